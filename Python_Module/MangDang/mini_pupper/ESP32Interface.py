@@ -158,6 +158,7 @@ class ESP32Interface:
         self.err = False
         self.verbose = False
         self.sentCounter = 0
+        self.fragmentSeq = 0
         self.parseProtocol = ParseProtocol()
         port = '/dev/ttyAMA1'
         baudrate = 3000000
@@ -178,6 +179,33 @@ class ESP32Interface:
                 break
         return ret
 
+    def receiveFragments(self, code):
+        # parts of a message sent in fragments ('F') are put back in place
+        # returns (command, data) of the whole message, or of a response sent in one frame
+        # parts start every 246 bytes : a part received twice is ignored, a part at another place restarts
+        data = None
+        parts = set()
+        seq = 0
+        while True:
+            ret = self.parseProtocol.parse(self.ser.read(), self.verbose)
+            if not isinstance(ret.code, str) or int(ret.code, base=16) != code:
+                continue
+            buff = ret.rawDecoded[5:-1]
+            if ret.CMD != 'F':
+                return ret.CMD, bytes(buff)
+            command, part_seq, offset, total = struct.unpack('<cBHH', buff[0:6])
+            if data is None or part_seq != seq or len(data) != total:
+                data = bytearray(total)
+                parts = set()
+                seq = part_seq
+            if offset % 246 or len(buff) - 6 != min(246, total - offset):
+                data = None
+                continue
+            data[offset:offset + len(buff) - 6] = buff[6:]
+            parts.add(offset)
+            if len(parts) == (total + 245) // 246:
+                return command.decode(), bytes(data)
+
     def decodeServoResponse(self, buffer):
         ret = buffer.rawDecoded[5:-1]
         ret_array = []
@@ -231,6 +259,143 @@ class ESP32Interface:
             data += int(positions[i]).to_bytes(length=2, byteorder='little', signed=False)
         self.executeServoCommand(0x76, 'W', data)
 
+    def servos_stream_position(self, sequence, timestamp, positions, speeds=None, times=None):
+        # fire and forget: the ESP32 does not answer streamed setpoints, stale frames are dropped
+        data = bytearray()
+        data += struct.pack('<II', sequence & 0xffffffff, timestamp & 0xffffffff)
+        data += struct.pack('<12H', *positions)
+        if speeds is not None or times is not None:
+            data += struct.pack('<12H', *(speeds if speeds is not None else [0] * 12))
+        if times is not None:
+            data += struct.pack('<12H', *times)
+        self.code = 0x40
+        self.command = 'W'
+        self.sendFunction(data)
+
+    def telemetry_subscribe(self, period_ms, count=-1):
+        # the ESP32 pushes the telemetry parameter every period_ms (>= 10ms), count times (-1 : forever)
+        data = bytearray(struct.pack('<BIiBI', 0x42, period_ms, count, 4, 0))
+        self.executeServoCommand(0x22, 'W', data)
+
+    def telemetry_read(self):
+        # waits for the next pushed (or requested) telemetry message
+        self.code = 0x42
+        ret = self.receiveFunction()
+        buff = ret.rawDecoded[5:-1]
+        version, timestamp, sequence, valid = struct.unpack('<BIIH', buff[0:11])
+        ret_dict = {'version': version, 'timestamp': timestamp, 'sequence': sequence, 'valid': valid}
+        ret_dict['position'] = list(struct.unpack('<12H', buff[11:35]))
+        ret_dict['load'] = list(struct.unpack('<12h', buff[35:59]))
+        ret_dict['acc'] = list(struct.unpack('<3f', buff[59:71]))
+        ret_dict['gyro'] = list(struct.unpack('<3f', buff[71:83]))
+        return ret_dict
+
+    def get_state(self):
+        # all servo feedback and the IMU sample in one round trip
+        ret = self.executeServoCommand(0x43, 'R')
+        if not self.err:
+            buff = ret.rawDecoded[5:-1]
+            version, timestamp, sequence, valid = struct.unpack('<BIIH', buff[0:11])
+            ret_dict = {'version': version, 'timestamp': timestamp, 'sequence': sequence, 'valid': valid}
+            ret_dict['position'] = list(struct.unpack('<12H', buff[11:35]))
+            ret_dict['speed'] = list(struct.unpack('<12h', buff[35:59]))
+            ret_dict['load'] = list(struct.unpack('<12h', buff[59:83]))
+            ret_dict['current'] = list(struct.unpack('<12h', buff[83:107]))
+            ret_dict['voltage'] = list(buff[107:119])
+            ret_dict['temperature'] = list(buff[119:131])
+            ret_dict['move'], ret_dict['imu_timestamp'], ret_dict['imu_valid'] = struct.unpack('<HIB', buff[131:138])
+            ret_dict['acc'] = list(struct.unpack('<3f', buff[138:150]))
+            ret_dict['gyro'] = list(struct.unpack('<3f', buff[150:162]))
+            ret_dict['dq'] = list(struct.unpack('<4f', buff[162:178]))
+            return ret_dict
+
+    def bus_get_stats(self):
+        # servo bus latency (us), timeouts, checksum errors and retries
+        ret = self.executeServoCommand(0x44, 'R')
+        if not self.err:
+            buff = ret.rawDecoded[5:-1]
+            ret_dict = {'version': buff[0], 'inst': {}, 'servo': []}
+            offset = 1
+            for name in ['write', 'read', 'sync_write', 'sync_read', 'ping']:
+                count, timeout, chkerr, lmin, mean, p50, p99, lmax = struct.unpack('<IIIHHHHH', buff[offset:offset + 22])
+                ret_dict['inst'][name] = {'count': count, 'timeout': timeout, 'chkerr': chkerr,
+                                          'min': lmin, 'mean': mean, 'p50': p50, 'p99': p99, 'max': lmax}
+                offset += 22
+            for i in range(12):
+                timeout, chkerr, retry = struct.unpack('<IIH', buff[offset:offset + 10])
+                ret_dict['servo'].append({'timeout': timeout, 'chkerr': chkerr, 'retry': retry})
+                offset += 10
+            return ret_dict
+
+    def bus_reset_stats(self):
+        self.executeServoCommand(0x44, 'W', bytearray(1))
+
+    def servos_push_waypoints(self, waypoints):
+        # waypoints: list of (timestamp_ms, positions), 1 to 8 per call, timestamps strictly increasing
+        # the ESP32 interpolates them at the servo control rate
+        # returns (accepted, free): waypoints taken and room left in the buffer
+        data = bytearray()
+        for timestamp, positions in waypoints:
+            data += struct.pack('<I', timestamp & 0xffffffff)
+            data += struct.pack('<12H', *positions)
+        ret = self.executeServoCommand(0x45, 'W', data)
+        if not self.err:
+            buff = ret.rawDecoded[5:-1]
+            return buff[0], buff[1]
+        return 0, 0
+
+    def batch(self, records):
+        # records: list of (command, code, data), e.g. ('R', 0x43, None) or ('W', 0x76, positions)
+        # processed in order by the ESP32 from one frame, answered in one frame
+        # returns the responses as (command, code, data), responses which did not fit in the frame are left out
+        # params waiting on the servo bus (0x7F ping) are not run in a batch : their data is the single byte 0xFF
+        # params larger than one frame (0x47 IMU batch) do not fit a record : their data is empty
+        data = bytearray()
+        for command, code, payload in records:
+            payload = bytearray() if payload is None else bytearray(payload)
+            data += struct.pack('<cBB', command.encode(), code, len(payload)) + payload
+        # code is the record count
+        self.ser.write(self.parseProtocol.compileMessage('M', len(records), data))
+        self.sentCounter += 1
+        while True:
+            ret = self.parseProtocol.parse(self.ser.read(), self.verbose)
+            if isinstance(ret.code, str) and ret.CMD == 'm':
+                break
+        buff = ret.rawDecoded[5:-1]
+        responses = []
+        offset = 0
+        while offset + 3 <= len(buff):
+            command, code, length = chr(buff[offset]), buff[offset + 1], buff[offset + 2]
+            responses.append((command, code, bytes(buff[offset + 3:offset + 3 + length])))
+            offset += 3 + length
+        return responses
+
+    def read_large(self, code):
+        # params larger than one frame are sent back in fragments
+        self.code = code
+        self.command = 'R'
+        self.sendFunction(bytearray())
+        command, data = self.receiveFragments(code)
+        return data
+
+    def write_large(self, code, data):
+        # sent in fragments of up to 246 bytes (up to 2048 bytes in all), returns 1 if written
+        self.fragmentSeq = (self.fragmentSeq + 1) % 256
+        for offset in range(0, len(data), 246):
+            part = struct.pack('<cBHH', b'W', self.fragmentSeq, offset, len(data)) + bytes(data[offset:offset + 246])
+            self.ser.write(self.parseProtocol.compileMessage('F', code, part))
+            self.sentCounter += 1
+        self.code = code
+        ret = self.receiveFunction()
+        return ret.rawDecoded[5]
+
+    def trajectory_get_status(self):
+        ret = self.executeServoCommand(0x46, 'R')
+        if not self.err:
+            buff = ret.rawDecoded[5:-1]
+            free, active, underruns, dropped = struct.unpack('<BBII', buff[0:10])
+            return {'free': free, 'active': active, 'underruns': underruns, 'dropped': dropped}
+
     def servo_get_position(self):
         ret = self.executeServoCommand(0x77, 'R')
         if not self.err:
@@ -239,7 +404,13 @@ class ESP32Interface:
     def servo_get_feedback(self):
         ret = self.executeServoCommand(0x78, 'R')
         if not self.err:
-            return self.decodeServoResponse(ret)
+            buff = ret.rawDecoded[5:-1]
+            ret_array = []
+            for i in range(0, len(buff), 12):
+                position, speed, load, current, voltage, temperature, move, valid = struct.unpack('<HhhhBBBB', buff[i:i + 12])
+                ret_array.append({'position': position, 'speed': speed, 'load': load, 'current': current,
+                                  'voltage': voltage, 'temperature': temperature, 'move': move, 'valid': valid})
+            return ret_array
 
     def servo_get_speed(self):
         ret = self.executeServoCommand(0x79, 'R')
@@ -272,8 +443,9 @@ class ESP32Interface:
             return self.decodeServoResponse(ret)
 
     def servo_ping(self):
+        # a single 0xFF byte : pings already pending on the ESP32, nothing done (returns None)
         ret = self.executeServoCommand(0x7f, 'R')
-        if not self.err:
+        if not self.err and ret.rawDecoded[5:-1] != b'\xff':
             return self.decodeServoResponse(ret)
 
     def imu_get_6dof(self):
@@ -287,6 +459,20 @@ class ESP32Interface:
                 ret_dict['gyro'].append(struct.unpack('f', buff[i:i + 4])[0])
         return ret_dict
 
+    def imu_get_batch(self):
+        # the last IMU samples (up to 64, 5ms apart), oldest first, sent in fragments
+        # sequence counts the samples read since start, the last one included : consecutive reads overlap or leave a gap
+        buff = self.read_large(0x47)
+        if len(buff) < 6:
+            return None
+        version, count, sequence = struct.unpack('<BBI', buff[0:6])
+        ret_dict = {'version': version, 'sequence': sequence, 'samples': []}
+        for i in range(count):
+            offset = 6 + i * 28
+            timestamp, ax, ay, az, gx, gy, gz = struct.unpack('<I6f', buff[offset:offset + 28])
+            ret_dict['samples'].append({'timestamp': timestamp, 'acc': [ax, ay, az], 'gyro': [gx, gy, gz]})
+        return ret_dict
+
     def imu_get_attitude(self):
         ret = self.executeServoCommand(0x61, 'R')
         buff = ret.rawDecoded[5:-1]
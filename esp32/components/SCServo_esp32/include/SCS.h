@@ -9,6 +9,8 @@
 #define _SCS_H
 
 #include "INST.h"
+#include "SCSFrame.h"
+#include "SCSProfiler.h"
 
 class SCS{
 public:
@@ -18,7 +20,7 @@ public:
 	int genWrite(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen);//普通写指令
 	int regWrite(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen);//异步写指令
 	int RegWriteAction(u8 ID = 0xfe);//异步写执行指令
-	void syncWrite(u8 ID[], u8 IDN, u8 MemAddr, u8 *nDat, u8 nLen);//同步写指令
+	int syncWrite(u8 ID[], u8 IDN, u8 MemAddr, u8 *nDat, u8 nLen);//同步写指令, returns the bytes sent (0 or less : frame not sent)
 	int writeByte(u8 ID, u8 MemAddr, u8 bDat);//写1个字节
 	int writeWord(u8 ID, u8 MemAddr, u16 wDat);//写2个字节
 	int Read(u8 ID, u8 MemAddr, u8 *nData, u8 nLen);//读指令
@@ -43,6 +45,7 @@ public:
 	u16 syncReadRxBuffLen;
 	u16 syncReadRxBuffMax;
 	u32 syncTimeOut;
+	SCSProfiler *Profiler;//总线时序统计，NULL表示不统计
 protected:
 	virtual int writeSCS(unsigned char *nDat, int nLen) = 0;
 	virtual int readSCS(unsigned char *nDat, int nLen) = 0;
@@ -52,9 +55,18 @@ protected:
 	virtual void wFlushSCS() = 0;
 protected:
 	void writeBuf(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen, u8 Fun);
+	int writeFrame();//一次写出txFrame
 	void Host2SCS(u8 *DataL, u8* DataH, u16 Data);//1个16位数拆分为2个8位数
 	u16	SCS2Host(u8 DataL, u8 DataH);//2个8位数组合为1个16位数
 	int	Ack(u8 ID);//返回应答
 	int checkHead();//帧头检测
+	int readStatus(u8 ID, u8 MemAddr, u8 *nData, u8 nLen);//读指令及应答
+	int pingStatus(u8 ID);//Ping指令及应答
+	int syncReadPacketDecode(u8 ID, u8 *nDat);//同步读返回包解码
+	int64_t profBegin();//事务开始时间
+	void profEnd(u8 Inst, u8 ID, int64_t Begin, int Ok);//记录事务结果
+protected:
+	SCSFrame txFrame;//发送帧缓存
+	u8 RxStat;//最后一次接收失败原因(SCS_PROF_TIMEOUT/SCS_PROF_CHKERR)
 };
 #endif
\ No newline at end of file
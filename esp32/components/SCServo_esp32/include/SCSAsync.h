@@ -0,0 +1,106 @@
+/*
+ * SCSAsync.h
+ * Feetech serial servo asynchronous transaction engine
+ * Requests are queued by any task, a dedicated task sends them one after the
+ * other, parses the status packets from the UART events and reports them
+ * through a completion callback.
+ * Two priorities: the real-time requests of the control loop are always sent
+ * first, background requests (console, blocking drivers) only when none is
+ * pending, so a real-time request waits for one background transaction at most.
+ */
+
+#ifndef _SCSASYNC_H
+#define _SCSASYNC_H
+
+#include "SCSFrame.h"
+#include "SCSParser.h"
+#include "SCSProfiler.h"
+#include "SCSTiming.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+
+#define SCS_ASYNC_QUEUE_LEN 8//pending requests
+#define SCS_ASYNC_BACKGROUND_LEN 2//pending background requests
+#define SCS_ASYNC_TASK_STACK_SIZE 3072
+#define SCS_ASYNC_TIMEOUT_US 10000//default upper bound of the response window
+
+//callback events
+#define SCS_ASYNC_PACKET 0//one status packet received
+#define SCS_ASYNC_DONE 1//all expected status packets received
+#define SCS_ASYNC_TIMEOUT 2//response window elapsed, Count packets received
+
+//request priorities
+#define SCS_ASYNC_REALTIME 0
+#define SCS_ASYNC_BACKGROUND 1
+
+struct SCSAsyncResult{
+	u8 Event;
+	u8 ID;
+	u8 Error;
+	u8 nLen;
+	const u8 *nDat;
+	u8 Count;
+};
+
+//called from the engine task, must not block
+typedef void (*SCSAsyncCallback)(void *Arg, const SCSAsyncResult *Result);
+
+class SCSAsync{
+public:
+	SCSAsync();
+	int begin(int uart_port_num, QueueHandle_t uart_queue, UBaseType_t Priority, BaseType_t Core);
+	int genWrite(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen, SCSAsyncCallback Callback = NULL, void *Arg = NULL);//write instruction
+	int writeByte(u8 ID, u8 MemAddr, u8 bDat, SCSAsyncCallback Callback = NULL, void *Arg = NULL);//write 1 byte
+	int Read(u8 ID, u8 MemAddr, u8 nLen, SCSAsyncCallback Callback, void *Arg = NULL);//read instruction, nLen bytes
+	int Ping(u8 ID, SCSAsyncCallback Callback, void *Arg = NULL);//ping instruction
+	int syncWrite(const u8 ID[], u8 IDN, u8 MemAddr, const u8 *nDat, u8 nLen, SCSAsyncCallback Callback = NULL, void *Arg = NULL);//sync write instruction, no status packet
+	int syncRead(const u8 ID[], u8 IDN, u8 MemAddr, u8 nLen, SCSAsyncCallback Callback, void *Arg = NULL);//sync read instruction, one status packet per ID
+	//any instruction frame (0xFF 0xFF ID LEN INSTR PARAM... CHK), Expect status packets of RspLen parameter bytes
+	int transfer(const u8 *Frame, int nLen, u8 Expect, u8 RspLen, SCSAsyncCallback Callback, void *Arg = NULL, u8 Prio = SCS_ASYNC_BACKGROUND);
+	int setBaud(u32 Baud, SCSAsyncCallback Callback = NULL, void *Arg = NULL);//change the line rate once the bytes before it are sent
+	bool isStarted() const { return Task!=NULL; }
+public:
+	u8 Level;//servo return level, 0 : only read and ping are answered
+	u32 TimeOut;//upper bound of the response window (us)
+	SCSTiming Timing;//response window from the baud rate and the expected status packets
+	SCSProfiler *Profiler;//bus timing statistics, NULL : disabled
+	u32 ChkErr(){ return Parser.ChkErr; }
+private:
+	struct Request{
+		SCSFrame Frame;
+		int nLen;
+		u8 Expect;//status packets expected
+		u8 RspLen;//parameter bytes in each status packet
+		u32 Baud;//nLen 0 : line rate change instead of a frame
+		SCSAsyncCallback Callback;
+		void *Arg;
+	};
+	int post(Request &Req, u8 Expect, u8 RspLen, SCSAsyncCallback Callback, void *Arg, u8 Prio = SCS_ASYNC_REALTIME);
+	int enqueue(const Request &Req, u8 Prio);
+	int pop();
+	static void task(void *Arg);
+	static void timer(void *Arg);
+	void next();
+	void receive();
+	void finish(u8 Event);
+	void notify(u8 Event);
+	u8 profInst() const;
+private:
+	int uart_port_num;
+	QueueHandle_t EventQueue;
+	QueueHandle_t RequestQueue;
+	QueueHandle_t BackgroundQueue;
+	TaskHandle_t Task;
+	esp_timer_handle_t Timer;
+	SCSParser Parser;
+	Request Cur;//request waiting for its status packets
+	u8 Active;
+	u8 Count;
+	int64_t Deadline;
+	int64_t Begin;//current request put on the wire
+	u32 Seen;//bit i set : status packet of ID i received (IDs below 32)
+};
+
+#endif
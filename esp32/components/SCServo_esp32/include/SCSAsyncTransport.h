@@ -0,0 +1,41 @@
+/*
+ * SCSAsyncTransport.h
+ * Feetech serial servo transport through the asynchronous engine
+ * Lets the blocking drivers (SCSCL, SMS_STS...) share the bus with the
+ * engine: each transaction is posted as a background request, the caller
+ * blocks until its status packets are back. Status packets are rebuilt as
+ * they came on the wire for the driver to parse them again.
+ * One transaction at a time, the caller serializes the driver.
+ */
+
+#ifndef _SCSASYNCTRANSPORT_H
+#define _SCSASYNCTRANSPORT_H
+
+#include "SCSTransport.h"
+#include "SCSAsync.h"
+#include "freertos/semphr.h"
+
+#define SCS_ASYNC_TRANSPORT_RX_LEN 512//status packets of one transaction
+
+class SCSAsyncTransport : public SCSTransport{
+public:
+	SCSAsyncTransport(SCSAsync &Engine);
+	virtual ~SCSAsyncTransport();
+	virtual int write(const u8 *nDat, int nLen);//frame bytes are kept until wFlush()
+	virtual int read(u8 *nDat, int nLen, u32 TimeOut);//status packets received by wFlush()
+	virtual void rFlush();
+	virtual void wFlush();//post the frame and wait for its status packets
+	virtual void setBaud(u32 Baud);
+private:
+	static void callback(void *Arg, const SCSAsyncResult *Result);
+	void expect(u8 &Expect, u8 &RspLen) const;
+	SCSAsync &Engine;
+	SemaphoreHandle_t Done;
+	u8 TxBuf[SCS_FRAME_MAX_LEN];
+	int TxLen;
+	u8 RxBuf[SCS_ASYNC_TRANSPORT_RX_LEN];
+	int RxLen;
+	int RxPos;
+};
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * SCSBaud.h
+ * Feetech serial servo baud rate manager
+ * Finds the rate each servo listens at, moves servos to another rate
+ * (EEPROM unlocked for the write) and measures the sync write / sync read
+ * cycle time at the current rate. Blocking, the caller owns the bus.
+ */
+
+#ifndef _SCSBAUD_H
+#define _SCSBAUD_H
+
+#include "SCSCL.h"
+
+#define SCS_BAUD_NUM 12//_1M to _4800 in INST.h
+#define SCS_BAUD_NONE 0xff//servo not found
+#define SCS_BAUD_MAX_SERVO 32
+#define SCS_BAUD_PING_RETRY 2
+#define SCS_BAUD_BENCH_ADDR SCSCL_PRESENT_POSITION_L//feedback read by the benchmark, as the control task does
+#define SCS_BAUD_BENCH_LEN (SCSCL_PRESENT_CURRENT_H-SCSCL_PRESENT_POSITION_L+1)
+#define SCS_BAUD_BENCH_TIMEOUT 10//ms, sync read upper bound
+
+struct SCSBaudBench{
+	u32 Baud;
+	u16 Cycles;
+	u8 Servos;//servos written and read
+	u32 SyncWrite;//mean us to queue the sync write
+	u32 SyncRead;//mean us until the last status packet
+	u32 Cycle;//mean us, sync write + sync read
+	u32 Missed;//status packets missing or corrupted
+};
+
+class SCSBaud{
+public:
+	static u32 rate(u8 Index);//INST.h index (_1M, _0_5M...) to baud, 0 if unknown
+	static u8 index(u32 Baud);//SCS_BAUD_NONE if not in the table
+	static u8 discover(SCSCL &Bus, u8 ID, u8 First = SCS_BAUD_NONE);//rate index ID answers at, First tried first, the bus is left at that rate
+	static int scan(SCSCL &Bus, const u8 ID[], u8 IDN, u8 Index[]);//rate index of each servo, returns servos found, the bus is left at its rate
+	static int migrate(SCSCL &Bus, const u8 ID[], u8 IDN, u8 Index);//move servos to a rate, returns servos answering at it, the bus is left at it
+	static int bench(SCSCL &Bus, const u8 ID[], u8 IDN, u16 Cycles, SCSBaudBench &Result);//goal positions are written back unchanged, returns servos benched
+};
+
+#endif
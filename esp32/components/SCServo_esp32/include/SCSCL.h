@@ -16,6 +16,8 @@
 //-------EPROM(读写)--------
 #define SCSCL_ID 5
 #define SCSCL_BAUD_RATE 6
+#define SCSCL_RETURN_DELAY_TIME 7
+#define SCSCL_RETURN_LEVEL 8
 #define SCSCL_MIN_ANGLE_LIMIT_L 9
 #define SCSCL_MIN_ANGLE_LIMIT_H 10
 #define SCSCL_MAX_ANGLE_LIMIT_L 11
@@ -47,6 +49,7 @@
 #define SCSCL_PRESENT_CURRENT_H 70
 
 #include "SCSerial.h"
+#include "SCSShadow.h"
 
 class SCSCL : public SCSerial
 {
@@ -70,8 +73,11 @@ public:
 	virtual int ReadTemper(int ID);//读温度
 	virtual int ReadMove(int ID);//读移动状态
 	virtual int ReadCurrent(int ID);//读电流
+	virtual int SyncWriteDelta(u8 First, u8 Last);//sync write the shadow registers changed in [First, Last], returns servos written
+public:
+	SCSShadow Shadow;//per servo registers : written through WritePos/EnableTorque/Shadow.write, read by FeedBack
 private:
-	u8 Mem[SCSCL_PRESENT_CURRENT_H-SCSCL_PRESENT_POSITION_L+1];
+	int MemID;//servo read by the last FeedBack, ID -1 of the Read functions
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,203 @@
+/*
+ * SCSFamily.h
+ * Feetech serial servo families resolved at compile time
+ * A family policy gives the register map, the byte order and the sign bit
+ * conventions of a servo series. SCSCodec encodes and decodes registers and
+ * builds frames for one family without runtime branches on End, SCSDriver
+ * is a non-virtual driver on top of it. Alongside SCSCL and SMS_STS, which
+ * keep their virtual interface.
+ */
+
+#ifndef _SCSFAMILY_H
+#define _SCSFAMILY_H
+
+#include <stddef.h>
+#include "SCSerial.h"
+#include "SCSCL.h"
+#include "SMS_STS.h"
+
+struct SCSCLFamily{
+	static const u8 End = 1;//big endian
+	static const u8 Acc = 0;//no acceleration register before the goal position
+	static const u16 PositionSign = 0;//unsigned position
+	static const u16 SpeedSign = 1<<15;
+	static const u16 LoadSign = 1<<10;
+	static const u16 CurrentSign = 1<<15;
+	static const u8 TorqueEnable = SCSCL_TORQUE_ENABLE;
+	static const u8 GoalAcc = SCSCL_GOAL_POSITION_L;
+	static const u8 GoalPosition = SCSCL_GOAL_POSITION_L;
+	static const u8 GoalTime = SCSCL_GOAL_TIME_L;
+	static const u8 GoalSpeed = SCSCL_GOAL_SPEED_L;
+	static const u8 Lock = SCSCL_LOCK;
+	static const u8 PresentPosition = SCSCL_PRESENT_POSITION_L;
+	static const u8 PresentSpeed = SCSCL_PRESENT_SPEED_L;
+	static const u8 PresentLoad = SCSCL_PRESENT_LOAD_L;
+	static const u8 PresentVoltage = SCSCL_PRESENT_VOLTAGE;
+	static const u8 PresentTemperature = SCSCL_PRESENT_TEMPERATURE;
+	static const u8 Moving = SCSCL_MOVING;
+	static const u8 PresentCurrent = SCSCL_PRESENT_CURRENT_L;
+};
+
+struct SMSSTSFamily{
+	static const u8 End = 0;//little endian
+	static const u8 Acc = 1;//acceleration register before the goal position
+	static const u16 PositionSign = 1<<15;
+	static const u16 SpeedSign = 1<<15;
+	static const u16 LoadSign = 1<<10;
+	static const u16 CurrentSign = 1<<15;
+	static const u8 TorqueEnable = SMS_STS_TORQUE_ENABLE;
+	static const u8 GoalAcc = SMS_STS_ACC;
+	static const u8 GoalPosition = SMS_STS_GOAL_POSITION_L;
+	static const u8 GoalTime = SMS_STS_GOAL_TIME_L;
+	static const u8 GoalSpeed = SMS_STS_GOAL_SPEED_L;
+	static const u8 Lock = SMS_STS_LOCK;
+	static const u8 PresentPosition = SMS_STS_PRESENT_POSITION_L;
+	static const u8 PresentSpeed = SMS_STS_PRESENT_SPEED_L;
+	static const u8 PresentLoad = SMS_STS_PRESENT_LOAD_L;
+	static const u8 PresentVoltage = SMS_STS_PRESENT_VOLTAGE;
+	static const u8 PresentTemperature = SMS_STS_PRESENT_TEMPERATURE;
+	static const u8 Moving = SMS_STS_MOVING;
+	static const u8 PresentCurrent = SMS_STS_PRESENT_CURRENT_L;
+};
+
+//present block, as read by FeedBack
+struct SCSFeedback{
+	s16 Position;
+	s16 Speed;
+	s16 Load;
+	u8 Voltage;
+	u8 Temperature;
+	u8 Move;
+	s16 Current;
+};
+
+template<class F>
+class SCSCodec{
+public:
+	static const u8 GoalLen = F::Acc+6;//[acc] position time speed
+	static const u8 FeedBackLen = F::PresentCurrent+2-F::PresentPosition;
+
+	//End 1 : high byte first
+	static inline void put(u8 *Buf, u16 Data){
+		Buf[1-F::End] = Data>>8;
+		Buf[F::End] = Data&0xff;
+	}
+	static inline u16 get(const u8 *Buf){
+		return (u16)(Buf[1-F::End]<<8)|Buf[F::End];
+	}
+	//sign and magnitude, Bit 0 : unsigned
+	static inline u16 sign(s16 Value, u16 Bit){
+		if(!Bit){
+			return (u16)Value;
+		}
+		u16 Neg = (u16)(Value>>15);
+		u16 Mag = ((u16)Value^Neg)-Neg;
+		return Mag|(Neg&Bit);
+	}
+	static inline s16 unsign(u16 Raw, u16 Bit){
+		if(!Bit){
+			return (s16)Raw;
+		}
+		s16 Neg = -(s16)((Raw&Bit)!=0);
+		s16 Mag = (s16)(Raw&~Bit);
+		return (Mag^Neg)-Neg;
+	}
+	//goal block from GoalAcc, returns GoalLen
+	static inline u8 goal(u8 *Buf, s16 Position, u16 Time, u16 Speed, u8 ACC = 0){
+		if(F::Acc){
+			Buf[0] = ACC;
+		}
+		put(Buf+F::Acc, sign(Position, F::PositionSign));
+		put(Buf+F::Acc+2, Time);
+		put(Buf+F::Acc+4, Speed);
+		return GoalLen;
+	}
+	//present block from PresentPosition, FeedBackLen bytes
+	static inline void feedback(const u8 *Block, SCSFeedback &Out){
+		Out.Position = unsign(get(Block+F::PresentPosition-F::PresentPosition), F::PositionSign);
+		Out.Speed = unsign(get(Block+F::PresentSpeed-F::PresentPosition), F::SpeedSign);
+		Out.Load = unsign(get(Block+F::PresentLoad-F::PresentPosition), F::LoadSign);
+		Out.Voltage = Block[F::PresentVoltage-F::PresentPosition];
+		Out.Temperature = Block[F::PresentTemperature-F::PresentPosition];
+		Out.Move = Block[F::Moving-F::PresentPosition];
+		Out.Current = unsign(get(Block+F::PresentCurrent-F::PresentPosition), F::CurrentSign);
+	}
+	//frames, returns the frame length (0 if it overflowed)
+	static inline int writePos(SCSFrame &Frame, u8 ID, s16 Position, u16 Time, u16 Speed, u8 ACC = 0){
+		u8 bBuf[GoalLen];
+		goal(bBuf, Position, Time, Speed, ACC);
+		Frame.begin(ID, INST_WRITE);
+		Frame.add(F::GoalAcc);
+		Frame.add(bBuf, GoalLen);
+		return Frame.end();
+	}
+	//Time, Speed and ACC may be NULL (0)
+	static inline int syncWritePos(SCSFrame &Frame, const u8 ID[], u8 IDN, const s16 Position[], const u16 Time[], const u16 Speed[], const u8 ACC[] = NULL){
+		Frame.begin(0xfe, INST_SYNC_WRITE);
+		Frame.add(F::GoalAcc);
+		Frame.add(GoalLen);
+		for(u8 i=0; i<IDN; i++){
+			u8 bBuf[GoalLen];
+			goal(bBuf, Position[i], Time ? Time[i] : 0, Speed ? Speed[i] : 0, ACC ? ACC[i] : 0);
+			Frame.add(ID[i]);
+			Frame.add(bBuf, GoalLen);
+		}
+		return Frame.end();
+	}
+	static inline int syncReadFeedBack(SCSFrame &Frame, const u8 ID[], u8 IDN){
+		Frame.begin(0xfe, INST_SYNC_READ);
+		Frame.add(F::PresentPosition);
+		Frame.add(FeedBackLen);
+		Frame.add(ID, IDN);
+		return Frame.end();
+	}
+};
+
+template<class F>
+class SCSDriver : public SCSerial
+{
+public:
+	typedef SCSCodec<F> Codec;
+	SCSDriver():SCSerial(F::End){}
+	SCSDriver(u8 Level):SCSerial(F::End, Level){}
+	int WritePos(u8 ID, s16 Position, u16 Time, u16 Speed = 0, u8 ACC = 0){
+		u8 bBuf[Codec::GoalLen];
+		Codec::goal(bBuf, Position, Time, Speed, ACC);
+		return genWrite(ID, F::GoalAcc, bBuf, Codec::GoalLen);
+	}
+	void SyncWritePos(const u8 ID[], u8 IDN, const s16 Position[], const u16 Time[], const u16 Speed[], const u8 ACC[] = NULL){
+		rFlushSCS();
+		Codec::syncWritePos(txFrame, ID, IDN, Position, Time, Speed, ACC);
+		writeFrame();
+		wFlushSCS();
+	}
+	int EnableTorque(u8 ID, u8 Enable){
+		return writeByte(ID, F::TorqueEnable, Enable);
+	}
+	int unLockEprom(u8 ID){
+		return writeByte(ID, F::Lock, 0);
+	}
+	int LockEprom(u8 ID){
+		return writeByte(ID, F::Lock, 1);
+	}
+	int FeedBack(u8 ID, SCSFeedback &Out){
+		u8 Mem[Codec::FeedBackLen];
+		if(Read(ID, F::PresentPosition, Mem, sizeof(Mem))!=sizeof(Mem)){
+			return -1;
+		}
+		Codec::feedback(Mem, Out);
+		return sizeof(Mem);
+	}
+	int ReadPos(u8 ID){
+		int Pos = readWord(ID, F::PresentPosition);
+		if(Pos==-1){
+			return -1;
+		}
+		return Codec::unsign(Pos, F::PositionSign);
+	}
+};
+
+typedef SCSDriver<SCSCLFamily> SCSCLDriver;
+typedef SCSDriver<SMSSTSFamily> SMSSTSDriver;
+
+#endif
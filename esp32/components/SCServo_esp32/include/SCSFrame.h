@@ -0,0 +1,68 @@
+/*
+ * SCSFrame.h
+ * Feetech serial servo instruction frame builder
+ * 0xFF 0xFF ID LEN INSTR PARAM... CHK, built in place without allocation
+ */
+
+#ifndef _SCSFRAME_H
+#define _SCSFRAME_H
+
+#include "INST.h"
+
+#define SCS_FRAME_MAX_LEN (4+255)//header, ID, LEN + at most 255 bytes
+
+class SCSFrame{
+public:
+	SCSFrame(){
+		Len = 0;
+		Sum = 0;
+		Overflow = 0;
+	}
+	//start a new frame: header, ID and instruction
+	void begin(u8 ID, u8 Fun){
+		Buf[0] = 0xff;
+		Buf[1] = 0xff;
+		Buf[2] = ID;
+		Buf[4] = Fun;
+		Len = 5;
+		Sum = ID + Fun;
+		Overflow = 0;
+	}
+	//append one parameter byte, checksum is updated on the fly
+	void add(u8 bDat){
+		if(Len>=SCS_FRAME_MAX_LEN-1){
+			Overflow = 1;
+			return;
+		}
+		Buf[Len++] = bDat;
+		Sum += bDat;
+	}
+	void add(const u8 *nDat, u8 nLen){
+		for(u8 i=0; i<nLen; i++){
+			add(nDat[i]);
+		}
+	}
+	//write LEN and CHK, returns the frame length (0 if the frame overflowed)
+	int end(){
+		if(Overflow){
+			return 0;
+		}
+		u8 msgLen = Len - 3;//INSTR + PARAM... + CHK
+		Buf[3] = msgLen;
+		Buf[Len] = ~(u8)(Sum + msgLen);
+		return Len + 1;
+	}
+	u8 *data(){
+		return Buf;
+	}
+	const u8 *data() const{
+		return Buf;
+	}
+private:
+	u8 Buf[SCS_FRAME_MAX_LEN];
+	int Len;
+	u8 Sum;
+	u8 Overflow;
+};
+
+#endif
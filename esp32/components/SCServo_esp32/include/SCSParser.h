@@ -0,0 +1,32 @@
+/*
+ * SCSParser.h
+ * Feetech serial servo status packet parser
+ * 0xFF 0xFF ID LEN ERR PARAM... CHK, fed one byte at a time as it arrives
+ */
+
+#ifndef _SCSPARSER_H
+#define _SCSPARSER_H
+
+#include "INST.h"
+
+#define SCS_PARSER_MAX_PARAM 253//LEN is at most 255 (ERR + PARAM... + CHK)
+
+class SCSParser{
+public:
+	SCSParser();
+	void reset();//drop any partial packet
+	int parse(u8 bDat);//returns 1 when a complete packet with a valid checksum has been received
+public:
+	u8 ID;//last complete packet
+	u8 Error;
+	u8 nLen;
+	u8 Dat[SCS_PARSER_MAX_PARAM];
+	u32 ChkErr;//packets dropped on checksum error
+private:
+	u8 State;
+	u8 Len;
+	u8 Index;
+	u8 Sum;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * SCSProfiler.h
+ * Feetech serial servo bus timing statistics
+ * Latency histogram, timeouts and checksum errors per instruction,
+ * response counters and retries per servo ID.
+ */
+
+#ifndef _SCSPROFILER_H
+#define _SCSPROFILER_H
+
+#include <stdint.h>
+#include "INST.h"
+
+//instruction classes
+#define SCS_PROF_WRITE 0//write, reg write, action, recovery
+#define SCS_PROF_READ 1
+#define SCS_PROF_SYNC_WRITE 2
+#define SCS_PROF_SYNC_READ 3
+#define SCS_PROF_PING 4
+#define SCS_PROF_INST_NUM 5
+
+//transaction results
+#define SCS_PROF_OK 0
+#define SCS_PROF_TIMEOUT 1//status packet missing or truncated
+#define SCS_PROF_CHKERR 2//status packet corrupted (checksum, ID or length mismatch)
+
+#define SCS_PROF_MAX_ID 32//per servo counters for IDs 0 to 31
+#define SCS_PROF_BUCKETS 16//bucket i : latency below 2^(i+5) us, last bucket : everything above
+#define SCS_PROF_BUCKET_SHIFT 5
+
+struct SCSProfInst{
+	u32 Count;//completed transactions (latency recorded)
+	u32 Timeout;
+	u32 ChkErr;
+	u32 Min;//us
+	u32 Max;//us
+	uint64_t Sum;//us
+	u32 Hist[SCS_PROF_BUCKETS];
+};
+
+struct SCSProfServo{
+	u32 Count;//status packets received
+	u32 Timeout;
+	u32 ChkErr;
+	u32 Retry;//retries issued by the application
+};
+
+//counters are plain integers : a reader may see a transaction half accounted for
+class SCSProfiler{
+public:
+	SCSProfiler();
+	void reset();
+	static int64_t now();//us
+	void record(u8 Inst, u8 ID, int64_t Begin, u8 Res);//one transaction started at Begin
+	void response(u8 ID, u8 Res);//one status packet of a sync read
+	void chkErr(u8 Inst, u8 ID);//corrupted status packet, the transaction goes on
+	void retry(u8 ID);
+	u32 mean(u8 Inst) const;
+	u32 percentile(u8 Inst, u8 Pct) const;//upper bound of the bucket holding the Pct-th percentile
+	static u32 bucketLimit(u8 Bucket);//upper bound of a bucket (us), 0 : unbounded
+public:
+	SCSProfInst Inst[SCS_PROF_INST_NUM];
+	SCSProfServo Servo[SCS_PROF_MAX_ID];
+};
+
+#endif
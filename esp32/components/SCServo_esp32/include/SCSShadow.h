@@ -0,0 +1,56 @@
+/*
+ * SCSShadow.h
+ * Feetech serial servo register shadow
+ * Per servo copy of the SRAM control table (torque enable to present
+ * current, same addresses on SCSCL and SMS_STS). Bytes written by the host
+ * are marked dirty when they differ from the shadow, so that a single sync
+ * write carries only the servos and the registers that changed. Bytes read
+ * back from the servos are served without bus traffic.
+ * Not thread safe : the host writes, the read backs and the deltas must all
+ * come from one task (or be serialized by the caller, like the driver itself).
+ */
+
+#ifndef _SCSSHADOW_H
+#define _SCSSHADOW_H
+
+#include "INST.h"
+
+#define SCS_SHADOW_FIRST 40//torque enable
+#define SCS_SHADOW_LAST 70//present current H
+#define SCS_SHADOW_LEN (SCS_SHADOW_LAST-SCS_SHADOW_FIRST+1)
+#define SCS_SHADOW_MAX_ID 32//servo ID 0 to 31, other IDs are not shadowed
+#define SCS_SHADOW_BROADCAST 0xfe
+
+class SCSShadow{
+public:
+	SCSShadow(u8 End);
+	void clear();//nothing known, nothing dirty
+	//host side : bytes that differ from the shadow (or were never known) become dirty
+	void write(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen);
+	void writeByte(u8 ID, u8 MemAddr, u8 bDat);
+	void writeWord(u8 ID, u8 MemAddr, u16 wDat);
+	//servo side
+	void sent(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen);//written without the shadow : known and clean, the broadcast ID updates every servo
+	void update(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen);//read back : dirty bytes keep the host value
+	//cached value, -1 if a byte is unknown
+	int read(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen) const;
+	int readByte(u8 ID, u8 MemAddr) const;
+	int readWord(u8 ID, u8 MemAddr) const;
+	void touch(u8 ID, u8 First, u8 Last);//known bytes in [First, Last] are sent again (lost or unacknowledged writes), broadcast ID : every servo
+	void forget(u8 ID);//servo reset or replaced
+	int dirty(u8 First, u8 Last) const;//servos with dirty bytes in [First, Last]
+	//next sync write of the dirty bytes in [First, Last] : servo IDs, MemAddr and nLen of the write,
+	//IDN x nLen bytes in nDat (up to Last-First+1 per servo). Dirty bits of the servos written are cleared.
+	//Returns the number of servos, 0 when nothing is dirty. Call until 0 when the servos do not share a range.
+	int delta(u8 First, u8 Last, u8 ID[], u8 *nDat, u8 &MemAddr, u8 &nLen);
+public:
+	u8 End;//byte order of the servo family, as SCS::End
+private:
+	static u32 mask(u8 First, u8 Last);//shadow bits of [First, Last], clipped to the shadow
+	static u32 run(u32 Bits);//lowest contiguous run of bits
+	u8 Mem[SCS_SHADOW_MAX_ID][SCS_SHADOW_LEN];
+	u32 Known[SCS_SHADOW_MAX_ID];//bit i : address SCS_SHADOW_FIRST+i holds a valid value
+	u32 Dirty[SCS_SHADOW_MAX_ID];//bit i : address SCS_SHADOW_FIRST+i is to be written
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * SCSTiming.h
+ * Feetech serial servo bus timing model
+ * Response windows computed from the baud rate, the frame lengths and the
+ * servo return delay, so that a missing servo costs a few hundred
+ * microseconds instead of a whole timeout.
+ */
+
+#ifndef _SCSTIMING_H
+#define _SCSTIMING_H
+
+#include <stdint.h>
+#include "INST.h"
+
+#define SCS_TIMING_MARGIN_US 500//servo processing, UART RX timeout and scheduling slack
+#define SCS_TIMING_PACKET_GAP_US 50//turnaround between two status packets of a sync read
+#define SCS_TIMING_MIN_PACKET_LEN 6//0xFF 0xFF ID LEN ERR CHK
+
+class SCSTiming{
+public:
+	SCSTiming(u32 Baud = 1000000){
+		ReturnDelay = 0;
+		Margin = SCS_TIMING_MARGIN_US;
+		PacketGap = SCS_TIMING_PACKET_GAP_US;
+		setBaud(Baud);
+	}
+	void setBaud(u32 Baud){
+		this->Baud = Baud;
+		ByteTime = (10*1000000000ULL+Baud-1)/Baud;
+	}
+	//us to put nLen bytes on the wire (start + 8 data + stop bits)
+	u32 bytes(int nLen) const{
+		return (u32)(((uint64_t)nLen*ByteTime+999)/1000);
+	}
+	//us from the end of the instruction to the last byte of Packets status packets, nLen bytes in total
+	u32 response(int nLen, int Packets = 1) const{
+		return Margin+Packets*(ReturnDelay+PacketGap)+bytes(nLen);
+	}
+public:
+	u32 Baud;
+	u32 ByteTime;//ns per byte
+	u32 ReturnDelay;//us, servo return delay time register x 2us
+	u32 Margin;//us, once per response
+	u32 PacketGap;//us, per status packet
+};
+
+#endif
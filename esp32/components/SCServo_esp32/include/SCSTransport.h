@@ -0,0 +1,22 @@
+/*
+ * SCSTransport.h
+ * Feetech serial servo byte transport
+ * Anything that can carry the half duplex bus: UART, simulated bus...
+ */
+
+#ifndef _SCSTRANSPORT_H
+#define _SCSTRANSPORT_H
+
+#include "INST.h"
+
+class SCSTransport{
+public:
+	virtual ~SCSTransport(){}
+	virtual int write(const u8 *nDat, int nLen) = 0;//send nLen bytes, returns bytes sent
+	virtual int read(u8 *nDat, int nLen, u32 TimeOut) = 0;//receive up to nLen bytes within TimeOut us, returns bytes received
+	virtual void rFlush() = 0;//drop received bytes
+	virtual void wFlush() = 0;//wait for sent bytes
+	virtual void setBaud(u32){}//change the line rate
+};
+
+#endif
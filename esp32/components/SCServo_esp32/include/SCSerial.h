@@ -11,6 +11,8 @@
 // #include "HardwareSerial.h"
 
 #include "SCS.h"
+#include "SCSTransport.h"
+#include "SCSTiming.h"
 
 class SCSerial : public SCS
 {
@@ -18,6 +20,7 @@ public:
 	SCSerial();
 	SCSerial(u8 End);
 	SCSerial(u8 End, u8 Level);
+	void setBaud(u32 Baud);//串口及应答窗口切换到Baud
 
 protected:
 	int writeSCS(unsigned char *nDat, int nLen);//输出nLen字节
@@ -26,12 +29,18 @@ protected:
 	int writeSCS(unsigned char bDat);//输出1字节
 	void rFlushSCS();//
 	void wFlushSCS();//
+	int readWindow(unsigned char *nDat, int nLen, u32 Window);//在Window微秒内输入nLen字节
 public:
-	unsigned long IOTimeOut;//输入输出超时
+	unsigned long IOTimeOut;//输入输出超时上限(ms)
+	SCSTiming Timing;//按波特率计算应答窗口
 	int uart_port_num;//串口number
+	SCSTransport *Transport;//set : bytes go through Transport instead of the UART
 	int Err;
 public:
 	virtual int getErr(){  return Err;  }
+protected:
+	int64_t TxEnd;//最后一个发送字节离开串口的时间(us)
+	u8 RxFirst;//下一次输入是应答的第一个字节
 };
 
 #endif
@@ -0,0 +1,79 @@
+/*
+ * SCSim.h
+ * Simulated Feetech bus of SCSCL servos, for host builds
+ * Time is virtual and only moves with the bytes on the wire, so runs are
+ * deterministic and the bus time of a sequence of instructions can be measured.
+ */
+
+#ifndef _SCSIM_H
+#define _SCSIM_H
+
+#include "SCSTransport.h"
+#include "SCSFrame.h"
+#include <stdint.h>
+
+#define SCSIM_MAX_SERVO 16
+#define SCSIM_MEM_SIZE 71//up to SCSCL_PRESENT_CURRENT_H
+#define SCSIM_RX_SIZE 4096
+
+struct SCSimServo{
+	u8 Mem[SCSIM_MEM_SIZE];
+	u8 Online;
+	u8 RegPending;//REG_WRITE waiting for REG_ACTION
+	u8 RegAddr;
+	u8 RegLen;
+	u8 RegDat[SCSIM_MEM_SIZE];
+	double Position;//simulated position (steps)
+};
+
+class SCSim : public SCSTransport{
+public:
+	SCSim(u32 Baud = 500000, u8 End = 1);
+	SCSimServo *addServo(u8 ID);//default SCSCL memory table
+	SCSimServo *servo(u8 ID);
+	void step(u32 Us);//let time run, servos move towards their goal
+	//SCSTransport
+	int write(const u8 *nDat, int nLen);
+	int read(u8 *nDat, int nLen, u32 TimeOut);
+	void rFlush();
+	void wFlush();
+	void setBaud(u32 Baud);
+public:
+	//fault injection
+	u32 ResponseDelay;//us added to the servo return delay
+	u32 DropRate;//one byte out of DropRate returned by the servos is lost (0 : none)
+	u32 CorruptRate;//one status packet out of CorruptRate has a wrong checksum (0 : none)
+	u32 Seed;
+	//statistics
+	uint64_t Now;//virtual time (ns)
+	u32 TxBytes;
+	u32 RxBytes;
+	u32 Instructions;
+	u32 StatusPackets;
+private:
+	u16 word(SCSimServo *Servo, u8 Addr);
+	void setWord(SCSimServo *Servo, u8 Addr, u16 Data);
+	u32 rand();
+	void instruction(const u8 *Pkt, u8 nLen);//ID LEN INSTR PARAM...
+	void reset(SCSimServo *Servo, u8 ID);
+	void memWrite(SCSimServo *Servo, u8 Addr, const u8 *nDat, u8 nLen);
+	void reply(SCSimServo *Servo, u8 ID, const u8 *nDat, u8 nLen);
+	void advance(uint64_t To);//move virtual time and servos forward
+	void update(SCSimServo *Servo);//present registers from the simulated position
+	u8 listening(SCSimServo *Servo);//the servo baud rate register matches the bus
+private:
+	u32 Baud;
+	u32 ByteTime;//ns per byte on the wire (start + 8 data + stop bits)
+	u8 End;
+	SCSimServo Servo[SCSIM_MAX_SERVO];
+	u8 Count;
+	u8 TxPkt[SCS_FRAME_MAX_LEN];//instruction being received
+	int TxLen;
+	u8 RxBuf[SCSIM_RX_SIZE];//status bytes and their arrival time
+	uint64_t RxTime[SCSIM_RX_SIZE];
+	int RxHead;
+	int RxTail;
+	uint64_t BusFree;//the servos answer one after the other
+};
+
+#endif
@@ -53,6 +53,7 @@
 #define SMS_STS_PRESENT_CURRENT_H 70
 
 #include "SCSerial.h"
+#include "SCSShadow.h"
 
 class SMS_STS : public SCSerial
 {
@@ -77,8 +78,11 @@ public:
 	virtual int ReadTemper(int ID);//读温度
 	virtual int ReadMove(int ID);//读移动状态
 	virtual int ReadCurrent(int ID);//读电流
+	virtual int SyncWriteDelta(u8 First, u8 Last);//sync write the shadow registers changed in [First, Last], returns servos written
+public:
+	SCSShadow Shadow;//per servo registers : written through WritePos/EnableTorque/Shadow.write, read by FeedBack
 private:
-	u8 Mem[SMS_STS_PRESENT_CURRENT_H-SMS_STS_PRESENT_POSITION_L+1];
+	int MemID;//servo read by the last FeedBack, ID -1 of the Read functions
 };
 
 #endif
\ No newline at end of file
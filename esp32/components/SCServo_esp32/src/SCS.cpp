@@ -12,6 +12,8 @@ SCS::SCS()
 {
 	Level = 1;//除广播指令所有指令返回应答
 	Error = 0;
+	Profiler = NULL;
+	RxStat = SCS_PROF_OK;
 }
 
 SCS::SCS(u8 End)
@@ -19,6 +21,8 @@ SCS::SCS(u8 End)
 	Level = 1;
 	this->End = End;
 	Error = 0;
+	Profiler = NULL;
+	RxStat = SCS_PROF_OK;
 }
 
 SCS::SCS(u8 End, u8 Level)
@@ -26,6 +30,8 @@ SCS::SCS(u8 End, u8 Level)
 	this->Level = Level;
 	this->End = End;
 	Error = 0;
+	Profiler = NULL;
+	RxStat = SCS_PROF_OK;
 }
 
 //1个16位数拆分为2个8位数
@@ -60,116 +66,117 @@ u16 SCS::SCS2Host(u8 DataL, u8 DataH)
 
 void SCS::writeBuf(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen, u8 Fun)
 {
-	u8 msgLen = 2;
-	u8 bBuf[6];
-	u8 CheckSum = 0;
-	bBuf[0] = 0xff;
-	bBuf[1] = 0xff;
-	bBuf[2] = ID;
-	bBuf[4] = Fun;
+	txFrame.begin(ID, Fun);
 	if(nDat){
-		msgLen += nLen + 1;
-		bBuf[3] = msgLen;
-		bBuf[5] = MemAddr;
-		writeSCS(bBuf, 6);
-		
-	}else{
-		bBuf[3] = msgLen;
-		writeSCS(bBuf, 5);
+		txFrame.add(MemAddr);
+		txFrame.add(nDat, nLen);
 	}
-	CheckSum = ID + msgLen + Fun + MemAddr;
-	u8 i = 0;
-	if(nDat){
-		for(i=0; i<nLen; i++){
-			CheckSum += nDat[i];
-		}
-		writeSCS(nDat, nLen);
+	writeFrame();
+}
+
+//the whole frame is sent with a single write
+int SCS::writeFrame()
+{
+	int nLen = txFrame.end();
+	if(!nLen){
+		return 0;
 	}
-	writeSCS(~CheckSum);
+	return writeSCS(txFrame.data(), nLen);
 }
 
 //普通写指令
 //舵机ID，MemAddr内存表地址，写入数据，写入长度
 int SCS::genWrite(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen)
 {
+	int64_t Begin = profBegin();
 	rFlushSCS();
 	writeBuf(ID, MemAddr, nDat, nLen, INST_WRITE);
 	wFlushSCS();
-	return Ack(ID);
+	int Res = Ack(ID);
+	profEnd(SCS_PROF_WRITE, ID, Begin, Res);
+	return Res;
 }
 
 //异步写指令
 //舵机ID，MemAddr内存表地址，写入数据，写入长度
 int SCS::regWrite(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen)
 {
+	int64_t Begin = profBegin();
 	rFlushSCS();
 	writeBuf(ID, MemAddr, nDat, nLen, INST_REG_WRITE);
 	wFlushSCS();
-	return Ack(ID);
+	int Res = Ack(ID);
+	profEnd(SCS_PROF_WRITE, ID, Begin, Res);
+	return Res;
 }
 
 //异步写执行指令
 //舵机ID
 int SCS::RegWriteAction(u8 ID)
 {
+	int64_t Begin = profBegin();
 	rFlushSCS();
 	writeBuf(ID, 0, NULL, 0, INST_REG_ACTION);
 	wFlushSCS();
-	return Ack(ID);
+	int Res = Ack(ID);
+	profEnd(SCS_PROF_WRITE, ID, Begin, Res);
+	return Res;
 }
 
 //同步写指令
 //舵机ID[]数组，IDN数组长度，MemAddr内存表地址，写入数据，写入长度
-void SCS::syncWrite(u8 ID[], u8 IDN, u8 MemAddr, u8 *nDat, u8 nLen)
+int SCS::syncWrite(u8 ID[], u8 IDN, u8 MemAddr, u8 *nDat, u8 nLen)
 {
+	int64_t Begin = profBegin();
 	rFlushSCS();
-	u8 mesLen = ((nLen+1)*IDN+4);
-	u8 Sum = 0;
-	u8 bBuf[7];
-	bBuf[0] = 0xff;
-	bBuf[1] = 0xff;
-	bBuf[2] = 0xfe;
-	bBuf[3] = mesLen;
-	bBuf[4] = INST_SYNC_WRITE;
-	bBuf[5] = MemAddr;
-	bBuf[6] = nLen;
-	writeSCS(bBuf, 7);
-
-	Sum = 0xfe + mesLen + INST_SYNC_WRITE + MemAddr + nLen;
-	u8 i, j;
-	for(i=0; i<IDN; i++){
-		writeSCS(ID[i]);
-		writeSCS(nDat+i*nLen, nLen);
-		Sum += ID[i];
-		for(j=0; j<nLen; j++){
-			Sum += nDat[i*nLen+j];
-		}
+	txFrame.begin(0xfe, INST_SYNC_WRITE);
+	txFrame.add(MemAddr);
+	txFrame.add(nLen);
+	for(u8 i=0; i<IDN; i++){
+		txFrame.add(ID[i]);
+		txFrame.add(nDat+i*nLen, nLen);
 	}
-	writeSCS(~Sum);
+	int Res = writeFrame();
 	wFlushSCS();
+	profEnd(SCS_PROF_SYNC_WRITE, 0xfe, Begin, Res>0);
+	return Res;
 }
 
 int SCS::writeByte(u8 ID, u8 MemAddr, u8 bDat)
 {
+	int64_t Begin = profBegin();
 	rFlushSCS();
 	writeBuf(ID, MemAddr, &bDat, 1, INST_WRITE);
 	wFlushSCS();
-	return Ack(ID);
+	int Res = Ack(ID);
+	profEnd(SCS_PROF_WRITE, ID, Begin, Res);
+	return Res;
 }
 
 int SCS::writeWord(u8 ID, u8 MemAddr, u16 wDat)
 {
 	u8 bBuf[2];
 	Host2SCS(bBuf+0, bBuf+1, wDat);
+	int64_t Begin = profBegin();
 	rFlushSCS();
 	writeBuf(ID, MemAddr, bBuf, 2, INST_WRITE);
 	wFlushSCS();
-	return Ack(ID);
+	int Res = Ack(ID);
+	profEnd(SCS_PROF_WRITE, ID, Begin, Res);
+	return Res;
 }
 
 //读指令
 //舵机ID，MemAddr内存表地址，返回数据nData，数据长度nLen
 int SCS::Read(u8 ID, u8 MemAddr, u8 *nData, u8 nLen)
+{
+	int64_t Begin = profBegin();
+	int Size = readStatus(ID, MemAddr, nData, nLen);
+	profEnd(SCS_PROF_READ, ID, Begin, Size);
+	return Size;
+}
+
+int SCS::readStatus(u8 ID, u8 MemAddr, u8 *nData, u8 nLen)
 {
 	rFlushSCS();
 	writeBuf(ID, MemAddr, &nLen, 1, INST_READ);
@@ -179,15 +186,18 @@ int SCS::Read(u8 ID, u8 MemAddr, u8 *nData, u8 nLen)
 	}
 	u8 bBuf[4];
 	Error = 0;
+	RxStat = SCS_PROF_TIMEOUT;
 	if(readSCS(bBuf, 3)!=3){
 		return 0;
 	}
+	RxStat = SCS_PROF_CHKERR;
 	if(bBuf[0]!=ID && ID!=0xfe){
 		return 0;
 	}
 	if(bBuf[1]!=(nLen+2)){
 		return 0;
 	}
+	RxStat = SCS_PROF_TIMEOUT;
 	int Size = readSCS(nData, nLen);
 	if(Size!=nLen){
 		return 0;
@@ -195,6 +205,7 @@ int SCS::Read(u8 ID, u8 MemAddr, u8 *nData, u8 nLen)
 	if(readSCS(bBuf+3, 1)!=1){
 		return 0;
 	}
+	RxStat = SCS_PROF_CHKERR;
 	u8 calSum = bBuf[0]+bBuf[1]+bBuf[2];
 	u8 i;
 	for(i=0; i<Size; i++){
@@ -235,6 +246,14 @@ int SCS::readWord(u8 ID, u8 MemAddr)
 
 //Ping指令，返回舵机ID，超时返回-1
 int	SCS::Ping(u8 ID)
+{
+	int64_t Begin = profBegin();
+	int Res = pingStatus(ID);
+	profEnd(SCS_PROF_PING, ID, Begin, Res!=-1);
+	return Res;
+}
+
+int	SCS::pingStatus(u8 ID)
 {
 	rFlushSCS();
 	writeBuf(ID, 0, NULL, 0, INST_PING);
@@ -244,9 +263,11 @@ int	SCS::Ping(u8 ID)
 		return -1;
 	}
 	u8 bBuf[4];
+	RxStat = SCS_PROF_TIMEOUT;
 	if(readSCS(bBuf, 4)!=4){
 		return -1;
 	}
+	RxStat = SCS_PROF_CHKERR;
 	if(bBuf[0]!=ID && ID!=0xfe){
 		return -1;
 	}
@@ -268,6 +289,7 @@ int SCS::checkHead()
 	u8 Cnt = 0;
 	while(1){
 		if(!readSCS(&bDat, 1)){
+			RxStat = SCS_PROF_TIMEOUT;
 			return 0;
 		}
 		bBuf[1] = bBuf[0];
@@ -277,6 +299,7 @@ int SCS::checkHead()
 		}
 		Cnt++;
 		if(Cnt>10){
+			RxStat = SCS_PROF_CHKERR;
 			return 0;
 		}
 	}
@@ -291,9 +314,11 @@ int	SCS::Ack(u8 ID)
 			return 0;
 		}
 		u8 bBuf[4];
+		RxStat = SCS_PROF_TIMEOUT;
 		if(readSCS(bBuf, 4)!=4){
 			return 0;
 		}
+		RxStat = SCS_PROF_CHKERR;
 		if(bBuf[0]!=ID){
 			return 0;
 		}
@@ -311,26 +336,19 @@ int	SCS::Ack(u8 ID)
 
 int	SCS::syncReadPacketTx(u8 ID[], u8 IDN, u8 MemAddr, u8 nLen)
 {
+	int64_t Begin = profBegin();
 	rFlushSCS();
 	syncReadRxPacketLen = nLen;
-	u8 checkSum = (4+0xfe)+IDN+MemAddr+nLen+INST_SYNC_READ;
-	u8 i;
-	writeSCS(0xff);
-	writeSCS(0xff);
-	writeSCS(0xfe);
-	writeSCS(IDN+4);
-	writeSCS(INST_SYNC_READ);
-	writeSCS(MemAddr);
-	writeSCS(nLen);
-	for(i=0; i<IDN; i++){
-		writeSCS(ID[i]);
-		checkSum += ID[i];
-	}
-	checkSum = ~checkSum;
-	writeSCS(checkSum);
+	txFrame.begin(0xfe, INST_SYNC_READ);
+	txFrame.add(MemAddr);
+	txFrame.add(nLen);
+	txFrame.add(ID, IDN);
+	writeFrame();
 	wFlushSCS();
 	
 	syncReadRxBuffLen = readSCS(syncReadRxBuff, syncReadRxBuffMax, syncTimeOut);
+	RxStat = SCS_PROF_TIMEOUT;
+	profEnd(SCS_PROF_SYNC_READ, 0xfe, Begin, syncReadRxBuffLen);
 	return syncReadRxBuffLen;
 }
 
@@ -344,13 +362,23 @@ void SCS::syncReadBegin(u8 IDN, u8 rxLen, u32 TimeOut)
 void SCS::syncReadEnd()
 {
 	if(syncReadRxBuff){
-		delete syncReadRxBuff;
+		delete[] syncReadRxBuff;
 		syncReadRxBuff = NULL;
 	}
 }
 
 int SCS::syncReadPacketRx(u8 ID, u8 *nDat)
 {
+	int Size = syncReadPacketDecode(ID, nDat);
+	if(Profiler){
+		Profiler->response(ID, Size ? SCS_PROF_OK : RxStat);
+	}
+	return Size;
+}
+
+int SCS::syncReadPacketDecode(u8 ID, u8 *nDat)
+{
+	RxStat = SCS_PROF_TIMEOUT;
 	u16 syncReadRxBuffIndex = 0;
 	syncReadRxPacket = nDat;
 	syncReadRxPacketIndex = 0;
@@ -379,6 +407,7 @@ int SCS::syncReadPacketRx(u8 ID, u8 *nDat)
 		}
 		calSum = ~calSum;
 		if(calSum!=syncReadRxBuff[syncReadRxBuffIndex++]){
+			RxStat = SCS_PROF_CHKERR;
 			return 0;
 		}
 		return syncReadRxPacketLen;
@@ -411,8 +440,24 @@ int SCS::syncReadRxPacketToWrod(u8 negBit)
 
 int SCS::Recovery(u8 ID)
 {
+	int64_t Begin = profBegin();
 	rFlushSCS();
 	writeBuf(ID, 0, NULL, 0, INST_RECOVERY);
 	wFlushSCS();
-	return Ack(ID);
+	int Res = Ack(ID);
+	profEnd(SCS_PROF_WRITE, ID, Begin, Res);
+	return Res;
+}
+
+int64_t SCS::profBegin()
+{
+	return Profiler ? SCSProfiler::now() : 0;
+}
+
+//Ok为0时按RxStat记录超时或校验错误
+void SCS::profEnd(u8 Inst, u8 ID, int64_t Begin, int Ok)
+{
+	if(Profiler){
+		Profiler->record(Inst, ID, Begin, Ok ? SCS_PROF_OK : RxStat);
+	}
 }
\ No newline at end of file
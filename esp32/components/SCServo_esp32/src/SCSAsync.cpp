@@ -0,0 +1,335 @@
+/*
+ * SCSAsync.cpp
+ * Feetech serial servo asynchronous transaction engine
+ */
+
+#include "SCSAsync.h"
+#include "driver/uart.h"
+
+//engine events posted to the UART event queue next to the driver events
+#define SCS_ASYNC_EVENT_REQUEST ((uart_event_type_t)(UART_EVENT_MAX+1))
+#define SCS_ASYNC_EVENT_TIMEOUT ((uart_event_type_t)(UART_EVENT_MAX+2))
+
+SCSAsync::SCSAsync()
+{
+	Level = 1;
+	TimeOut = SCS_ASYNC_TIMEOUT_US;
+	uart_port_num = 0;
+	EventQueue = NULL;
+	RequestQueue = NULL;
+	BackgroundQueue = NULL;
+	Task = NULL;
+	Timer = NULL;
+	Active = 0;
+	Count = 0;
+	Deadline = 0;
+	Begin = 0;
+	Seen = 0;
+	Profiler = NULL;
+}
+
+//the engine becomes the only reader of the UART
+//uart_queue is the event queue given by uart_driver_install()
+int SCSAsync::begin(int uart_port_num, QueueHandle_t uart_queue, UBaseType_t Priority, BaseType_t Core)
+{
+	if(Task || !uart_queue){
+		return 0;
+	}
+	this->uart_port_num = uart_port_num;
+	EventQueue = uart_queue;
+	uint32_t Baud = 0;
+	if(uart_get_baudrate((uart_port_t)uart_port_num, &Baud)==ESP_OK && Baud){
+		Timing.setBaud(Baud);
+	}
+	//wake up on every received chunk instead of waiting for 120 bytes
+	uart_set_rx_full_threshold((uart_port_t)uart_port_num, 16);
+	uart_set_rx_timeout((uart_port_t)uart_port_num, 2);
+	xQueueReset(EventQueue);
+	uart_flush_input((uart_port_t)uart_port_num);
+	RequestQueue = xQueueCreate(SCS_ASYNC_QUEUE_LEN, sizeof(Request));
+	BackgroundQueue = xQueueCreate(SCS_ASYNC_BACKGROUND_LEN, sizeof(Request));
+	esp_timer_create_args_t const timer_args = {
+		.callback = &SCSAsync::timer,
+		.arg = this,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "scs_async_timer",
+		.skip_unhandled_events = true
+	};
+	if(!RequestQueue || !BackgroundQueue || esp_timer_create(&timer_args, &Timer)!=ESP_OK){
+		return 0;
+	}
+	return xTaskCreatePinnedToCore(task, "scs_async_task", SCS_ASYNC_TASK_STACK_SIZE, this, Priority, &Task, Core)==pdPASS;
+}
+
+int SCSAsync::genWrite(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen, SCSAsyncCallback Callback, void *Arg)
+{
+	Request Req;
+	Req.Frame.begin(ID, INST_WRITE);
+	Req.Frame.add(MemAddr);
+	Req.Frame.add(nDat, nLen);
+	return post(Req, (ID!=0xfe && Level) ? 1 : 0, 0, Callback, Arg);
+}
+
+int SCSAsync::writeByte(u8 ID, u8 MemAddr, u8 bDat, SCSAsyncCallback Callback, void *Arg)
+{
+	return genWrite(ID, MemAddr, &bDat, 1, Callback, Arg);
+}
+
+int SCSAsync::Read(u8 ID, u8 MemAddr, u8 nLen, SCSAsyncCallback Callback, void *Arg)
+{
+	Request Req;
+	Req.Frame.begin(ID, INST_READ);
+	Req.Frame.add(MemAddr);
+	Req.Frame.add(nLen);
+	return post(Req, 1, nLen, Callback, Arg);
+}
+
+int SCSAsync::Ping(u8 ID, SCSAsyncCallback Callback, void *Arg)
+{
+	Request Req;
+	Req.Frame.begin(ID, INST_PING);
+	return post(Req, 1, 0, Callback, Arg);
+}
+
+int SCSAsync::syncWrite(const u8 ID[], u8 IDN, u8 MemAddr, const u8 *nDat, u8 nLen, SCSAsyncCallback Callback, void *Arg)
+{
+	Request Req;
+	Req.Frame.begin(0xfe, INST_SYNC_WRITE);
+	Req.Frame.add(MemAddr);
+	Req.Frame.add(nLen);
+	for(u8 i=0; i<IDN; i++){
+		Req.Frame.add(ID[i]);
+		Req.Frame.add(nDat+i*nLen, nLen);
+	}
+	return post(Req, 0, 0, Callback, Arg);
+}
+
+int SCSAsync::syncRead(const u8 ID[], u8 IDN, u8 MemAddr, u8 nLen, SCSAsyncCallback Callback, void *Arg)
+{
+	Request Req;
+	Req.Frame.begin(0xfe, INST_SYNC_READ);
+	Req.Frame.add(MemAddr);
+	Req.Frame.add(nLen);
+	Req.Frame.add(ID, IDN);
+	return post(Req, IDN, nLen, Callback, Arg);
+}
+
+int SCSAsync::transfer(const u8 *Frame, int nLen, u8 Expect, u8 RspLen, SCSAsyncCallback Callback, void *Arg, u8 Prio)
+{
+	//0xFF 0xFF ID LEN INSTR PARAM... CHK, LEN and CHK are computed again
+	if(nLen<6 || Frame[0]!=0xff || Frame[1]!=0xff){
+		return 0;
+	}
+	Request Req;
+	Req.Frame.begin(Frame[2], Frame[4]);
+	Req.Frame.add(Frame+5, nLen-6);
+	return post(Req, Expect, RspLen, Callback, Arg, Prio);
+}
+
+int SCSAsync::setBaud(u32 Baud, SCSAsyncCallback Callback, void *Arg)
+{
+	if(!Task || !Baud){
+		return 0;
+	}
+	Request Req;
+	Req.nLen = 0;
+	Req.Expect = 0;
+	Req.RspLen = 0;
+	Req.Baud = Baud;
+	Req.Callback = Callback;
+	Req.Arg = Arg;
+	return enqueue(Req, SCS_ASYNC_BACKGROUND);
+}
+
+//queue a request and wake up the engine, never blocks
+int SCSAsync::post(Request &Req, u8 Expect, u8 RspLen, SCSAsyncCallback Callback, void *Arg, u8 Prio)
+{
+	if(!Task){
+		return 0;
+	}
+	Req.nLen = Req.Frame.end();
+	if(!Req.nLen){
+		return 0;
+	}
+	Req.Expect = Expect;
+	Req.RspLen = RspLen;
+	Req.Baud = 0;
+	Req.Callback = Callback;
+	Req.Arg = Arg;
+	return enqueue(Req, Prio);
+}
+
+int SCSAsync::enqueue(const Request &Req, u8 Prio)
+{
+	if(xQueueSend(Prio==SCS_ASYNC_REALTIME ? RequestQueue : BackgroundQueue, &Req, 0)!=pdTRUE){
+		return 0;
+	}
+	uart_event_t event = {};
+	event.type = SCS_ASYNC_EVENT_REQUEST;
+	xQueueSend(EventQueue, &event, 0);//event queue full : the task polls the request queues every tick
+	return 1;
+}
+
+void SCSAsync::timer(void *Arg)
+{
+	SCSAsync *self = static_cast<SCSAsync*>(Arg);
+	uart_event_t event = {};
+	event.type = SCS_ASYNC_EVENT_TIMEOUT;
+	xQueueSend(self->EventQueue, &event, 0);
+}
+
+void SCSAsync::task(void *Arg)
+{
+	SCSAsync *self = static_cast<SCSAsync*>(Arg);
+	for(;;){
+		uart_event_t event;
+		//while a response or a request is pending, wake up at least every tick in case an event was lost
+		bool Poll = self->Active || uxQueueMessagesWaiting(self->RequestQueue) || uxQueueMessagesWaiting(self->BackgroundQueue);
+		if(xQueueReceive(self->EventQueue, &event, Poll ? 1 : portMAX_DELAY)==pdTRUE){
+			switch(event.type){
+			case UART_DATA:
+				self->receive();
+				break;
+			case UART_FIFO_OVF:
+			case UART_BUFFER_FULL:
+				uart_flush_input((uart_port_t)self->uart_port_num);
+				xQueueReset(self->EventQueue);
+				self->Parser.reset();
+				break;
+			default:
+				break;
+			}
+		}
+		if(self->Active && esp_timer_get_time()>=self->Deadline){
+			self->finish(SCS_ASYNC_TIMEOUT);
+		}
+		if(!self->Active){
+			self->next();
+		}
+	}
+}
+
+//next request in Cur, real-time requests first
+int SCSAsync::pop()
+{
+	return xQueueReceive(RequestQueue, &Cur, 0)==pdTRUE || xQueueReceive(BackgroundQueue, &Cur, 0)==pdTRUE;
+}
+
+//send queued requests until one waits for status packets
+void SCSAsync::next()
+{
+	while(pop()){
+		if(!Cur.nLen){
+			//the bytes of the previous requests leave at the old rate
+			uart_wait_tx_done((uart_port_t)uart_port_num, portMAX_DELAY);
+			uart_set_baudrate((uart_port_t)uart_port_num, Cur.Baud);
+			Timing.setBaud(Cur.Baud);
+			Count = 0;
+			notify(SCS_ASYNC_DONE);
+			continue;
+		}
+		uart_flush_input((uart_port_t)uart_port_num);
+		Parser.reset();
+		Begin = esp_timer_get_time();
+		uart_write_bytes((uart_port_t)uart_port_num, (const char*)Cur.Frame.data(), Cur.nLen);
+		if(!Cur.Expect){
+			Count = 0;
+			if(Profiler){
+				Profiler->record(profInst(), Cur.Frame.data()[2], Begin, SCS_PROF_OK);
+			}
+			notify(SCS_ASYNC_DONE);
+			continue;
+		}
+		//the window opens once the request is on the wire
+		u32 Window = Timing.response(Cur.Expect*(Cur.RspLen+SCS_TIMING_MIN_PACKET_LEN), Cur.Expect);
+		if(Window>TimeOut){
+			Window = TimeOut;
+		}
+		Window += Timing.bytes(Cur.nLen);
+		Active = 1;
+		Count = 0;
+		Seen = 0;
+		Deadline = esp_timer_get_time()+Window;
+		esp_timer_stop(Timer);
+		esp_timer_start_once(Timer, Window);
+		return;
+	}
+}
+
+void SCSAsync::receive()
+{
+	u8 Buf[64];
+	int Size;
+	while((Size = uart_read_bytes((uart_port_t)uart_port_num, Buf, sizeof(Buf), 0))>0){
+		for(int i=0; i<Size; i++){
+			u32 ChkErr = Parser.ChkErr;
+			if(!Parser.parse(Buf[i]) || !Active){
+				if(Profiler && Active && Parser.ChkErr!=ChkErr){
+					Profiler->chkErr(profInst(), Parser.ID);
+				}
+				continue;
+			}
+			if(Parser.nLen!=Cur.RspLen){
+				continue;
+			}
+			Count++;
+			if(Parser.ID<32){
+				Seen |= 1UL<<Parser.ID;
+			}
+			if(Cur.Callback){
+				SCSAsyncResult Result = {SCS_ASYNC_PACKET, Parser.ID, Parser.Error, Parser.nLen, Parser.Dat, Count};
+				Cur.Callback(Cur.Arg, &Result);
+			}
+			if(Count==Cur.Expect){
+				finish(SCS_ASYNC_DONE);
+			}
+		}
+	}
+}
+
+void SCSAsync::finish(u8 Event)
+{
+	esp_timer_stop(Timer);
+	Active = 0;
+	if(Profiler){
+		const u8 *Frame = Cur.Frame.data();
+		u8 Inst = profInst();
+		if(Inst==SCS_PROF_SYNC_READ){
+			//0xFF 0xFF 0xFE LEN INSTR ADDR nLEN ID...
+			for(u8 i=0; i<Cur.Expect; i++){
+				u8 ID = Frame[7+i];
+				u8 Received = ID<32 ? (Seen>>ID)&1 : 0;
+				Profiler->response(ID, Received ? SCS_PROF_OK : SCS_PROF_TIMEOUT);
+			}
+			Profiler->record(Inst, 0xfe, Begin, Event==SCS_ASYNC_DONE ? SCS_PROF_OK : SCS_PROF_TIMEOUT);
+		}else{
+			Profiler->record(Inst, Frame[2], Begin, Event==SCS_ASYNC_DONE ? SCS_PROF_OK : SCS_PROF_TIMEOUT);
+		}
+	}
+	notify(Event);
+}
+
+//instruction class of the current request
+u8 SCSAsync::profInst() const
+{
+	switch(Cur.Frame.data()[4]){
+	case INST_READ:
+		return SCS_PROF_READ;
+	case INST_SYNC_WRITE:
+		return SCS_PROF_SYNC_WRITE;
+	case INST_SYNC_READ:
+		return SCS_PROF_SYNC_READ;
+	case INST_PING:
+		return SCS_PROF_PING;
+	default:
+		return SCS_PROF_WRITE;
+	}
+}
+
+void SCSAsync::notify(u8 Event)
+{
+	if(Cur.Callback){
+		SCSAsyncResult Result = {Event, 0, 0, 0, NULL, Count};
+		Cur.Callback(Cur.Arg, &Result);
+	}
+}
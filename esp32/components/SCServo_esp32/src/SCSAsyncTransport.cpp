@@ -0,0 +1,143 @@
+/*
+ * SCSAsyncTransport.cpp
+ * Feetech serial servo transport through the asynchronous engine
+ */
+
+#include <string.h>
+#include "SCSAsyncTransport.h"
+
+SCSAsyncTransport::SCSAsyncTransport(SCSAsync &Engine) : Engine(Engine)
+{
+	Done = xSemaphoreCreateBinary();
+	TxLen = 0;
+	RxLen = 0;
+	RxPos = 0;
+}
+
+SCSAsyncTransport::~SCSAsyncTransport()
+{
+	if(Done){
+		vSemaphoreDelete(Done);
+	}
+}
+
+int SCSAsyncTransport::write(const u8 *nDat, int nLen)
+{
+	if(TxLen+nLen>(int)sizeof(TxBuf)){
+		nLen = sizeof(TxBuf)-TxLen;
+	}
+	memcpy(TxBuf+TxLen, nDat, nLen);
+	TxLen += nLen;
+	return nLen;
+}
+
+int SCSAsyncTransport::read(u8 *nDat, int nLen, u32 TimeOut)
+{
+	//the response window was waited for by wFlush()
+	if(nLen>RxLen-RxPos){
+		nLen = RxLen-RxPos;
+	}
+	memcpy(nDat, RxBuf+RxPos, nLen);
+	RxPos += nLen;
+	return nLen;
+}
+
+void SCSAsyncTransport::rFlush()
+{
+	RxLen = 0;
+	RxPos = 0;
+}
+
+//status packets the servos answer the frame in TxBuf with
+void SCSAsyncTransport::expect(u8 &Expect, u8 &RspLen) const
+{
+	//0xFF 0xFF ID LEN INSTR PARAM... CHK
+	u8 ID = TxBuf[2];
+	Expect = 0;
+	RspLen = 0;
+	switch(TxBuf[4]){
+	case INST_PING:
+		Expect = ID!=0xfe;
+		break;
+	case INST_READ:
+		Expect = ID!=0xfe;
+		RspLen = TxBuf[6];
+		break;
+	case INST_SYNC_READ:
+		//LEN : INSTR ADDR nLEN ID... CHK
+		Expect = TxBuf[3]-4;
+		RspLen = TxBuf[6];
+		break;
+	case INST_SYNC_WRITE:
+		break;
+	default:
+		Expect = ID!=0xfe && Engine.Level;
+		break;
+	}
+}
+
+void SCSAsyncTransport::wFlush()
+{
+	if(TxLen<6 || !Done){
+		TxLen = 0;
+		return;
+	}
+	u8 Expect, RspLen;
+	expect(Expect, RspLen);
+	RxLen = 0;
+	RxPos = 0;
+	//the engine always reports DONE or TIMEOUT once the request is queued
+	//background queue full (other blocking callers) : try again next tick
+	while(!Engine.transfer(TxBuf, TxLen, Expect, RspLen, callback, this)){
+		if(!Engine.isStarted()){
+			TxLen = 0;
+			return;
+		}
+		vTaskDelay(1);
+	}
+	xSemaphoreTake(Done, portMAX_DELAY);
+	TxLen = 0;
+}
+
+void SCSAsyncTransport::setBaud(u32 Baud)
+{
+	if(!Done || !Baud){
+		return;
+	}
+	while(!Engine.setBaud(Baud, callback, this)){
+		if(!Engine.isStarted()){
+			return;
+		}
+		vTaskDelay(1);
+	}
+	xSemaphoreTake(Done, portMAX_DELAY);
+}
+
+//engine task : status packets back into wire format
+void SCSAsyncTransport::callback(void *Arg, const SCSAsyncResult *Result)
+{
+	SCSAsyncTransport *self = static_cast<SCSAsyncTransport*>(Arg);
+	if(Result->Event!=SCS_ASYNC_PACKET){
+		xSemaphoreGive(self->Done);
+		return;
+	}
+	int Size = Result->nLen+6;
+	if(self->RxLen+Size>(int)sizeof(self->RxBuf)){
+		return;
+	}
+	//0xFF 0xFF ID LEN ERR PARAM... CHK
+	u8 *Packet = self->RxBuf+self->RxLen;
+	u8 msgLen = Result->nLen+2;
+	u8 Sum = Result->ID+msgLen+Result->Error;
+	Packet[0] = 0xff;
+	Packet[1] = 0xff;
+	Packet[2] = Result->ID;
+	Packet[3] = msgLen;
+	Packet[4] = Result->Error;
+	for(u8 i=0; i<Result->nLen; i++){
+		Packet[5+i] = Result->nDat[i];
+		Sum += Result->nDat[i];
+	}
+	Packet[5+Result->nLen] = ~Sum;
+	self->RxLen += Size;
+}
@@ -0,0 +1,162 @@
+/*
+ * SCSBaud.cpp
+ * Feetech serial servo baud rate manager
+ */
+
+#include <stddef.h>
+#include "SCSBaud.h"
+#include "SCSProfiler.h"
+
+static const u32 BaudTable[SCS_BAUD_NUM] = {1000000, 500000, 250000, 128000, 115200, 76800, 57600, 38400, 19200, 14400, 9600, 4800};
+
+u32 SCSBaud::rate(u8 Index)
+{
+	return Index<SCS_BAUD_NUM ? BaudTable[Index] : 0;
+}
+
+u8 SCSBaud::index(u32 Baud)
+{
+	for(u8 i=0; i<SCS_BAUD_NUM; i++){
+		if(BaudTable[i]==Baud){
+			return i;
+		}
+	}
+	return SCS_BAUD_NONE;
+}
+
+static int ping(SCSCL &Bus, u8 ID)
+{
+	for(u8 i=0; i<SCS_BAUD_PING_RETRY; i++){
+		if(Bus.Ping(ID)==ID){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+u8 SCSBaud::discover(SCSCL &Bus, u8 ID, u8 First)
+{
+	if(First<SCS_BAUD_NUM){
+		Bus.setBaud(BaudTable[First]);
+		if(ping(Bus, ID)){
+			return First;
+		}
+	}
+	//fastest first : the lower rates take the longest to try
+	for(u8 i=0; i<SCS_BAUD_NUM; i++){
+		if(i==First){
+			continue;
+		}
+		Bus.setBaud(BaudTable[i]);
+		if(ping(Bus, ID)){
+			return i;
+		}
+	}
+	return SCS_BAUD_NONE;
+}
+
+int SCSBaud::scan(SCSCL &Bus, const u8 ID[], u8 IDN, u8 Index[])
+{
+	u8 Current = index(Bus.Timing.Baud);
+	int Found = 0;
+	for(u8 i=0; i<IDN; i++){
+		//servos usually share a rate : start from the last one found
+		Index[i] = discover(Bus, ID[i], Current);
+		if(Index[i]!=SCS_BAUD_NONE){
+			Current = Index[i];
+			Found++;
+		}
+	}
+	return Found;
+}
+
+int SCSBaud::migrate(SCSCL &Bus, const u8 ID[], u8 IDN, u8 Index)
+{
+	if(Index>=SCS_BAUD_NUM || IDN>SCS_BAUD_MAX_SERVO){
+		return -1;
+	}
+	u8 From[SCS_BAUD_MAX_SERVO];
+	scan(Bus, ID, IDN, From);
+	int Count = 0;
+	for(u8 i=0; i<IDN; i++){
+		if(From[i]==SCS_BAUD_NONE){
+			continue;
+		}
+		if(From[i]!=Index){
+			Bus.setBaud(BaudTable[From[i]]);
+			Bus.unLockEprom(ID[i]);
+			Bus.writeByte(ID[i], SCSCL_BAUD_RATE, Index);
+			//the servo may switch before or after its status packet : look for it, then lock the EEPROM at its rate
+			u8 Now = discover(Bus, ID[i], Index);
+			if(Now==SCS_BAUD_NONE){
+				continue;
+			}
+			Bus.LockEprom(ID[i]);
+			if(Now!=Index){
+				continue;
+			}
+		}
+		Count++;
+	}
+	Bus.setBaud(BaudTable[Index]);
+	return Count;
+}
+
+int SCSBaud::bench(SCSCL &Bus, const u8 ID[], u8 IDN, u16 Cycles, SCSBaudBench &Result)
+{
+	Result.Baud = Bus.Timing.Baud;
+	Result.Cycles = 0;
+	Result.Servos = 0;
+	Result.SyncWrite = 0;
+	Result.SyncRead = 0;
+	Result.Cycle = 0;
+	Result.Missed = 0;
+	if(IDN>SCS_BAUD_MAX_SERVO || !Cycles){
+		return 0;
+	}
+	//current goal positions, written back unchanged : the servos do not move
+	u8 IDs[SCS_BAUD_MAX_SERVO];
+	u8 Goal[2*SCS_BAUD_MAX_SERVO];
+	u8 n = 0;
+	for(u8 i=0; i<IDN; i++){
+		if(Bus.Read(ID[i], SCSCL_GOAL_POSITION_L, Goal+2*n, 2)==2){
+			IDs[n++] = ID[i];
+		}
+	}
+	Result.Servos = n;
+	if(!n){
+		return 0;
+	}
+	//the sync read buffer of the bus is put aside for the benchmark
+	u8 *RxBuff = Bus.syncReadRxBuff;
+	u16 RxBuffMax = Bus.syncReadRxBuffMax;
+	u32 RxTimeOut = Bus.syncTimeOut;
+	Bus.syncReadRxBuff = NULL;
+	Bus.syncReadBegin(n, SCS_BAUD_BENCH_LEN, SCS_BAUD_BENCH_TIMEOUT);
+	uint64_t WriteSum = 0;
+	uint64_t ReadSum = 0;
+	u8 Feedback[SCS_BAUD_BENCH_LEN];
+	for(u16 c=0; c<Cycles; c++){
+		int64_t Begin = SCSProfiler::now();
+		Bus.syncWrite(IDs, n, SCSCL_GOAL_POSITION_L, Goal, 2);
+		int64_t Written = SCSProfiler::now();
+		Bus.syncReadPacketTx(IDs, n, SCS_BAUD_BENCH_ADDR, SCS_BAUD_BENCH_LEN);
+		for(u8 i=0; i<n; i++){
+			if(Bus.syncReadPacketRx(IDs[i], Feedback)!=SCS_BAUD_BENCH_LEN){
+				Result.Missed++;
+			}
+		}
+		int64_t Read = SCSProfiler::now();
+		WriteSum += Written-Begin;
+		ReadSum += Read-Written;
+	}
+	Bus.syncReadEnd();
+	Bus.syncReadRxBuff = RxBuff;
+	Bus.syncReadRxBuffMax = RxBuffMax;
+	Bus.syncTimeOut = RxTimeOut;
+	Result.Cycles = Cycles;
+	Result.SyncWrite = (u32)(WriteSum/Cycles);
+	Result.SyncRead = (u32)(ReadSum/Cycles);
+	Result.Cycle = Result.SyncWrite+Result.SyncRead;
+	return n;
+}
@@ -7,17 +7,20 @@
 
 #include "SCSCL.h"
 
-SCSCL::SCSCL()
+SCSCL::SCSCL():Shadow(1)
 {
 	End = 1;
+	MemID = -1;
 }
 
-SCSCL::SCSCL(u8 End):SCSerial(End)
+SCSCL::SCSCL(u8 End):SCSerial(End), Shadow(End)
 {
+	MemID = -1;
 }
 
-SCSCL::SCSCL(u8 End, u8 Level):SCSerial(End, Level)
+SCSCL::SCSCL(u8 End, u8 Level):SCSerial(End, Level), Shadow(End)
 {
+	MemID = -1;
 }
 
 int SCSCL::WritePos(u8 ID, u16 Position, u16 Time, u16 Speed)
@@ -27,7 +30,11 @@ int SCSCL::WritePos(u8 ID, u16 Position, u16 Time, u16 Speed)
 	Host2SCS(bBuf+2, bBuf+3, Time);
 	Host2SCS(bBuf+4, bBuf+5, Speed);
 	
-	return genWrite(ID, SCSCL_GOAL_POSITION_L, bBuf, 6);
+	int Res = genWrite(ID, SCSCL_GOAL_POSITION_L, bBuf, 6);
+	if(Res){
+		Shadow.sent(ID, SCSCL_GOAL_POSITION_L, bBuf, 6);
+	}
+	return Res;
 }
 
 int SCSCL::RegWritePos(u8 ID, u16 Position, u16 Time, u16 Speed)
@@ -42,8 +49,11 @@ int SCSCL::RegWritePos(u8 ID, u16 Position, u16 Time, u16 Speed)
 
 void SCSCL::SyncWritePos(u8 ID[], u8 IDN, u16 Position[], u16 Time[], u16 Speed[])
 {
-    u8 offbuf[6*IDN];
-    for(u8 i = 0; i<IDN; i++){
+	rFlushSCS();
+	txFrame.begin(0xfe, INST_SYNC_WRITE);
+	txFrame.add(SCSCL_GOAL_POSITION_L);
+	txFrame.add(6);
+	for(u8 i = 0; i<IDN; i++){
 		u16 T, V;
 		if(Time){
 			T = Time[i];
@@ -55,11 +65,16 @@ void SCSCL::SyncWritePos(u8 ID[], u8 IDN, u16 Position[], u16 Time[], u16 Speed[
 		}else{
 			V = 0;
 		}
-        Host2SCS(offbuf+i*6+0, offbuf+i*6+1, Position[i]);
-        Host2SCS(offbuf+i*6+2, offbuf+i*6+3, T);
-        Host2SCS(offbuf+i*6+4, offbuf+i*6+5, V);
-    }
-    syncWrite(ID, IDN, SCSCL_GOAL_POSITION_L, offbuf, 6);
+		u8 bBuf[6];
+		Host2SCS(bBuf+0, bBuf+1, Position[i]);
+		Host2SCS(bBuf+2, bBuf+3, T);
+		Host2SCS(bBuf+4, bBuf+5, V);
+		txFrame.add(ID[i]);
+		txFrame.add(bBuf, 6);
+		Shadow.sent(ID[i], SCSCL_GOAL_POSITION_L, bBuf, 6);
+	}
+	writeFrame();
+	wFlushSCS();
 }
 
 int SCSCL::PWMMode(u8 ID)
@@ -86,7 +101,31 @@ int SCSCL::WritePWM(u8 ID, s16 pwmOut)
 
 int SCSCL::EnableTorque(u8 ID, u8 Enable)
 {
-	return writeByte(ID, SCSCL_TORQUE_ENABLE, Enable);
+	int Res = writeByte(ID, SCSCL_TORQUE_ENABLE, Enable);
+	if(Res){
+		Shadow.sent(ID, SCSCL_TORQUE_ENABLE, &Enable, 1);
+	}
+	return Res;
+}
+
+int SCSCL::SyncWriteDelta(u8 First, u8 Last)
+{
+	u8 IDs[SCS_SHADOW_MAX_ID];
+	u8 nDat[SCS_SHADOW_MAX_ID*SCS_SHADOW_LEN];
+	u8 MemAddr, nLen;
+	int Count = 0;
+	int IDN;
+	while((IDN = Shadow.delta(First, Last, IDs, nDat, MemAddr, nLen))>0){
+		if(syncWrite(IDs, IDN, MemAddr, nDat, nLen)<=0){
+			//not sent : dirty again, for the next call
+			for(int i=0; i<IDN; i++){
+				Shadow.touch(IDs[i], MemAddr, MemAddr+nLen-1);
+			}
+			break;
+		}
+		Count += IDN;
+	}
+	return Count;
 }
 
 int SCSCL::unLockEprom(u8 ID)
@@ -101,11 +140,14 @@ int SCSCL::LockEprom(u8 ID)
 
 int SCSCL::FeedBack(int ID)
 {
+	u8 Mem[SCSCL_PRESENT_CURRENT_H-SCSCL_PRESENT_POSITION_L+1];
 	int nLen = Read(ID, SCSCL_PRESENT_POSITION_L, Mem, sizeof(Mem));
 	if(nLen!=sizeof(Mem)){
 		Err = 1;
 		return -1;
 	}
+	Shadow.update(ID, SCSCL_PRESENT_POSITION_L, Mem, sizeof(Mem));
+	MemID = ID;
 	Err = 0;
 	return nLen;
 }
@@ -114,9 +156,11 @@ int SCSCL::ReadPos(int ID)
 {
 	int Pos = -1;
 	if(ID==-1){
-		Pos = Mem[SCSCL_PRESENT_POSITION_L-SCSCL_PRESENT_POSITION_L];
-		Pos <<= 8;
-		Pos |= Mem[SCSCL_PRESENT_POSITION_H-SCSCL_PRESENT_POSITION_L];
+		Pos = Shadow.readWord(MemID, SCSCL_PRESENT_POSITION_L);
+		if(Pos==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Pos = readWord(ID, SCSCL_PRESENT_POSITION_L);
@@ -131,9 +175,11 @@ int SCSCL::ReadSpeed(int ID)
 {
 	int Speed = -1;
 	if(ID==-1){
-		Speed = Mem[SCSCL_PRESENT_SPEED_L-SCSCL_PRESENT_POSITION_L];
-		Speed <<= 8;
-		Speed |= Mem[SCSCL_PRESENT_SPEED_H-SCSCL_PRESENT_POSITION_L];
+		Speed = Shadow.readWord(MemID, SCSCL_PRESENT_SPEED_L);
+		if(Speed==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Speed = readWord(ID, SCSCL_PRESENT_SPEED_L);
@@ -152,9 +198,11 @@ int SCSCL::ReadLoad(int ID)
 {
 	int Load = -1;
 	if(ID==-1){
-		Load = Mem[SCSCL_PRESENT_LOAD_L-SCSCL_PRESENT_POSITION_L];
-		Load <<= 8;
-		Load |= Mem[SCSCL_PRESENT_LOAD_H-SCSCL_PRESENT_POSITION_L];
+		Load = Shadow.readWord(MemID, SCSCL_PRESENT_LOAD_L);
+		if(Load==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Load = readWord(ID, SCSCL_PRESENT_LOAD_L);
@@ -172,7 +220,10 @@ int SCSCL::ReadVoltage(int ID)
 {
 	int Voltage = -1;
 	if(ID==-1){
-		Voltage = Mem[SCSCL_PRESENT_VOLTAGE-SCSCL_PRESENT_POSITION_L];	
+		Voltage = Shadow.readByte(MemID, SCSCL_PRESENT_VOLTAGE);
+		if(Voltage==-1){
+			Err = 1;
+		}
 	}else{
 		Err = 0;
 		Voltage = readByte(ID, SCSCL_PRESENT_VOLTAGE);
@@ -187,7 +238,10 @@ int SCSCL::ReadTemper(int ID)
 {
 	int Temper = -1;
 	if(ID==-1){
-		Temper = Mem[SCSCL_PRESENT_TEMPERATURE-SCSCL_PRESENT_POSITION_L];	
+		Temper = Shadow.readByte(MemID, SCSCL_PRESENT_TEMPERATURE);
+		if(Temper==-1){
+			Err = 1;
+		}
 	}else{
 		Err = 0;
 		Temper = readByte(ID, SCSCL_PRESENT_TEMPERATURE);
@@ -202,7 +256,10 @@ int SCSCL::ReadMove(int ID)
 {
 	int Move = -1;
 	if(ID==-1){
-		Move = Mem[SCSCL_MOVING-SCSCL_PRESENT_POSITION_L];	
+		Move = Shadow.readByte(MemID, SCSCL_MOVING);
+		if(Move==-1){
+			Err = 1;
+		}
 	}else{
 		Err = 0;
 		Move = readByte(ID, SCSCL_MOVING);
@@ -217,9 +274,11 @@ int SCSCL::ReadCurrent(int ID)
 {
 	int Current = -1;
 	if(ID==-1){
-		Current = Mem[SCSCL_PRESENT_CURRENT_L-SCSCL_PRESENT_POSITION_L];
-		Current <<= 8;
-		Current |= Mem[SCSCL_PRESENT_CURRENT_H-SCSCL_PRESENT_POSITION_L];
+		Current = Shadow.readWord(MemID, SCSCL_PRESENT_CURRENT_L);
+		if(Current==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Current = readWord(ID, SCSCL_PRESENT_CURRENT_L);
@@ -0,0 +1,86 @@
+/*
+ * SCSParser.cpp
+ * Feetech serial servo status packet parser
+ */
+
+#include "SCSParser.h"
+
+enum{
+	SCS_PARSER_HEAD1,
+	SCS_PARSER_HEAD2,
+	SCS_PARSER_ID,
+	SCS_PARSER_LEN,
+	SCS_PARSER_ERR,
+	SCS_PARSER_PARAM,
+	SCS_PARSER_CHK
+};
+
+SCSParser::SCSParser()
+{
+	ID = 0;
+	Error = 0;
+	nLen = 0;
+	ChkErr = 0;
+	reset();
+}
+
+void SCSParser::reset()
+{
+	State = SCS_PARSER_HEAD1;
+	Len = 0;
+	Index = 0;
+	Sum = 0;
+}
+
+int SCSParser::parse(u8 bDat)
+{
+	switch(State){
+	case SCS_PARSER_HEAD1:
+		if(bDat==0xff){
+			State = SCS_PARSER_HEAD2;
+		}
+		break;
+	case SCS_PARSER_HEAD2:
+		State = (bDat==0xff) ? SCS_PARSER_ID : SCS_PARSER_HEAD1;
+		break;
+	case SCS_PARSER_ID:
+		if(bDat==0xff){
+			break;//extra header byte
+		}
+		ID = bDat;
+		Sum = bDat;
+		State = SCS_PARSER_LEN;
+		break;
+	case SCS_PARSER_LEN:
+		if(bDat<2){
+			reset();
+			break;
+		}
+		Len = bDat-2;
+		Sum += bDat;
+		State = SCS_PARSER_ERR;
+		break;
+	case SCS_PARSER_ERR:
+		Error = bDat;
+		Sum += bDat;
+		Index = 0;
+		State = Len ? SCS_PARSER_PARAM : SCS_PARSER_CHK;
+		break;
+	case SCS_PARSER_PARAM:
+		Dat[Index++] = bDat;
+		Sum += bDat;
+		if(Index==Len){
+			State = SCS_PARSER_CHK;
+		}
+		break;
+	case SCS_PARSER_CHK:
+		State = SCS_PARSER_HEAD1;
+		if((u8)~Sum!=bDat){
+			ChkErr++;
+			return 0;
+		}
+		nLen = Len;
+		return 1;
+	}
+	return 0;
+}
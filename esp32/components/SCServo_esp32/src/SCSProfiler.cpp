@@ -0,0 +1,136 @@
+/*
+ * SCSProfiler.cpp
+ * Feetech serial servo bus timing statistics
+ */
+
+#include <string.h>
+#include "SCSProfiler.h"
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <chrono>
+#endif
+
+SCSProfiler::SCSProfiler()
+{
+	reset();
+}
+
+void SCSProfiler::reset()
+{
+	memset(Inst, 0, sizeof(Inst));
+	memset(Servo, 0, sizeof(Servo));
+	for(u8 i=0; i<SCS_PROF_INST_NUM; i++){
+		Inst[i].Min = 0xffffffff;
+	}
+}
+
+int64_t SCSProfiler::now()
+{
+#ifdef ESP_PLATFORM
+	return esp_timer_get_time();
+#else
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void SCSProfiler::record(u8 Inst, u8 ID, int64_t Begin, u8 Res)
+{
+	if(Inst>=SCS_PROF_INST_NUM){
+		return;
+	}
+	SCSProfInst &Stat = this->Inst[Inst];
+	if(ID<SCS_PROF_MAX_ID){
+		response(ID, Res);
+	}
+	if(Res==SCS_PROF_TIMEOUT){
+		Stat.Timeout++;
+		return;
+	}
+	if(Res==SCS_PROF_CHKERR){
+		Stat.ChkErr++;
+		return;
+	}
+	int64_t Elapsed = now()-Begin;
+	u32 Latency = Elapsed>0 ? (u32)Elapsed : 0;
+	Stat.Count++;
+	Stat.Sum += Latency;
+	if(Latency<Stat.Min){
+		Stat.Min = Latency;
+	}
+	if(Latency>Stat.Max){
+		Stat.Max = Latency;
+	}
+	u8 Bucket = 0;
+	u32 Scaled = Latency>>SCS_PROF_BUCKET_SHIFT;
+	while(Scaled && Bucket<SCS_PROF_BUCKETS-1){
+		Scaled >>= 1;
+		Bucket++;
+	}
+	Stat.Hist[Bucket]++;
+}
+
+void SCSProfiler::response(u8 ID, u8 Res)
+{
+	if(ID>=SCS_PROF_MAX_ID){
+		return;
+	}
+	if(Res==SCS_PROF_TIMEOUT){
+		Servo[ID].Timeout++;
+	}else if(Res==SCS_PROF_CHKERR){
+		Servo[ID].ChkErr++;
+	}else{
+		Servo[ID].Count++;
+	}
+}
+
+void SCSProfiler::chkErr(u8 Inst, u8 ID)
+{
+	if(Inst<SCS_PROF_INST_NUM){
+		this->Inst[Inst].ChkErr++;
+	}
+	if(ID<SCS_PROF_MAX_ID){
+		Servo[ID].ChkErr++;
+	}
+}
+
+void SCSProfiler::retry(u8 ID)
+{
+	if(ID<SCS_PROF_MAX_ID){
+		Servo[ID].Retry++;
+	}
+}
+
+u32 SCSProfiler::mean(u8 Inst) const
+{
+	if(Inst>=SCS_PROF_INST_NUM || !this->Inst[Inst].Count){
+		return 0;
+	}
+	return (u32)(this->Inst[Inst].Sum/this->Inst[Inst].Count);
+}
+
+u32 SCSProfiler::percentile(u8 Inst, u8 Pct) const
+{
+	if(Inst>=SCS_PROF_INST_NUM || !this->Inst[Inst].Count){
+		return 0;
+	}
+	const SCSProfInst &Stat = this->Inst[Inst];
+	uint64_t Rank = ((uint64_t)Stat.Count*Pct+99)/100;
+	uint64_t Sum = 0;
+	for(u8 i=0; i<SCS_PROF_BUCKETS; i++){
+		Sum += Stat.Hist[i];
+		if(Sum>=Rank){
+			u32 Limit = bucketLimit(i);
+			return (Limit && Limit<Stat.Max) ? Limit : Stat.Max;
+		}
+	}
+	return Stat.Max;
+}
+
+u32 SCSProfiler::bucketLimit(u8 Bucket)
+{
+	if(Bucket>=SCS_PROF_BUCKETS-1){
+		return 0;
+	}
+	return 1UL<<(Bucket+SCS_PROF_BUCKET_SHIFT);
+}
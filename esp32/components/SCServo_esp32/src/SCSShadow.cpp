@@ -0,0 +1,234 @@
+/*
+ * SCSShadow.cpp
+ * Feetech serial servo register shadow
+ */
+
+#include <string.h>
+#include "SCSShadow.h"
+
+SCSShadow::SCSShadow(u8 End)
+{
+	this->End = End;
+	clear();
+}
+
+void SCSShadow::clear()
+{
+	memset(Mem, 0, sizeof(Mem));
+	for(u8 i=0; i<SCS_SHADOW_MAX_ID; i++){
+		Known[i] = 0;
+		Dirty[i] = 0;
+	}
+}
+
+u32 SCSShadow::mask(u8 First, u8 Last)
+{
+	if(First<SCS_SHADOW_FIRST){
+		First = SCS_SHADOW_FIRST;
+	}
+	if(Last>SCS_SHADOW_LAST){
+		Last = SCS_SHADOW_LAST;
+	}
+	if(First>Last){
+		return 0;
+	}
+	u32 Bits = (1UL<<(Last-First+1))-1;
+	return Bits<<(First-SCS_SHADOW_FIRST);
+}
+
+u32 SCSShadow::run(u32 Bits)
+{
+	return Bits & ~(Bits+(Bits&(~Bits+1)));
+}
+
+void SCSShadow::write(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen)
+{
+	if(ID>=SCS_SHADOW_MAX_ID){
+		return;
+	}
+	for(u8 i=0; i<nLen; i++){
+		u8 Addr = MemAddr+i;
+		if(Addr<SCS_SHADOW_FIRST || Addr>SCS_SHADOW_LAST){
+			continue;
+		}
+		u8 Off = Addr-SCS_SHADOW_FIRST;
+		u32 Bit = 1UL<<Off;
+		if(!(Known[ID]&Bit) || Mem[ID][Off]!=nDat[i]){
+			Mem[ID][Off] = nDat[i];
+			Dirty[ID] |= Bit;
+		}
+		Known[ID] |= Bit;
+	}
+}
+
+void SCSShadow::writeByte(u8 ID, u8 MemAddr, u8 bDat)
+{
+	write(ID, MemAddr, &bDat, 1);
+}
+
+void SCSShadow::writeWord(u8 ID, u8 MemAddr, u16 wDat)
+{
+	u8 bBuf[2];
+	if(End){
+		bBuf[0] = (wDat>>8);
+		bBuf[1] = (wDat&0xff);
+	}else{
+		bBuf[1] = (wDat>>8);
+		bBuf[0] = (wDat&0xff);
+	}
+	write(ID, MemAddr, bBuf, 2);
+}
+
+void SCSShadow::sent(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen)
+{
+	if(ID==SCS_SHADOW_BROADCAST){
+		for(u8 i=0; i<SCS_SHADOW_MAX_ID; i++){
+			sent(i, MemAddr, nDat, nLen);
+		}
+		return;
+	}
+	if(ID>=SCS_SHADOW_MAX_ID){
+		return;
+	}
+	for(u8 i=0; i<nLen; i++){
+		u8 Addr = MemAddr+i;
+		if(Addr<SCS_SHADOW_FIRST || Addr>SCS_SHADOW_LAST){
+			continue;
+		}
+		u8 Off = Addr-SCS_SHADOW_FIRST;
+		Mem[ID][Off] = nDat[i];
+		Known[ID] |= 1UL<<Off;
+		Dirty[ID] &= ~(1UL<<Off);
+	}
+}
+
+void SCSShadow::update(u8 ID, u8 MemAddr, const u8 *nDat, u8 nLen)
+{
+	if(ID>=SCS_SHADOW_MAX_ID){
+		return;
+	}
+	for(u8 i=0; i<nLen; i++){
+		u8 Addr = MemAddr+i;
+		if(Addr<SCS_SHADOW_FIRST || Addr>SCS_SHADOW_LAST){
+			continue;
+		}
+		u8 Off = Addr-SCS_SHADOW_FIRST;
+		if(Dirty[ID]&(1UL<<Off)){
+			continue;
+		}
+		Mem[ID][Off] = nDat[i];
+		Known[ID] |= 1UL<<Off;
+	}
+}
+
+int SCSShadow::read(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen) const
+{
+	if(ID>=SCS_SHADOW_MAX_ID || !nLen || MemAddr+nLen-1>SCS_SHADOW_LAST){
+		return -1;
+	}
+	u32 Bits = mask(MemAddr, MemAddr+nLen-1);
+	if(!Bits || (Known[ID]&Bits)!=Bits){
+		return -1;
+	}
+	memcpy(nDat, Mem[ID]+(MemAddr-SCS_SHADOW_FIRST), nLen);
+	return nLen;
+}
+
+int SCSShadow::readByte(u8 ID, u8 MemAddr) const
+{
+	u8 bDat;
+	if(read(ID, MemAddr, &bDat, 1)!=1){
+		return -1;
+	}
+	return bDat;
+}
+
+int SCSShadow::readWord(u8 ID, u8 MemAddr) const
+{
+	u8 bBuf[2];
+	if(read(ID, MemAddr, bBuf, 2)!=2){
+		return -1;
+	}
+	if(End){
+		return (bBuf[0]<<8)|bBuf[1];
+	}
+	return (bBuf[1]<<8)|bBuf[0];
+}
+
+void SCSShadow::touch(u8 ID, u8 First, u8 Last)
+{
+	if(ID==SCS_SHADOW_BROADCAST){
+		for(u8 i=0; i<SCS_SHADOW_MAX_ID; i++){
+			touch(i, First, Last);
+		}
+		return;
+	}
+	if(ID<SCS_SHADOW_MAX_ID){
+		Dirty[ID] |= Known[ID]&mask(First, Last);
+	}
+}
+
+void SCSShadow::forget(u8 ID)
+{
+	if(ID<SCS_SHADOW_MAX_ID){
+		Known[ID] = 0;
+		Dirty[ID] = 0;
+	}
+}
+
+int SCSShadow::dirty(u8 First, u8 Last) const
+{
+	u32 Range = mask(First, Last);
+	int Count = 0;
+	for(u8 i=0; i<SCS_SHADOW_MAX_ID; i++){
+		if(Dirty[i]&Range){
+			Count++;
+		}
+	}
+	return Count;
+}
+
+int SCSShadow::delta(u8 First, u8 Last, u8 ID[], u8 *nDat, u8 &MemAddr, u8 &nLen)
+{
+	u32 Range = mask(First, Last);
+	u32 Union = 0;
+	for(u8 i=0; i<SCS_SHADOW_MAX_ID; i++){
+		Union |= Dirty[i]&Range;
+	}
+	if(!Union){
+		return 0;
+	}
+	//one sync write covers the lowest to the highest dirty byte of all servos,
+	//clean bytes in between are sent again from the shadow
+	u8 Lo = __builtin_ctz(Union);
+	u8 Hi = 31-__builtin_clz(Union);
+	u32 Span = ((1UL<<(Hi-Lo+1))-1)<<Lo;
+	bool Fit = false;
+	for(u8 i=0; i<SCS_SHADOW_MAX_ID && !Fit; i++){
+		Fit = (Dirty[i]&Span) && (Known[i]&Span)==Span;
+	}
+	if(!Fit){
+		//no servo has the whole span known : first dirty run of the first dirty servo, always known
+		for(u8 i=0; i<SCS_SHADOW_MAX_ID; i++){
+			if(Dirty[i]&Range){
+				Span = run(Dirty[i]&Range);
+				break;
+			}
+		}
+		Lo = __builtin_ctz(Span);
+		Hi = 31-__builtin_clz(Span);
+	}
+	MemAddr = SCS_SHADOW_FIRST+Lo;
+	nLen = Hi-Lo+1;
+	int IDN = 0;
+	for(u8 i=0; i<SCS_SHADOW_MAX_ID; i++){
+		if(!(Dirty[i]&Span) || (Known[i]&Span)!=Span){
+			continue;
+		}
+		ID[IDN] = i;
+		memcpy(nDat+IDN*nLen, Mem[i]+Lo, nLen);
+		Dirty[i] &= ~Span;
+		IDN++;
+	}
+	return IDN;
+}
@@ -5,38 +5,114 @@
  * 作者: 
  */
 
+#include <stddef.h>
 #include "SCSerial.h"
+#ifdef ESP_PLATFORM
 #include "driver/uart.h"
 #include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#endif
 
 SCSerial::SCSerial()
 {
 	IOTimeOut = 10;
 	uart_port_num = 0;
+	Transport = NULL;
+	TxEnd = 0;
+	RxFirst = 0;
 }
 
 SCSerial::SCSerial(u8 End):SCS(End)
 {
 	IOTimeOut = 10;
 	uart_port_num = 0;
+	Transport = NULL;
+	TxEnd = 0;
+	RxFirst = 0;
 }
 
 SCSerial::SCSerial(u8 End, u8 Level):SCS(End, Level)
 {
 	IOTimeOut = 10;
 	uart_port_num = 0;
+	Transport = NULL;
+	TxEnd = 0;
+	RxFirst = 0;
 }
 
-int SCSerial::readSCS(unsigned char *nDat, int nLen, unsigned long TimeOut)
+void SCSerial::setBaud(u32 Baud)
 {
+	Timing.setBaud(Baud);
+	if(Transport){
+		Transport->setBaud(Baud);
+		return;
+	}
+#ifdef ESP_PLATFORM
+	uart_wait_tx_done((uart_port_t)uart_port_num, pdMS_TO_TICKS(IOTimeOut));
+	uart_set_baudrate((uart_port_t)uart_port_num, Baud);
+	uart_flush_input((uart_port_t)uart_port_num);
+#endif
+}
 
-	return uart_read_bytes(uart_port_num, nDat, nLen, TimeOut / portTICK_RATE_MS);
+//TimeOut毫秒为上限，按最短状态包估计应答窗口(同步读)
+int SCSerial::readSCS(unsigned char *nDat, int nLen, unsigned long TimeOut)
+{
+	u32 Window = Timing.response(nLen, (nLen+SCS_TIMING_MIN_PACKET_LEN-1)/SCS_TIMING_MIN_PACKET_LEN);
+	if(Window>TimeOut*1000){
+		Window = TimeOut*1000;
+	}
+	RxFirst = 0;
+	return readWindow(nDat, nLen, Window);
 }
 
+//应答的第一个字节等待指令发送完毕及舵机返回延时，之后只等待字节传输时间
 int SCSerial::readSCS(unsigned char *nDat, int nLen)
 {
-	//uart_read_bytes(uart_port_num, nDat, nLen, IOTimeOut / portTICK_RATE_MS);
-	return uart_read_bytes(uart_port_num, nDat, nLen, IOTimeOut / portTICK_RATE_MS);
+	u32 Window;
+	if(RxFirst){
+		Window = Timing.response(nLen);
+	}else{
+		Window = Timing.Margin+Timing.bytes(nLen);
+	}
+	if(Window>IOTimeOut*1000){
+		Window = IOTimeOut*1000;
+	}
+	RxFirst = 0;
+	return readWindow(nDat, nLen, Window);
+}
+
+int SCSerial::readWindow(unsigned char *nDat, int nLen, u32 Window)
+{
+	if(Transport){
+		return Transport->read(nDat, nLen, Window);
+	}
+#ifdef ESP_PLATFORM
+	//the window opens once the instruction is on the wire
+	int64_t Now = esp_timer_get_time();
+	int64_t Deadline = (TxEnd>Now ? TxEnd : Now)+Window;
+	int64_t const Tick = portTICK_PERIOD_MS*1000;
+	int Size = 0;
+	while(Size<nLen){
+		int64_t Remain = Deadline-esp_timer_get_time();
+		//block on whole ticks, spin on the last one
+		TickType_t Ticks = Remain>=2*Tick ? (TickType_t)(Remain/Tick-1) : 0;
+		int Res = uart_read_bytes(uart_port_num, nDat+Size, nLen-Size, Ticks);
+		if(Res>0){
+			Size += Res;
+			continue;
+		}
+		if(Remain<=0){
+			break;
+		}
+		if(!Ticks){
+			esp_rom_delay_us(Timing.bytes(1));
+		}
+	}
+	return Size;
+#else
+	return 0;
+#endif
 }
 
 int SCSerial::writeSCS(unsigned char *nDat, int nLen)
@@ -44,21 +120,39 @@ int SCSerial::writeSCS(unsigned char *nDat, int nLen)
 	if(nDat==NULL){
 		return 0;
 	}
-	// uart_write_bytes(uart_port_num, nData, nlen);
+	RxFirst = 1;
+	if(Transport){
+		return Transport->write(nDat, nLen);
+	}
+#ifdef ESP_PLATFORM
+	//bytes are queued in the TX buffer, they leave one ByteTime after the other
+	int64_t Now = esp_timer_get_time();
+	TxEnd = (TxEnd>Now ? TxEnd : Now)+Timing.bytes(nLen);
 	return uart_write_bytes(uart_port_num, nDat, nLen);
+#else
+	return 0;
+#endif
 }
 
 int SCSerial::writeSCS(unsigned char bDat)
 {
-	// uart_write_bytes(uart_port_num, &bDat, 1);
-	return uart_write_bytes(uart_port_num, &bDat, 1);
+	return writeSCS(&bDat, 1);
 }
 
 void SCSerial::rFlushSCS()
 {
+	if(Transport){
+		Transport->rFlush();
+		return;
+	}
+#ifdef ESP_PLATFORM
 	uart_flush(uart_port_num);
+#endif
 }
 
 void SCSerial::wFlushSCS()
 {
+	if(Transport){
+		Transport->wFlush();
+	}
 }
\ No newline at end of file
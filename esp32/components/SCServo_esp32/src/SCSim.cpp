@@ -0,0 +1,353 @@
+/*
+ * SCSim.cpp
+ * Simulated Feetech bus of SCSCL servos, for host builds
+ */
+
+#include <string.h>
+#include "SCSim.h"
+#include "SCSCL.h"
+#include "SCSBaud.h"
+
+#define SCSIM_DEFAULT_SPEED 1500//steps/s when the goal speed is 0 (maximum speed)
+
+SCSim::SCSim(u32 Baud, u8 End)
+{
+	this->End = End;
+	ResponseDelay = 0;
+	DropRate = 0;
+	CorruptRate = 0;
+	Seed = 1;
+	Now = 0;
+	TxBytes = 0;
+	RxBytes = 0;
+	Instructions = 0;
+	StatusPackets = 0;
+	Count = 0;
+	TxLen = 0;
+	RxHead = 0;
+	RxTail = 0;
+	BusFree = 0;
+	memset(Servo, 0, sizeof(Servo));
+	setBaud(Baud);
+}
+
+void SCSim::setBaud(u32 Baud)
+{
+	this->Baud = Baud;
+	ByteTime = (10*1000000000ULL+Baud-1)/Baud;
+}
+
+SCSimServo *SCSim::addServo(u8 ID)
+{
+	if(Count>=SCSIM_MAX_SERVO){
+		return NULL;
+	}
+	SCSimServo *S = &Servo[Count++];
+	reset(S, ID);
+	return S;
+}
+
+//factory memory table, what RECOVERY restores
+void SCSim::reset(SCSimServo *S, u8 ID)
+{
+	memset(S, 0, sizeof(SCSimServo));
+	S->Mem[SCSCL_VERSION_L] = 3;
+	S->Mem[SCSCL_ID] = ID;
+	S->Mem[SCSCL_BAUD_RATE] = SCSBaud::index(Baud)!=SCS_BAUD_NONE ? SCSBaud::index(Baud) : _1M;
+	S->Mem[SCSCL_RETURN_LEVEL] = 1;
+	setWord(S, SCSCL_MAX_ANGLE_LIMIT_L, 1023);
+	S->Mem[SCSCL_LOCK] = 1;
+	S->Mem[SCSCL_PRESENT_VOLTAGE] = 74;
+	S->Mem[SCSCL_PRESENT_TEMPERATURE] = 30;
+	S->Position = 511;
+	setWord(S, SCSCL_GOAL_POSITION_L, 511);
+	S->Online = 1;
+	update(S);
+}
+
+SCSimServo *SCSim::servo(u8 ID)
+{
+	for(u8 i=0; i<Count; i++){
+		if(Servo[i].Online && Servo[i].Mem[SCSCL_ID]==ID){
+			return &Servo[i];
+		}
+	}
+	return NULL;
+}
+
+void SCSim::step(u32 Us)
+{
+	advance(Now+Us*1000ULL);
+}
+
+int SCSim::write(const u8 *nDat, int nLen)
+{
+	for(int i=0; i<nLen; i++){
+		advance(Now+ByteTime);
+		TxBytes++;
+		u8 bDat = nDat[i];
+		//0xFF 0xFF ID LEN INSTR PARAM... CHK
+		if(TxLen<2){
+			TxLen = (bDat==0xff) ? TxLen+1 : 0;
+			continue;
+		}
+		if(TxLen==2 && bDat==0xff){
+			continue;
+		}
+		TxPkt[TxLen++] = bDat;
+		if(TxLen<4 || TxLen<4+TxPkt[3]){
+			continue;
+		}
+		u8 Sum = 0;
+		for(int j=2; j<TxLen-1; j++){
+			Sum += TxPkt[j];
+		}
+		if((u8)~Sum==TxPkt[TxLen-1] && TxPkt[3]>=2){
+			instruction(TxPkt+2, TxLen-3);
+		}
+		TxLen = 0;
+	}
+	if(BusFree<Now){
+		BusFree = Now;
+	}
+	return nLen;
+}
+
+//blocks until nLen bytes arrived or TimeOut us elapsed
+int SCSim::read(u8 *nDat, int nLen, u32 TimeOut)
+{
+	uint64_t Deadline = Now+TimeOut*1000ULL;
+	int Size = 0;
+	while(Size<nLen && RxHead!=RxTail){
+		if(RxTime[RxHead]>Deadline){
+			break;
+		}
+		if(RxTime[RxHead]>Now){
+			advance(RxTime[RxHead]);
+		}
+		nDat[Size++] = RxBuf[RxHead];
+		RxHead = (RxHead+1)%SCSIM_RX_SIZE;
+		RxBytes++;
+	}
+	if(Size<nLen){
+		advance(Deadline);
+	}
+	return Size;
+}
+
+void SCSim::rFlush()
+{
+	while(RxHead!=RxTail && RxTime[RxHead]<=Now){
+		RxHead = (RxHead+1)%SCSIM_RX_SIZE;
+	}
+}
+
+void SCSim::wFlush()
+{
+}
+
+u16 SCSim::word(SCSimServo *S, u8 Addr)
+{
+	if(End){
+		return (S->Mem[Addr]<<8)|S->Mem[Addr+1];
+	}
+	return (S->Mem[Addr+1]<<8)|S->Mem[Addr];
+}
+
+void SCSim::setWord(SCSimServo *S, u8 Addr, u16 Data)
+{
+	if(End){
+		S->Mem[Addr] = Data>>8;
+		S->Mem[Addr+1] = Data&0xff;
+	}else{
+		S->Mem[Addr+1] = Data>>8;
+		S->Mem[Addr] = Data&0xff;
+	}
+}
+
+//xorshift32, deterministic for a given Seed
+u32 SCSim::rand()
+{
+	u32 x = Seed ? Seed : 1;
+	x ^= x<<13;
+	x ^= x>>17;
+	x ^= x<<5;
+	Seed = x;
+	return x;
+}
+
+void SCSim::advance(uint64_t To)
+{
+	if(To<=Now){
+		return;
+	}
+	double dt = (To-Now)*1e-9;
+	Now = To;
+	for(u8 i=0; i<Count; i++){
+		SCSimServo *S = &Servo[i];
+		if(!S->Mem[SCSCL_TORQUE_ENABLE]){
+			S->Mem[SCSCL_MOVING] = 0;
+			setWord(S, SCSCL_PRESENT_SPEED_L, 0);
+			continue;
+		}
+		double Goal = word(S, SCSCL_GOAL_POSITION_L);
+		u16 Speed = word(S, SCSCL_GOAL_SPEED_L);
+		double Step = (Speed ? Speed : SCSIM_DEFAULT_SPEED)*dt;
+		double Error = Goal-S->Position;
+		if(Error>Step){
+			S->Position += Step;
+		}else if(Error<-Step){
+			S->Position -= Step;
+		}else{
+			S->Position = Goal;
+		}
+		update(S);
+	}
+}
+
+//a servo set to another rate only sees garbage
+u8 SCSim::listening(SCSimServo *S)
+{
+	return SCSBaud::rate(S->Mem[SCSCL_BAUD_RATE])==Baud;
+}
+
+void SCSim::update(SCSimServo *S)
+{
+	u16 Position = (u16)(S->Position+0.5);
+	u16 Goal = word(S, SCSCL_GOAL_POSITION_L);
+	u16 Speed = word(S, SCSCL_GOAL_SPEED_L);
+	u8 Moving = (S->Mem[SCSCL_TORQUE_ENABLE] && Position!=Goal);
+	u16 V = Moving ? (Speed ? Speed : SCSIM_DEFAULT_SPEED) : 0;
+	setWord(S, SCSCL_PRESENT_POSITION_L, Position);
+	//sign and magnitude: bit 15 for speed and current, bit 10 for load
+	setWord(S, SCSCL_PRESENT_SPEED_L, (Goal<Position && Moving) ? (V|(1<<15)) : V);
+	setWord(S, SCSCL_PRESENT_LOAD_L, Moving ? ((Goal<Position) ? (100|(1<<10)) : 100) : 0);
+	setWord(S, SCSCL_PRESENT_CURRENT_L, Moving ? 20 : 0);
+	S->Mem[SCSCL_MOVING] = Moving;
+}
+
+void SCSim::memWrite(SCSimServo *S, u8 Addr, const u8 *nDat, u8 nLen)
+{
+	for(u8 i=0; i<nLen; i++){
+		int a = Addr+i;
+		if(a<SCSCL_ID || a>=SCSCL_PRESENT_POSITION_L){
+			continue;//read only
+		}
+		S->Mem[a] = nDat[i];//locked eprom : applied but not saved, power cycles are not simulated
+	}
+	update(S);
+}
+
+//queue a status packet after the return delay, once the bus is free
+void SCSim::reply(SCSimServo *S, u8 ID, const u8 *nDat, u8 nLen)
+{
+	SCSFrame Frame;
+	Frame.begin(ID, 0);//ERR byte sits where the instruction is
+	Frame.add(nDat, nLen);
+	int Size = Frame.end();
+	u8 *Pkt = Frame.data();
+	if(CorruptRate && rand()%CorruptRate==0){
+		Pkt[Size-1] ^= 0x5a;
+	}
+	uint64_t Start = Now+S->Mem[SCSCL_RETURN_DELAY_TIME]*2000ULL+ResponseDelay*1000ULL;
+	if(Start<BusFree){
+		Start = BusFree;
+	}
+	for(int i=0; i<Size; i++){
+		Start += ByteTime;
+		if(DropRate && rand()%DropRate==0){
+			continue;
+		}
+		int Next = (RxTail+1)%SCSIM_RX_SIZE;
+		if(Next==RxHead){
+			break;//host not reading, overflow
+		}
+		RxBuf[RxTail] = Pkt[i];
+		RxTime[RxTail] = Start;
+		RxTail = Next;
+	}
+	BusFree = Start;
+	StatusPackets++;
+}
+
+void SCSim::instruction(const u8 *Pkt, u8 nLen)
+{
+	u8 ID = Pkt[0];
+	u8 Fun = Pkt[2];
+	const u8 *Param = Pkt+3;
+	u8 nParam = nLen-3;
+	Instructions++;
+	if(Fun==INST_SYNC_WRITE || Fun==INST_SYNC_READ){
+		if(nParam<2){
+			return;
+		}
+		u8 Addr = Param[0];
+		u8 Len = Param[1];
+		u8 Stride = (Fun==INST_SYNC_WRITE) ? Len+1 : 1;
+		for(int i=2; i+Stride<=nParam; i+=Stride){
+			SCSimServo *S = servo(Param[i]);
+			if(!S || !listening(S)){
+				continue;
+			}
+			if(Fun==INST_SYNC_WRITE){
+				memWrite(S, Addr, Param+i+1, Len);
+			}else if(Addr+Len<=SCSIM_MEM_SIZE){
+				reply(S, Param[i], S->Mem+Addr, Len);
+			}
+		}
+		return;
+	}
+	for(u8 i=0; i<Count; i++){
+		SCSimServo *S = &Servo[i];
+		if(!S->Online || !listening(S) || (ID!=0xfe && S->Mem[SCSCL_ID]!=ID)){
+			continue;
+		}
+		u8 Answer = (ID!=0xfe);
+		switch(Fun){
+		case INST_PING:
+			break;
+		case INST_READ:
+			if(nParam<2 || Param[0]+Param[1]>SCSIM_MEM_SIZE){
+				Answer = 0;
+				break;
+			}
+			if(Answer){
+				reply(S, ID, S->Mem+Param[0], Param[1]);
+				Answer = 0;
+			}
+			break;
+		case INST_WRITE:
+			if(nParam>=1){
+				memWrite(S, Param[0], Param+1, nParam-1);
+			}
+			Answer = Answer && S->Mem[SCSCL_RETURN_LEVEL];
+			break;
+		case INST_REG_WRITE:
+			if(nParam>=1){
+				S->RegPending = 1;
+				S->RegAddr = Param[0];
+				S->RegLen = (nParam-1<SCSIM_MEM_SIZE) ? nParam-1 : SCSIM_MEM_SIZE;
+				memcpy(S->RegDat, Param+1, S->RegLen);
+			}
+			Answer = Answer && S->Mem[SCSCL_RETURN_LEVEL];
+			break;
+		case INST_REG_ACTION:
+			if(S->RegPending){
+				memWrite(S, S->RegAddr, S->RegDat, S->RegLen);
+				S->RegPending = 0;
+			}
+			Answer = Answer && S->Mem[SCSCL_RETURN_LEVEL];
+			break;
+		case INST_RECOVERY:
+			reset(S, S->Mem[SCSCL_ID]);
+			Answer = Answer && S->Mem[SCSCL_RETURN_LEVEL];
+			break;
+		default:
+			Answer = 0;
+			break;
+		}
+		if(Answer){
+			reply(S, ID, NULL, 0);
+		}
+	}
+}
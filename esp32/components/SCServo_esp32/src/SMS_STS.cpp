@@ -7,17 +7,20 @@
 
 #include "SMS_STS.h"
 
-SMS_STS::SMS_STS()
+SMS_STS::SMS_STS():Shadow(0)
 {
 	End = 0;
+	MemID = -1;
 }
 
-SMS_STS::SMS_STS(u8 End):SCSerial(End)
+SMS_STS::SMS_STS(u8 End):SCSerial(End), Shadow(End)
 {
+	MemID = -1;
 }
 
-SMS_STS::SMS_STS(u8 End, u8 Level):SCSerial(End, Level)
+SMS_STS::SMS_STS(u8 End, u8 Level):SCSerial(End, Level), Shadow(End)
 {
+	MemID = -1;
 }
 
 int SMS_STS::WritePosEx(u8 ID, s16 Position, u16 Speed, u8 ACC)
@@ -32,7 +35,11 @@ int SMS_STS::WritePosEx(u8 ID, s16 Position, u16 Speed, u8 ACC)
 	Host2SCS(bBuf+3, bBuf+4, 0);
 	Host2SCS(bBuf+5, bBuf+6, Speed);
 	
-	return genWrite(ID, SMS_STS_ACC, bBuf, 7);
+	int Res = genWrite(ID, SMS_STS_ACC, bBuf, 7);
+	if(Res){
+		Shadow.sent(ID, SMS_STS_ACC, bBuf, 7);
+	}
+	return Res;
 }
 
 int SMS_STS::RegWritePosEx(u8 ID, s16 Position, u16 Speed, u8 ACC)
@@ -52,8 +59,11 @@ int SMS_STS::RegWritePosEx(u8 ID, s16 Position, u16 Speed, u8 ACC)
 
 void SMS_STS::SyncWritePosEx(u8 ID[], u8 IDN, s16 Position[], u16 Speed[], u8 ACC[])
 {
-    u8 offbuf[7*IDN];
-    for(u8 i = 0; i<IDN; i++){
+	rFlushSCS();
+	txFrame.begin(0xfe, INST_SYNC_WRITE);
+	txFrame.add(SMS_STS_ACC);
+	txFrame.add(7);
+	for(u8 i = 0; i<IDN; i++){
 		if(Position[i]<0){
 			Position[i] = -Position[i];
 			Position[i] |= (1<<15);
@@ -64,16 +74,21 @@ void SMS_STS::SyncWritePosEx(u8 ID[], u8 IDN, s16 Position[], u16 Speed[], u8 AC
 		}else{
 			V = 0;
 		}
+		u8 bBuf[7];
 		if(ACC){
-			offbuf[i*7] = ACC[i];
+			bBuf[0] = ACC[i];
 		}else{
-			offbuf[i*7] = 0;
+			bBuf[0] = 0;
 		}
-        Host2SCS(offbuf+i*7+1, offbuf+i*7+2, Position[i]);
-        Host2SCS(offbuf+i*7+3, offbuf+i*7+4, 0);
-        Host2SCS(offbuf+i*7+5, offbuf+i*7+6, V);
-    }
-    syncWrite(ID, IDN, SMS_STS_ACC, offbuf, 7);
+		Host2SCS(bBuf+1, bBuf+2, Position[i]);
+		Host2SCS(bBuf+3, bBuf+4, 0);
+		Host2SCS(bBuf+5, bBuf+6, V);
+		txFrame.add(ID[i]);
+		txFrame.add(bBuf, 7);
+		Shadow.sent(ID[i], SMS_STS_ACC, bBuf, 7);
+	}
+	writeFrame();
+	wFlushSCS();
 }
 
 int SMS_STS::WheelMode(u8 ID)
@@ -97,7 +112,31 @@ int SMS_STS::WriteSpe(u8 ID, s16 Speed, u8 ACC)
 
 int SMS_STS::EnableTorque(u8 ID, u8 Enable)
 {
-	return writeByte(ID, SMS_STS_TORQUE_ENABLE, Enable);
+	int Res = writeByte(ID, SMS_STS_TORQUE_ENABLE, Enable);
+	if(Res){
+		Shadow.sent(ID, SMS_STS_TORQUE_ENABLE, &Enable, 1);
+	}
+	return Res;
+}
+
+int SMS_STS::SyncWriteDelta(u8 First, u8 Last)
+{
+	u8 IDs[SCS_SHADOW_MAX_ID];
+	u8 nDat[SCS_SHADOW_MAX_ID*SCS_SHADOW_LEN];
+	u8 MemAddr, nLen;
+	int Count = 0;
+	int IDN;
+	while((IDN = Shadow.delta(First, Last, IDs, nDat, MemAddr, nLen))>0){
+		if(syncWrite(IDs, IDN, MemAddr, nDat, nLen)<=0){
+			//not sent : dirty again, for the next call
+			for(int i=0; i<IDN; i++){
+				Shadow.touch(IDs[i], MemAddr, MemAddr+nLen-1);
+			}
+			break;
+		}
+		Count += IDN;
+	}
+	return Count;
 }
 
 int SMS_STS::unLockEprom(u8 ID)
@@ -117,11 +156,14 @@ int SMS_STS::CalibrationOfs(u8 ID)
 
 int SMS_STS::FeedBack(int ID)
 {
+	u8 Mem[SMS_STS_PRESENT_CURRENT_H-SMS_STS_PRESENT_POSITION_L+1];
 	int nLen = Read(ID, SMS_STS_PRESENT_POSITION_L, Mem, sizeof(Mem));
 	if(nLen!=sizeof(Mem)){
 		Err = 1;
 		return -1;
 	}
+	Shadow.update(ID, SMS_STS_PRESENT_POSITION_L, Mem, sizeof(Mem));
+	MemID = ID;
 	Err = 0;
 	return nLen;
 }
@@ -130,9 +172,11 @@ int SMS_STS::ReadPos(int ID)
 {
 	int Pos = -1;
 	if(ID==-1){
-		Pos = Mem[SMS_STS_PRESENT_POSITION_H-SMS_STS_PRESENT_POSITION_L];
-		Pos <<= 8;
-		Pos |= Mem[SMS_STS_PRESENT_POSITION_L-SMS_STS_PRESENT_POSITION_L];
+		Pos = Shadow.readWord(MemID, SMS_STS_PRESENT_POSITION_L);
+		if(Pos==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Pos = readWord(ID, SMS_STS_PRESENT_POSITION_L);
@@ -151,9 +195,11 @@ int SMS_STS::ReadSpeed(int ID)
 {
 	int Speed = -1;
 	if(ID==-1){
-		Speed = Mem[SMS_STS_PRESENT_SPEED_H-SMS_STS_PRESENT_POSITION_L];
-		Speed <<= 8;
-		Speed |= Mem[SMS_STS_PRESENT_SPEED_L-SMS_STS_PRESENT_POSITION_L];
+		Speed = Shadow.readWord(MemID, SMS_STS_PRESENT_SPEED_L);
+		if(Speed==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Speed = readWord(ID, SMS_STS_PRESENT_SPEED_L);
@@ -172,9 +218,11 @@ int SMS_STS::ReadLoad(int ID)
 {
 	int Load = -1;
 	if(ID==-1){
-		Load = Mem[SMS_STS_PRESENT_LOAD_H-SMS_STS_PRESENT_POSITION_L];
-		Load <<= 8;
-		Load |= Mem[SMS_STS_PRESENT_LOAD_L-SMS_STS_PRESENT_POSITION_L];
+		Load = Shadow.readWord(MemID, SMS_STS_PRESENT_LOAD_L);
+		if(Load==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Load = readWord(ID, SMS_STS_PRESENT_LOAD_L);
@@ -192,7 +240,10 @@ int SMS_STS::ReadVoltage(int ID)
 {	
 	int Voltage = -1;
 	if(ID==-1){
-		Voltage = Mem[SMS_STS_PRESENT_VOLTAGE-SMS_STS_PRESENT_POSITION_L];	
+		Voltage = Shadow.readByte(MemID, SMS_STS_PRESENT_VOLTAGE);
+		if(Voltage==-1){
+			Err = 1;
+		}
 	}else{
 		Err = 0;
 		Voltage = readByte(ID, SMS_STS_PRESENT_VOLTAGE);
@@ -207,7 +258,10 @@ int SMS_STS::ReadTemper(int ID)
 {	
 	int Temper = -1;
 	if(ID==-1){
-		Temper = Mem[SMS_STS_PRESENT_TEMPERATURE-SMS_STS_PRESENT_POSITION_L];	
+		Temper = Shadow.readByte(MemID, SMS_STS_PRESENT_TEMPERATURE);
+		if(Temper==-1){
+			Err = 1;
+		}
 	}else{
 		Err = 0;
 		Temper = readByte(ID, SMS_STS_PRESENT_TEMPERATURE);
@@ -222,7 +276,10 @@ int SMS_STS::ReadMove(int ID)
 {
 	int Move = -1;
 	if(ID==-1){
-		Move = Mem[SMS_STS_MOVING-SMS_STS_PRESENT_POSITION_L];	
+		Move = Shadow.readByte(MemID, SMS_STS_MOVING);
+		if(Move==-1){
+			Err = 1;
+		}
 	}else{
 		Err = 0;
 		Move = readByte(ID, SMS_STS_MOVING);
@@ -237,9 +294,11 @@ int SMS_STS::ReadCurrent(int ID)
 {
 	int Current = -1;
 	if(ID==-1){
-		Current = Mem[SMS_STS_PRESENT_CURRENT_H-SMS_STS_PRESENT_POSITION_L];
-		Current <<= 8;
-		Current |= Mem[SMS_STS_PRESENT_CURRENT_L-SMS_STS_PRESENT_POSITION_L];
+		Current = Shadow.readWord(MemID, SMS_STS_PRESENT_CURRENT_L);
+		if(Current==-1){
+			Err = 1;
+			return -1;
+		}
 	}else{
 		Err = 0;
 		Current = readWord(ID, SMS_STS_PRESENT_CURRENT_L);
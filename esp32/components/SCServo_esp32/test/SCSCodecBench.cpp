@@ -0,0 +1,164 @@
+/*
+ * SCSCodecBench.cpp
+ * Feetech serial servo per-frame CPU cost, host benchmark
+ * The virtual drivers (SCSCL, SMS_STS) and the compile-time family drivers
+ * (SCSFamily.h) build the same frames and decode the same status packets;
+ * the frames are checked to be identical, then the time spent per frame is
+ * measured on a transport that costs nothing (configure the host build with
+ * -DCMAKE_BUILD_TYPE=Release for meaningful numbers).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "SCServo.h"
+#include "SCSFamily.h"
+
+#define BENCH_SERVOS 12
+#define BENCH_ITERATIONS 200000
+
+//keeps the compiler from seeing through the pointer : calls stay virtual
+template<class T> static T *opaque(T *Ptr)
+{
+	asm volatile("" : "+r"(Ptr));
+	return Ptr;
+}
+
+//frames are dropped, read instructions are answered with a canned status packet
+class SCSNullBus : public SCSTransport{
+public:
+	SCSNullBus():TxLen(0), RxLen(0), RxPos(0){}
+	int write(const u8 *nDat, int nLen){
+		if(TxLen+nLen<=(int)sizeof(TxBuf)){
+			memcpy(TxBuf+TxLen, nDat, nLen);
+			TxLen += nLen;
+		}
+		RxPos = 0;
+		return nLen;
+	}
+	int read(u8 *nDat, int nLen, u32){
+		int Size = RxLen-RxPos<nLen ? RxLen-RxPos : nLen;
+		memcpy(nDat, RxBuf+RxPos, Size);
+		RxPos += Size;
+		return Size;
+	}
+	void rFlush(){}
+	void wFlush(){}
+	void reply(u8 ID, const u8 *nDat, u8 nLen){
+		u8 Sum = ID+nLen+2;
+		RxLen = 0;
+		RxBuf[RxLen++] = 0xff;
+		RxBuf[RxLen++] = 0xff;
+		RxBuf[RxLen++] = ID;
+		RxBuf[RxLen++] = nLen+2;
+		RxBuf[RxLen++] = 0;
+		for(u8 i=0; i<nLen; i++){
+			RxBuf[RxLen++] = nDat[i];
+			Sum += nDat[i];
+		}
+		RxBuf[RxLen++] = ~Sum;
+	}
+public:
+	u8 TxBuf[256];
+	int TxLen;
+private:
+	u8 RxBuf[64];
+	int RxLen;
+	int RxPos;
+};
+
+static int Failed;
+
+template<class Call> static double measure(SCSNullBus &Bus, Call Frame)
+{
+	auto Begin = std::chrono::steady_clock::now();
+	for(int i=0; i<BENCH_ITERATIONS; i++){
+		Bus.TxLen = 0;
+		Frame(i);
+	}
+	auto End = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(End-Begin).count()/BENCH_ITERATIONS;
+}
+
+template<class Virtual, class Family> static void same(const char *Name, SCSNullBus &Bus, Virtual V, Family F)
+{
+	u8 Frame[sizeof(Bus.TxBuf)];
+	Bus.TxLen = 0;
+	V(1);
+	int Len = Bus.TxLen;
+	memcpy(Frame, Bus.TxBuf, Len);
+	Bus.TxLen = 0;
+	F(1);
+	if(Len!=Bus.TxLen || memcmp(Frame, Bus.TxBuf, Len)){
+		printf("FAIL %s : frames differ\n", Name);
+		Failed++;
+	}
+}
+
+template<class Virtual, class Family> static void compare(const char *Name, SCSNullBus &Bus, Virtual V, Family F)
+{
+	same(Name, Bus, V, F);
+	double VirtualNs = measure(Bus, V);
+	double FamilyNs = measure(Bus, F);
+	printf("  %-26s %8.1f ns %8.1f ns %6.2fx\n", Name, VirtualNs, FamilyNs, VirtualNs/FamilyNs);
+}
+
+int main()
+{
+	SCSNullBus Bus;
+	SCSCL sclObj;
+	SMS_STS stsObj;
+	SCSCL *scl = opaque(&sclObj);
+	SMS_STS *sts = opaque(&stsObj);
+	SCSCLDriver sclDrv;
+	SMSSTSDriver stsDrv;
+	scl->Transport = sts->Transport = sclDrv.Transport = stsDrv.Transport = &Bus;
+
+	u8 IDs[BENCH_SERVOS];
+	u16 Pos[BENCH_SERVOS], Time[BENCH_SERVOS], Speed[BENCH_SERVOS];
+	s16 PosS[BENCH_SERVOS], PosEx[BENCH_SERVOS];
+	u8 ACC[BENCH_SERVOS];
+	for(int i=0; i<BENCH_SERVOS; i++){
+		IDs[i] = i+1;
+		Pos[i] = 100+i*50;
+		PosS[i] = Pos[i];
+		PosEx[i] = 100*i;//SyncWritePosEx turns negative positions into sign and magnitude in place
+		Time[i] = 0;
+		Speed[i] = 500+i;
+		ACC[i] = i;
+	}
+
+	printf("%-28s %11s %11s %7s\n", "frame", "virtual", "family", "ratio");
+	compare("SCSCL WritePos", Bus,
+		[&](int i){ scl->WritePos(1, i&1023, 0, 500); },
+		[&](int i){ sclDrv.WritePos(1, i&1023, 0, 500); });
+	compare("SCSCL SyncWritePos x12", Bus,
+		[&](int i){ Pos[0] = i&1023; scl->SyncWritePos(IDs, BENCH_SERVOS, Pos, Time, Speed); },
+		[&](int i){ PosS[0] = i&1023; sclDrv.SyncWritePos(IDs, BENCH_SERVOS, PosS, Time, Speed); });
+	compare("SMS_STS WritePosEx", Bus,
+		[&](int i){ sts->WritePosEx(1, (i&4095)-2048, 1000, 50); },
+		[&](int i){ stsDrv.WritePos(1, (i&4095)-2048, 0, 1000, 50); });
+	compare("SMS_STS SyncWritePosEx x12", Bus,
+		[&](int i){ PosEx[0] = (i&4095)-2048; sts->SyncWritePosEx(IDs, BENCH_SERVOS, PosEx, Speed, ACC); },
+		[&](int i){ PosEx[0] = (i&4095)-2048; stsDrv.SyncWritePos(IDs, BENCH_SERVOS, PosEx, NULL, Speed, ACC); });
+
+	//one read of the present block, then every field decoded
+	static const u8 Block[] = {0x02, 0x58, 0x81, 0xf4, 0x04, 0x64, 0x78, 0x28, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x32};
+	Bus.reply(1, Block, sizeof(Block));
+	volatile int Sink;
+	compare("SCSCL FeedBack + fields", Bus,
+		[&](int){
+			scl->FeedBack(1);
+			Sink = scl->ReadPos(-1)+scl->ReadSpeed(-1)+scl->ReadLoad(-1)+scl->ReadVoltage(-1)
+				+scl->ReadTemper(-1)+scl->ReadMove(-1)+scl->ReadCurrent(-1);
+		},
+		[&](int){
+			SCSFeedback Out;
+			sclDrv.FeedBack(1, Out);
+			Sink = Out.Position+Out.Speed+Out.Load+Out.Voltage+Out.Temperature+Out.Move+Out.Current;
+		});
+	(void)Sink;
+
+	printf("%s\n", Failed ? "FAILED" : "virtual and family drivers send the same frames");
+	return Failed ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * SCSFrameTest.cpp
+ * Feetech serial servo instruction frames, host test
+ * Every instruction of the drivers is sent to a recording transport and
+ * compared byte for byte with the frame the original Feetech writers sent
+ * (status packets never come back, reads fail after their request).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <initializer_list>
+#include "SCServo.h"
+
+class SCSRecorder : public SCSTransport{
+public:
+	SCSRecorder():Len(0){}
+	int write(const u8 *nDat, int nLen){
+		if(Len+nLen>(int)sizeof(Buf)){
+			nLen = sizeof(Buf)-Len;
+		}
+		memcpy(Buf+Len, nDat, nLen);
+		Len += nLen;
+		return nLen;
+	}
+	int read(u8 *, int, u32){ return 0; }
+	void rFlush(){}
+	void wFlush(){}
+public:
+	u8 Buf[1024];
+	int Len;
+};
+
+static SCSRecorder Bus;
+static int Checked;
+static int Failed;
+
+static void dump(const char *Label, const u8 *nDat, int nLen)
+{
+	printf("  %-6s", Label);
+	for(int i=0; i<nLen; i++){
+		printf(" %02x", nDat[i]);
+	}
+	printf("\n");
+}
+
+//golden frames recorded from the baseline SCS/SCSCL/SMS_STS writers
+template<class Call> static void check(const char *Name, std::initializer_list<u8> Golden, Call Instruction)
+{
+	Bus.Len = 0;
+	Instruction();
+	Checked++;
+	if(Bus.Len==(int)Golden.size() && !memcmp(Bus.Buf, Golden.begin(), Bus.Len)){
+		return;
+	}
+	Failed++;
+	printf("FAIL %s\n", Name);
+	dump("golden", Golden.begin(), Golden.size());
+	dump("sent", Bus.Buf, Bus.Len);
+}
+
+int main()
+{
+	SCSCL scl;
+	SMS_STS sts;
+	scl.Transport = &Bus;
+	sts.Transport = &Bus;
+	u8 IDs[] = {1, 2, 3, 4};
+	u8 Dat[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+	u8 Rx[8];
+	u16 Pos[] = {100, 512, 1000};
+	s16 PosEx[] = {-100, 2048, 4000};
+	u16 Time[] = {0, 50, 100};
+	u16 Speed[] = {0, 500, 1500};
+	u8 ACC[] = {0, 10, 254};
+
+	check("SCSCL::genWrite(1, SCSCL_GOAL_POSITION_L, Dat, 3)", {0xff, 0xff, 0x01, 0x06, 0x03, 0x2a, 0x01, 0x02, 0x03, 0xc5}, [&]{ scl.genWrite(1, SCSCL_GOAL_POSITION_L, Dat, 3); });
+	check("SCSCL::regWrite(2, SCSCL_GOAL_POSITION_L, Dat, 2)", {0xff, 0xff, 0x02, 0x05, 0x04, 0x2a, 0x01, 0x02, 0xc7}, [&]{ scl.regWrite(2, SCSCL_GOAL_POSITION_L, Dat, 2); });
+	check("SCSCL::RegWriteAction()", {0xff, 0xff, 0xfe, 0x02, 0x05, 0xfa}, [&]{ scl.RegWriteAction(); });
+	check("SCSCL::RegWriteAction(3)", {0xff, 0xff, 0x03, 0x02, 0x05, 0xf5}, [&]{ scl.RegWriteAction(3); });
+	check("SCSCL::syncWrite(IDs, 3, SCSCL_GOAL_POSITION_L, Dat, 2)", {0xff, 0xff, 0xfe, 0x0d, 0x83, 0x2a, 0x02, 0x01, 0x01, 0x02, 0x02, 0x03, 0x04, 0x03, 0x05, 0x06, 0x2a}, [&]{ scl.syncWrite(IDs, 3, SCSCL_GOAL_POSITION_L, Dat, 2); });
+	check("SCSCL::writeByte(4, SCSCL_TORQUE_ENABLE, 1)", {0xff, 0xff, 0x04, 0x04, 0x03, 0x28, 0x01, 0xcb}, [&]{ scl.writeByte(4, SCSCL_TORQUE_ENABLE, 1); });
+	check("SCSCL::writeWord(5, SCSCL_GOAL_POSITION_L, 0x1234)", {0xff, 0xff, 0x05, 0x05, 0x03, 0x2a, 0x12, 0x34, 0x82}, [&]{ scl.writeWord(5, SCSCL_GOAL_POSITION_L, 0x1234); });
+	check("SCSCL::Read(6, SCSCL_PRESENT_POSITION_L, Rx, 8)", {0xff, 0xff, 0x06, 0x04, 0x02, 0x38, 0x08, 0xb3}, [&]{ scl.Read(6, SCSCL_PRESENT_POSITION_L, Rx, 8); });
+	check("SCSCL::readByte(7, SCSCL_PRESENT_VOLTAGE)", {0xff, 0xff, 0x07, 0x04, 0x02, 0x3e, 0x01, 0xb3}, [&]{ scl.readByte(7, SCSCL_PRESENT_VOLTAGE); });
+	check("SCSCL::readWord(8, SCSCL_PRESENT_POSITION_L)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x38, 0x02, 0xb7}, [&]{ scl.readWord(8, SCSCL_PRESENT_POSITION_L); });
+	check("SCSCL::Ping(9)", {0xff, 0xff, 0x09, 0x02, 0x01, 0xf3}, [&]{ scl.Ping(9); });
+	check("SCSCL::syncReadPacketTx(IDs, 4, SCSCL_PRESENT_POSITION_L, 8)", {0xff, 0xff, 0xfe, 0x08, 0x82, 0x38, 0x08, 0x01, 0x02, 0x03, 0x04, 0x2d}, [&]{ scl.syncReadPacketTx(IDs, 4, SCSCL_PRESENT_POSITION_L, 8); });
+	check("SCSCL::Recovery(10)", {0xff, 0xff, 0x0a, 0x02, 0x06, 0xed}, [&]{ scl.Recovery(10); });
+	check("SCSCL::WritePos(1, 600, 100, 200)", {0xff, 0xff, 0x01, 0x09, 0x03, 0x2a, 0x02, 0x58, 0x00, 0x64, 0x00, 0xc8, 0x42}, [&]{ scl.WritePos(1, 600, 100, 200); });
+	check("SCSCL::RegWritePos(2, 700, 0)", {0xff, 0xff, 0x02, 0x09, 0x04, 0x2a, 0x02, 0xbc, 0x00, 0x00, 0x00, 0x00, 0x08}, [&]{ scl.RegWritePos(2, 700, 0); });
+	check("SCSCL::SyncWritePos(IDs, 3, Pos, Time, Speed)", {0xff, 0xff, 0xfe, 0x19, 0x83, 0x2a, 0x06, 0x01, 0x00, 0x64, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x32, 0x01, 0xf4, 0x03, 0x03, 0xe8, 0x00, 0x64, 0x05, 0xdc, 0x72}, [&]{ scl.SyncWritePos(IDs, 3, Pos, Time, Speed); });
+	check("SCSCL::PWMMode(3)", {0xff, 0xff, 0x03, 0x07, 0x03, 0x09, 0x00, 0x00, 0x00, 0x00, 0xe9}, [&]{ scl.PWMMode(3); });
+	check("SCSCL::WritePWM(4, -300)", {0xff, 0xff, 0x04, 0x05, 0x03, 0x2c, 0x05, 0x2c, 0x96}, [&]{ scl.WritePWM(4, -300); });
+	check("SCSCL::EnableTorque(0xfe, 1)", {0xff, 0xff, 0xfe, 0x04, 0x03, 0x28, 0x01, 0xd1}, [&]{ scl.EnableTorque(0xfe, 1); });
+	check("SCSCL::unLockEprom(6)", {0xff, 0xff, 0x06, 0x04, 0x03, 0x30, 0x00, 0xc2}, [&]{ scl.unLockEprom(6); });
+	check("SCSCL::LockEprom(6)", {0xff, 0xff, 0x06, 0x04, 0x03, 0x30, 0x01, 0xc1}, [&]{ scl.LockEprom(6); });
+	check("SCSCL::FeedBack(7)", {0xff, 0xff, 0x07, 0x04, 0x02, 0x38, 0x0f, 0xab}, [&]{ scl.FeedBack(7); });
+	check("SCSCL::ReadPos(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x38, 0x02, 0xb7}, [&]{ scl.ReadPos(8); });
+	check("SCSCL::ReadSpeed(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3a, 0x02, 0xb5}, [&]{ scl.ReadSpeed(8); });
+	check("SCSCL::ReadLoad(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3c, 0x02, 0xb3}, [&]{ scl.ReadLoad(8); });
+	check("SCSCL::ReadVoltage(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3e, 0x01, 0xb2}, [&]{ scl.ReadVoltage(8); });
+	check("SCSCL::ReadTemper(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3f, 0x01, 0xb1}, [&]{ scl.ReadTemper(8); });
+	check("SCSCL::ReadMove(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x42, 0x01, 0xae}, [&]{ scl.ReadMove(8); });
+	check("SCSCL::ReadCurrent(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x45, 0x02, 0xaa}, [&]{ scl.ReadCurrent(8); });
+	check("SMS_STS::genWrite(1, SMS_STS_GOAL_POSITION_L, Dat, 3)", {0xff, 0xff, 0x01, 0x06, 0x03, 0x2a, 0x01, 0x02, 0x03, 0xc5}, [&]{ sts.genWrite(1, SMS_STS_GOAL_POSITION_L, Dat, 3); });
+	check("SMS_STS::writeWord(5, SMS_STS_GOAL_POSITION_L, 0x1234)", {0xff, 0xff, 0x05, 0x05, 0x03, 0x2a, 0x34, 0x12, 0x82}, [&]{ sts.writeWord(5, SMS_STS_GOAL_POSITION_L, 0x1234); });
+	check("SMS_STS::WritePosEx(1, -500, 1000, 50)", {0xff, 0xff, 0x01, 0x0a, 0x03, 0x29, 0x32, 0xf4, 0x81, 0x00, 0x00, 0xe8, 0x03, 0x36}, [&]{ sts.WritePosEx(1, -500, 1000, 50); });
+	check("SMS_STS::RegWritePosEx(2, 2047, 0)", {0xff, 0xff, 0x02, 0x0a, 0x04, 0x29, 0x00, 0xff, 0x07, 0x00, 0x00, 0x00, 0x00, 0xc0}, [&]{ sts.RegWritePosEx(2, 2047, 0); });
+	check("SMS_STS::SyncWritePosEx(IDs, 3, PosEx, Speed, ACC)", {0xff, 0xff, 0xfe, 0x1c, 0x83, 0x29, 0x07, 0x01, 0x00, 0x64, 0x80, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0a, 0x00, 0x08, 0x00, 0x00, 0xf4, 0x01, 0x03, 0xfe, 0xa0, 0x0f, 0x00, 0x00, 0xdc, 0x05, 0xb3}, [&]{ sts.SyncWritePosEx(IDs, 3, PosEx, Speed, ACC); });
+	check("SMS_STS::WheelMode(3)", {0xff, 0xff, 0x03, 0x04, 0x03, 0x21, 0x01, 0xd3}, [&]{ sts.WheelMode(3); });
+	check("SMS_STS::WriteSpe(3, -200, 10)", {0xff, 0xff, 0x03, 0x04, 0x03, 0x29, 0x0a, 0xc2, 0xff, 0xff, 0x03, 0x05, 0x03, 0x2e, 0xc8, 0x80, 0x7e}, [&]{ sts.WriteSpe(3, -200, 10); });
+	check("SMS_STS::EnableTorque(4, 0)", {0xff, 0xff, 0x04, 0x04, 0x03, 0x28, 0x00, 0xcc}, [&]{ sts.EnableTorque(4, 0); });
+	check("SMS_STS::unLockEprom(6)", {0xff, 0xff, 0x06, 0x04, 0x03, 0x37, 0x00, 0xbb}, [&]{ sts.unLockEprom(6); });
+	check("SMS_STS::LockEprom(6)", {0xff, 0xff, 0x06, 0x04, 0x03, 0x37, 0x01, 0xba}, [&]{ sts.LockEprom(6); });
+	check("SMS_STS::CalibrationOfs(5)", {0xff, 0xff, 0x05, 0x04, 0x03, 0x28, 0x80, 0x4b}, [&]{ sts.CalibrationOfs(5); });
+	check("SMS_STS::FeedBack(7)", {0xff, 0xff, 0x07, 0x04, 0x02, 0x38, 0x0f, 0xab}, [&]{ sts.FeedBack(7); });
+	check("SMS_STS::ReadPos(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x38, 0x02, 0xb7}, [&]{ sts.ReadPos(8); });
+	check("SMS_STS::ReadSpeed(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3a, 0x02, 0xb5}, [&]{ sts.ReadSpeed(8); });
+	check("SMS_STS::ReadLoad(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3c, 0x02, 0xb3}, [&]{ sts.ReadLoad(8); });
+	check("SMS_STS::ReadVoltage(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3e, 0x01, 0xb2}, [&]{ sts.ReadVoltage(8); });
+	check("SMS_STS::ReadTemper(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x3f, 0x01, 0xb1}, [&]{ sts.ReadTemper(8); });
+	check("SMS_STS::ReadMove(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x42, 0x01, 0xae}, [&]{ sts.ReadMove(8); });
+	check("SMS_STS::ReadCurrent(8)", {0xff, 0xff, 0x08, 0x04, 0x02, 0x45, 0x02, 0xaa}, [&]{ sts.ReadCurrent(8); });
+
+	printf("%d frames checked, %d failed\n", Checked, Failed);
+	return Failed ? 1 : 0;
+}
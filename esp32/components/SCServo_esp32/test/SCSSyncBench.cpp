@@ -0,0 +1,134 @@
+/*
+ * SCSSyncBench.cpp
+ * Feetech serial servo sync instructions on the simulated bus, host test
+ * The goals of 12 servos are written with one sync write and with one
+ * write per servo, their feedback is read with one sync read and with one
+ * read per servo. Both ways must leave the servos and the data read the
+ * same; the virtual bus time and the bytes on the wire of each are printed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "SCServo.h"
+#include "SCSim.h"
+
+#define BENCH_SERVOS 12
+#define BENCH_CYCLES 50
+#define BENCH_FEEDBACK_LEN (SCSCL_PRESENT_LOAD_H-SCSCL_PRESENT_POSITION_L+1)
+
+static int Failed;
+
+struct Cost{
+	uint64_t Ns;
+	u32 TxBytes;
+	u32 RxBytes;
+};
+
+class Meter{
+public:
+	Meter(SCSim &Bus):Bus(Bus), Ns(Bus.Now), TxBytes(Bus.TxBytes), RxBytes(Bus.RxBytes){}
+	void add(Cost &Total){
+		Total.Ns += Bus.Now-Ns;
+		Total.TxBytes += Bus.TxBytes-TxBytes;
+		Total.RxBytes += Bus.RxBytes-RxBytes;
+	}
+private:
+	SCSim &Bus;
+	uint64_t Ns;
+	u32 TxBytes;
+	u32 RxBytes;
+};
+
+static void print(const char *Name, const Cost &Total)
+{
+	printf("  %-20s %8.1f us %6lu tx %6lu rx\n", Name, Total.Ns/1000.0/BENCH_CYCLES,
+		(unsigned long)(Total.TxBytes/BENCH_CYCLES), (unsigned long)(Total.RxBytes/BENCH_CYCLES));
+}
+
+static u16 goal(int Cycle, int Index)
+{
+	return 200+((Cycle*37+Index*61)%600);
+}
+
+static void bench(u32 Baud, u8 Level)
+{
+	SCSim Bus(Baud);
+	SCSCL scl(1, Level);
+	scl.Transport = &Bus;
+	scl.setBaud(Baud);
+	u8 IDs[BENCH_SERVOS];
+	for(u8 i=0; i<BENCH_SERVOS; i++){
+		IDs[i] = i+1;
+		Bus.addServo(IDs[i])->Mem[SCSCL_RETURN_LEVEL] = Level;
+	}
+	scl.syncReadBegin(BENCH_SERVOS, BENCH_FEEDBACK_LEN, 10);
+	scl.EnableTorque(0xfe, 1);
+
+	Cost SyncWrite = {}, Write = {}, SyncRead = {}, Read = {};
+	u16 Pos[BENCH_SERVOS], Time[BENCH_SERVOS] = {}, Speed[BENCH_SERVOS] = {};
+	for(int Cycle=0; Cycle<BENCH_CYCLES; Cycle++){
+		//same goals both ways, servos settled in between
+		for(int i=0; i<BENCH_SERVOS; i++){
+			Pos[i] = goal(Cycle, i);
+		}
+		Meter SyncWriteMeter(Bus);
+		scl.SyncWritePos(IDs, BENCH_SERVOS, Pos, Time, Speed);
+		SyncWriteMeter.add(SyncWrite);
+		Bus.step(1000000);
+		for(int i=0; i<BENCH_SERVOS; i++){
+			Pos[i] = goal(Cycle+1, i);
+		}
+		Meter WriteMeter(Bus);
+		for(int i=0; i<BENCH_SERVOS; i++){
+			scl.WritePos(IDs[i], Pos[i], 0, 0);
+		}
+		WriteMeter.add(Write);
+		Bus.step(1000000);
+
+		u8 SyncDat[BENCH_SERVOS][BENCH_FEEDBACK_LEN];
+		u8 ReadDat[BENCH_SERVOS][BENCH_FEEDBACK_LEN];
+		Meter SyncReadMeter(Bus);
+		scl.syncReadPacketTx(IDs, BENCH_SERVOS, SCSCL_PRESENT_POSITION_L, BENCH_FEEDBACK_LEN);
+		for(int i=0; i<BENCH_SERVOS; i++){
+			if(scl.syncReadPacketRx(IDs[i], SyncDat[i])!=BENCH_FEEDBACK_LEN){
+				memset(SyncDat[i], 0xff, BENCH_FEEDBACK_LEN);
+			}
+		}
+		SyncReadMeter.add(SyncRead);
+		Meter ReadMeter(Bus);
+		for(int i=0; i<BENCH_SERVOS; i++){
+			if(scl.Read(IDs[i], SCSCL_PRESENT_POSITION_L, ReadDat[i], BENCH_FEEDBACK_LEN)!=BENCH_FEEDBACK_LEN){
+				memset(ReadDat[i], 0xfe, BENCH_FEEDBACK_LEN);
+			}
+		}
+		ReadMeter.add(Read);
+
+		for(int i=0; i<BENCH_SERVOS; i++){
+			u16 Present = ReadDat[i][0]<<8|ReadDat[i][1];
+			if(memcmp(SyncDat[i], ReadDat[i], BENCH_FEEDBACK_LEN) || Present!=Pos[i]){
+				printf("FAIL %lu baud level %d cycle %d servo %d : position %d, goal %d\n",
+					(unsigned long)Baud, Level, Cycle, IDs[i], Present, Pos[i]);
+				Failed++;
+				break;
+			}
+		}
+	}
+	scl.syncReadEnd();
+
+	printf("%lu baud, return level %d, %d servos (per cycle):\n", (unsigned long)Baud, Level, BENCH_SERVOS);
+	print("sync write", SyncWrite);
+	print("write per servo", Write);
+	print("sync read", SyncRead);
+	print("read per servo", Read);
+}
+
+int main()
+{
+	static const u32 Bauds[] = {1000000, 500000};
+	for(u32 Baud : Bauds){
+		bench(Baud, 1);
+		bench(Baud, 0);
+	}
+	printf("%s\n", Failed ? "FAILED" : "sync and per-servo transactions agree");
+	return Failed ? 1 : 0;
+}
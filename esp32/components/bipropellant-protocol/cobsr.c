@@ -5,6 +5,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "cobsr.h"
 
 
@@ -36,8 +37,8 @@
  *                 operation and the length of the result (that was written to
  *                 dst_buf_ptr)
  */
-cobsr_encode_result cobsr_encode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
-                                 const uint8_t * src_ptr, size_t src_len)
+cobsr_encode_result cobsr_encode_bytewise(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                          const uint8_t * src_ptr, size_t src_len)
 {
     cobsr_encode_result result              = { 0, COBSR_ENCODE_OK };
     const uint8_t *     src_read_ptr        = src_ptr;
@@ -157,8 +158,8 @@ cobsr_encode_result cobsr_encode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
  *                 operation and the length of the result (that was written to
  *                 dst_buf_ptr)
  */
-cobsr_decode_result cobsr_decode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
-                                 const uint8_t * src_ptr, size_t src_len)
+cobsr_decode_result cobsr_decode_bytewise(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                          const uint8_t * src_ptr, size_t src_len)
 {
     cobsr_decode_result result              = { 0, COBSR_DECODE_OK };
     const uint8_t *     src_read_ptr        = src_ptr;
@@ -276,3 +277,246 @@ cobsr_decode_result cobsr_decode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
 
     return result;
 }
+
+
+#if COBSR_WORD_AT_A_TIME
+
+/* Non-zero if one of the 4 bytes of x is zero. */
+#define COBSR_HAS_ZERO_BYTE(x)      (((x) - 0x01010101u) & ~(x) & 0x80808080u)
+
+/* Runs shorter than this are copied without calling memmove(). */
+#define COBSR_SHORT_RUN             16u
+
+/* Index of the first zero byte in a byte string, len if there is none.
+ * Words are read once aligned: targets without unaligned loads (Xtensa)
+ * would otherwise load them one byte at a time.
+ */
+static size_t cobsr_find_zero(const uint8_t * ptr, size_t len)
+{
+    size_t              i                   = 0;
+    uint32_t            word;
+
+    while ((i < len) && (((uintptr_t)(ptr + i) & (sizeof(word) - 1)) != 0))
+    {
+        if (ptr[i] == 0)
+        {
+            return i;
+        }
+        i++;
+    }
+    while (i + sizeof(word) <= len)
+    {
+        memcpy(&word, __builtin_assume_aligned(ptr + i, sizeof(word)), sizeof(word));
+        if (COBSR_HAS_ZERO_BYTE(word))
+        {
+            break;
+        }
+        i += sizeof(word);
+    }
+    while ((i < len) && (ptr[i] != 0))
+    {
+        i++;
+    }
+    return i;
+}
+
+/* COBS/R-encode a string of input bytes, one run of non-zero bytes at a time.
+ * In-place encoding gives the same result as the byte-wise implementation:
+ * runs are moved with memmove() and the final byte is read before it is
+ * overwritten. With the destination one byte before the source (as
+ * protocol_frame_encode does), code bytes replace the zero bytes and runs
+ * shorter than 254 bytes are not moved at all.
+ */
+cobsr_encode_result cobsr_encode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                 const uint8_t * src_ptr, size_t src_len)
+{
+    cobsr_encode_result result              = { 0, COBSR_ENCODE_OK };
+    const uint8_t *     src_read_ptr        = src_ptr;
+    const uint8_t *     src_end_ptr         = src_ptr + src_len;
+    uint8_t *           dst_code_write_ptr  = dst_buf_ptr;
+    uint8_t *           dst_write_ptr       = dst_code_write_ptr + 1;
+    uint8_t             src_byte_last;
+    size_t              search_max;
+    size_t              run_len;
+    uint8_t             search_len;
+
+
+    /* Error cases and buffers that may overflow are left to the byte-wise implementation. */
+    if ((dst_buf_ptr == NULL) || (src_ptr == NULL) || (src_len == 0) ||
+        (dst_buf_len < COBSR_ENCODE_DST_BUF_LEN_MAX(src_len)))
+    {
+        return cobsr_encode_bytewise(dst_buf_ptr, dst_buf_len, src_ptr, src_len);
+    }
+
+    src_byte_last = *(src_end_ptr - 1);
+
+    for (;;)
+    {
+        /* Copy the non-zero bytes up to the next zero byte, 254 at most */
+        search_max = src_end_ptr - src_read_ptr;
+        if (search_max > 0xFE)
+        {
+            search_max = 0xFE;
+        }
+        run_len = cobsr_find_zero(src_read_ptr, search_max);
+        if (dst_write_ptr == src_read_ptr)
+        {
+            /* Already in place */
+        }
+        else if (run_len < COBSR_SHORT_RUN)
+        {
+            /* Backwards: the destination may be ahead of the source */
+            for (size_t i = run_len; i != 0; i--)
+            {
+                dst_write_ptr[i - 1] = src_read_ptr[i - 1];
+            }
+        }
+        else
+        {
+            memmove(dst_write_ptr, src_read_ptr, run_len);
+        }
+        dst_write_ptr += run_len;
+        src_read_ptr += run_len;
+        search_len = run_len + 1;
+
+        if (run_len < search_max)
+        {
+            /* We found a zero byte */
+            src_read_ptr++;
+            *dst_code_write_ptr = search_len;
+            dst_code_write_ptr = dst_write_ptr++;
+            search_len = 1;
+            if (src_read_ptr >= src_end_ptr)
+            {
+                break;
+            }
+        }
+        else if (src_read_ptr >= src_end_ptr)
+        {
+            break;
+        }
+        else
+        {
+            /* We have a long string of non-zero bytes, so we need
+             * to write out a length code of 0xFF. */
+            *dst_code_write_ptr = search_len;
+            dst_code_write_ptr = dst_write_ptr++;
+        }
+    }
+
+    /* Final code byte, as in the byte-wise implementation. */
+    if (src_byte_last < search_len)
+    {
+        *dst_code_write_ptr = search_len;
+    }
+    else
+    {
+        *dst_code_write_ptr = src_byte_last;
+        dst_write_ptr--;
+    }
+
+    result.out_len = dst_write_ptr - dst_buf_ptr;
+
+    return result;
+}
+
+/* Decode a COBS/R byte string, one run of non-zero bytes at a time.
+ */
+cobsr_decode_result cobsr_decode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                 const uint8_t * src_ptr, size_t src_len)
+{
+    cobsr_decode_result result              = { 0, COBSR_DECODE_OK };
+    const uint8_t *     src_read_ptr        = src_ptr;
+    const uint8_t *     src_end_ptr         = src_ptr + src_len;
+    uint8_t *           dst_write_ptr       = dst_buf_ptr;
+    size_t              remaining_input_bytes;
+    size_t              num_output_bytes;
+    uint8_t             len_code;
+
+
+    /* The output is never longer than the input: with a buffer that long, there is no overflow to check.
+     * Error cases and shorter buffers are left to the byte-wise implementation. */
+    if ((dst_buf_ptr == NULL) || (src_ptr == NULL) || (src_len == 0) || (dst_buf_len < src_len))
+    {
+        return cobsr_decode_bytewise(dst_buf_ptr, dst_buf_len, src_ptr, src_len);
+    }
+
+    for (;;)
+    {
+        len_code = *src_read_ptr++;
+        if (len_code == 0)
+        {
+            result.status |= COBSR_DECODE_ZERO_BYTE_IN_INPUT;
+            break;
+        }
+
+        remaining_input_bytes = src_end_ptr - src_read_ptr;
+
+        if ((len_code - 1u) < remaining_input_bytes)
+        {
+            num_output_bytes = len_code - 1;
+        }
+        else
+        {
+            /* Last length code: the remaining bytes */
+            num_output_bytes = remaining_input_bytes;
+        }
+
+        if (cobsr_find_zero(src_read_ptr, num_output_bytes) < num_output_bytes)
+        {
+            result.status |= COBSR_DECODE_ZERO_BYTE_IN_INPUT;
+        }
+        if (num_output_bytes < COBSR_SHORT_RUN)
+        {
+            /* Forwards: the destination may be behind the source */
+            for (size_t i = 0; i < num_output_bytes; i++)
+            {
+                dst_write_ptr[i] = src_read_ptr[i];
+            }
+        }
+        else
+        {
+            memmove(dst_write_ptr, src_read_ptr, num_output_bytes);
+        }
+        dst_write_ptr += num_output_bytes;
+        src_read_ptr += num_output_bytes;
+
+        if ((len_code - 1u) < remaining_input_bytes)
+        {
+            /* Add a zero to the end */
+            if (len_code != 0xFF)
+            {
+                *dst_write_ptr++ = 0;
+            }
+        }
+        else
+        {
+            /* Write final data byte, if applicable for COBS/R encoding. */
+            if (len_code - 1u > remaining_input_bytes)
+            {
+                *dst_write_ptr++ = len_code;
+            }
+            break;
+        }
+    }
+
+    result.out_len = dst_write_ptr - dst_buf_ptr;
+
+    return result;
+}
+
+#else
+
+cobsr_encode_result cobsr_encode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                 const uint8_t * src_ptr, size_t src_len)
+{
+    return cobsr_encode_bytewise(dst_buf_ptr, dst_buf_len, src_ptr, src_len);
+}
+
+cobsr_decode_result cobsr_decode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                 const uint8_t * src_ptr, size_t src_len)
+{
+    return cobsr_decode_bytewise(dst_buf_ptr, dst_buf_len, src_ptr, src_len);
+}
+
+#endif /* COBSR_WORD_AT_A_TIME */
@@ -31,6 +31,17 @@
  */
 #define COBSR_ENCODE_SRC_OFFSET(SRC_LEN)                (((SRC_LEN) + 253u)/254u)
 
+/*
+ * 1: cobsr_encode() and cobsr_decode() look for zero bytes one 32-bit word
+ * at a time and copy the runs in between with memmove(). Same results as the
+ * byte-wise implementation, which they fall back to when the destination
+ * buffer may be too short.
+ * 0: cobsr_encode() and cobsr_decode() are the byte-wise implementation.
+ */
+#ifndef COBSR_WORD_AT_A_TIME
+#define COBSR_WORD_AT_A_TIME                            1
+#endif
+
 
 /*****************************************************************************
  * Typedefs
@@ -101,6 +112,12 @@ cobsr_encode_result cobsr_encode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
 cobsr_decode_result cobsr_decode(uint8_t * dst_buf_ptr, size_t dst_buf_len,
                                  const uint8_t * src_ptr, size_t src_len);
 
+/* Byte-wise reference implementations, same arguments and results. */
+cobsr_encode_result cobsr_encode_bytewise(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                          const uint8_t * src_ptr, size_t src_len);
+cobsr_decode_result cobsr_decode_bytewise(uint8_t * dst_buf_ptr, size_t dst_buf_len,
+                                          const uint8_t * src_ptr, size_t src_len);
+
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -20,6 +20,7 @@
 /*
 * usage:
 * call void protocol_byte( unsigned char byte ); with incoming bytes from main.call
+* or void protocol_bytes( const unsigned char *data, int len ); with a chunk of them
 * will call protocol_process_message when message received (protocol.c)
 * call protocol_post to send a message
 */
@@ -34,9 +35,8 @@
 
 
 
-static unsigned char mpGetTxByte(MACHINE_PROTOCOL_TX_BUFFER *buf);
 static char mpGetTxMsg(MACHINE_PROTOCOL_TX_BUFFER *buf, unsigned char *dest);
-static void mpPutTx(MACHINE_PROTOCOL_TX_BUFFER *buf, unsigned char value);
+static void mpPutTxMsg(MACHINE_PROTOCOL_TX_BUFFER *buf, const unsigned char *src, int len);
 
 //////////////////////////////////////////////////////////////////
 
@@ -60,6 +60,13 @@ static void protocol_send_nack(int (*send_serial_data)( unsigned char *data, int
 static void protocol_send_ack(int (*send_serial_data)( unsigned char *data, int len ), unsigned char CI);
 static int protocol_send(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg);
 static int protocol_send_raw(int (*send_serial_data)( unsigned char *data, int len ), PROTOCOL_MSG3full *msgFull);
+static PROTOCOL_ACK_SLOT *protocol_window_open(PROTOCOL_STAT *s);
+static void protocol_window_send(PROTOCOL_STAT *s, PROTOCOL_ACK_SLOT *slot);
+static int protocol_window_ack(PROTOCOL_STAT *s, unsigned char CI);
+static int protocol_window_nack(PROTOCOL_STAT *s, unsigned char CI);
+static int protocol_window_receive(PROTOCOL_STAT *s, unsigned char CI);
+static void protocol_window_tick(PROTOCOL_STAT *s);
+static void protocol_fragments_tx(PROTOCOL_STAT *s);
 
 
 int protocol_cobsr_decode(PROTOCOL_MSG3 *msg)
@@ -83,22 +90,6 @@ int protocol_cobsr_decode(PROTOCOL_MSG3 *msg)
     return (int) result.status;
 }
 
-int protocol_cobsr_encode(PROTOCOL_MSG3 *msg)
-{
-    // COBSR encoding can result in a length which is 1 byte longer. Enough Memory has to be provided.
-    cobsr_encode_result result = cobsr_encode(msg->bytes, (size_t)msg->len + 1, msg->bytes, (size_t)msg->len);
-
-    if(result.out_len >= 1) // At least CS
-    {
-        msg->len = (unsigned char) result.out_len;
-    }
-    else
-    {
-        return -1; // Message too short, invalid.
-    }
-    return (int) result.status;
-}
-
 void protocol_SOM_decode(PROTOCOL_MSG3 *msg) {
 
     if(0b10000000 & msg->cmd) {
@@ -214,6 +205,10 @@ void protocol_byte(PROTOCOL_STAT *s, unsigned char byte ){
             case PROTOCOL_SOM_ACK:
                 switch(s->curr_msg.cmd) {
                 case PROTOCOL_CMD_ACK:
+                    if (protocol_window_ack(s, s->curr_msg.CI)) {
+                        // message in the ACK window, its slot is free again
+                        break;
+                    }
                     if (s->send_state == PROTOCOL_ACK_TX_WAITING){
                         if (s->curr_msg.CI == s->ack.curr_send_msg.CI){
                             s->ack.last_send_time = 0;
@@ -238,6 +233,10 @@ void protocol_byte(PROTOCOL_STAT *s, unsigned char byte ){
 
                 case PROTOCOL_CMD_NACK:
                     // 'If an end receives a NACK, it should resend the last message with the same CI, up to 2 retries'
+                    if (protocol_window_nack(s, s->curr_msg.CI)) {
+                        // message in the ACK window, only this one is resent
+                        break;
+                    }
                     if (s->send_state == PROTOCOL_ACK_TX_WAITING){
                         // ignore CI
                         if (s->ack.retries > 0){
@@ -268,6 +267,16 @@ void protocol_byte(PROTOCOL_STAT *s, unsigned char byte ){
                         break;
                     }
 
+                    if (s->window.size > 1) {
+                        // several messages in flight: ACK every copy, process each CI once
+                        protocol_send_ack(s->send_serial_data, s->curr_msg.CI);
+                        if (protocol_window_receive(s, s->curr_msg.CI)) {
+                            s->ack.counters.rx++;
+                            protocol_process_message(s, (PROTOCOL_MSG3full *)&(s->curr_msg));
+                        }
+                        break;
+                    }
+
                     if (s->ack.lastRXCI == s->curr_msg.CI) {
                         // 'if a message is received with the same CI as the last received message, ACK will be sent, but the message discarded.'
                         protocol_send_ack(s->send_serial_data, s->curr_msg.CI);
@@ -348,6 +357,47 @@ void protocol_byte(PROTOCOL_STAT *s, unsigned char byte ){
     }
 }
 
+// called from main.c with a chunk of received bytes
+// externed in protocol.h
+// same as protocol_byte() on each byte : bytes between messages are skipped up to the next SOM
+// and message bodies are copied at once, only the bytes that change the state go through protocol_byte()
+void protocol_bytes(PROTOCOL_STAT *s, const unsigned char *data, int len){
+    const unsigned char *end = data + len;
+
+    while (data < end) {
+        int avail = end - data;
+
+        if ((s->state == PROTOCOL_STATE_IDLE || s->state == PROTOCOL_STATE_BADCHAR) && !s->allow_ascii) {
+            const unsigned char *som = memchr(data, PROTOCOL_SOM, avail);
+            if (som != data) {
+                // protocol_byte() flags each of them as a bad char
+                s->state = PROTOCOL_STATE_BADCHAR;
+                if (!som) {
+                    s->last_char_time = protocol_GetTick();
+                    return;
+                }
+                data = som;
+            }
+        } else if (s->state == PROTOCOL_STATE_WAIT_END && s->count + 1 < s->curr_msg.len) {
+            // body up to its last byte or the next SOM, the last byte completes the message in protocol_byte()
+            int n = s->curr_msg.len - s->count - 1;
+            if (n > avail) n = avail;
+            const unsigned char *som = memchr(data, PROTOCOL_SOM, n);
+            if (som) n = som - data;
+            if (n) {
+                memcpy(&s->curr_msg.bytes[s->count], data, n);
+                s->count += n;
+                data += n;
+                // otherwise the time is taken by protocol_byte() on the next byte
+                if (data == end) s->last_char_time = protocol_GetTick();
+                continue;
+            }
+        }
+
+        protocol_byte(s, *data++);
+    }
+}
+
 
 // private
 void protocol_send_nack(int (*send_serial_data)( unsigned char *data, int len ), unsigned char CI, unsigned char som){
@@ -382,9 +432,19 @@ void protocol_send_ack(int (*send_serial_data)( unsigned char *data, int len ),
 //  1 queued for later TX
 int protocol_post(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
 
+    if(s->batch) {
+        // response to a record of a batch, sent with the others
+        return protocol_batch_add(s->batch, msg);
+    }
+
     if(msg->SOM == PROTOCOL_SOM_ACK) {
         int txcount = mpTxQueued(&s->ack.TxBuffer);
-        if ((s->send_state != PROTOCOL_ACK_TX_WAITING) && !txcount){
+        if (s->window.size > 1) {
+            if (!txcount && protocol_window_open(s)) {
+                return protocol_send(s, msg);
+            }
+
+        } else if ((s->send_state != PROTOCOL_ACK_TX_WAITING) && !txcount){
 
             return protocol_send(s, msg);
         }
@@ -397,10 +457,8 @@ int protocol_post(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
             return -1;
         }
 
-        char *src = (char *) &(msg->cmd); // Do not copy SOM
-        for (int i = 0; i < total; i++) {
-            mpPutTx(&s->ack.TxBuffer, *(src++));
-        }
+        mpPutTxMsg(&s->ack.TxBuffer, &(msg->cmd), total); // Do not copy SOM
+        if (s->window.size > 1) s->ack.counters.windowFull++;
 
         return 1; // added to queue
 
@@ -411,54 +469,179 @@ int protocol_post(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
 }
 
 
-// private
-// note: if NULL in, send one message from queue
-int protocol_send(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
-    if(msg) {
-        if(msg->SOM == PROTOCOL_SOM_ACK && s->send_state == PROTOCOL_ACK_TX_WAITING) {
-            // Tried to Send Message which requires ACK, but a message is still pending.
-            return -1;
+// called to build a message straight into the frame it is sent from:
+// fill in cmd, code, lenPayload and content, then call protocol_commit
+// returns:
+//  NULL - the message would have to be queued (or is part of a batch), use protocol_post
+// externed in protocol.h
+PROTOCOL_MSG3full *protocol_reserve(PROTOCOL_STAT *s, unsigned char som){
+    PROTOCOL_MSG3full *msg;
 
-        } else if(msg->SOM == PROTOCOL_SOM_ACK && s->send_state == PROTOCOL_ACK_TX_IDLE) {
-            // Idling (not waiting for ACK), send the Message directly
-            memcpy(&s->ack.curr_send_msg, msg, 5 + msg->lenPayload); // SOM, cmd, CI, len, code + size of content
-            if( !(++(s->ack.lastTXCI)) ) s->ack.lastTXCI = 1;        // 0 is not a valid CI
-            s->ack.curr_send_msg.CI = s->ack.lastTXCI;
-            s->ack.counters.tx++;
-            protocol_send_raw(s->send_serial_data, &s->ack.curr_send_msg);
-            s->send_state = PROTOCOL_ACK_TX_WAITING;
-            s->ack.last_send_time = protocol_GetTick();
-            s->ack.retries = 2;
-            return 0;
+    if(s->batch) {
+        // responses of a batch are gathered by protocol_post
+        return NULL;
+    }
 
-        } else if (msg->SOM == PROTOCOL_SOM_NOACK) {
-            // Send Message without ACK immediately
-            memcpy(&s->noack.curr_send_msg, msg, 5 + msg->lenPayload); // SOM, cmd, CI, len, code + size of content
-            if( !(++(s->noack.lastTXCI)) ) s->noack.lastTXCI = 1;        // 0 is not a valid CI
-            s->noack.curr_send_msg.CI = s->noack.lastTXCI;
-            s->noack.counters.tx++;
-            protocol_send_raw(s->send_serial_data, &s->noack.curr_send_msg);
-            return 0;
+    if(som == PROTOCOL_SOM_NOACK) {
+        msg = &s->noack.curr_send_msg;
 
+    } else if(som == PROTOCOL_SOM_ACK) {
+        if(mpTxQueued(&s->ack.TxBuffer)) {
+            // Messages are waiting, keep the order
+            return NULL;
+        }
+        if(s->window.size > 1) {
+            PROTOCOL_ACK_SLOT *slot = protocol_window_open(s);
+            if(!slot) return NULL;
+            msg = &slot->msg;   // the slot stays free until committed (CI 0)
+        } else if(s->send_state == PROTOCOL_ACK_TX_WAITING) {
+            return NULL;
         } else {
-            // Shouldn't happen, unknowm SOM
+            msg = &s->ack.curr_send_msg;
+        }
+
+    } else {
+        // Shouldn't happen, unknowm SOM
+        return NULL;
+    }
+
+    msg->SOM = som;
+    return msg;
+}
+
+// called to send a message returned by protocol_reserve. CI and Checksum are added
+// externed in protocol.h
+int protocol_commit(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
+    if(msg == &s->noack.curr_send_msg) {
+        // Send Message without ACK immediately
+        if( !(++(s->noack.lastTXCI)) ) s->noack.lastTXCI = 1;        // 0 is not a valid CI
+        msg->CI = s->noack.lastTXCI;
+        s->noack.counters.tx++;
+        protocol_send_raw(s->send_serial_data, msg);
+        return 0;
+    }
+
+    if(msg == &s->ack.curr_send_msg) {
+        // Idling (not waiting for ACK), send the Message directly
+        if( !(++(s->ack.lastTXCI)) ) s->ack.lastTXCI = 1;        // 0 is not a valid CI
+        msg->CI = s->ack.lastTXCI;
+        s->ack.counters.tx++;
+        protocol_send_raw(s->send_serial_data, msg);
+        s->send_state = PROTOCOL_ACK_TX_WAITING;
+        s->ack.last_send_time = protocol_GetTick();
+        s->ack.retries = 2;
+        return 0;
+    }
+
+    for (int i = 0; i < PROTOCOL_ACK_WINDOW_MAX; i++) {
+        if(msg == &s->window.slots[i].msg) {
+            // Send the Message in its slot of the ACK window
+            protocol_window_send(s, &s->window.slots[i]);
+            return 0;
+        }
+    }
+
+    return -1; // not reserved
+}
+
+
+// called to send a message larger than one frame in fragments ('F')
+// the parts are sent from protocol_tick as frames become free
+// externed in protocol.h
+int protocol_send_fragments(PROTOCOL_STAT *s, unsigned char som, unsigned char cmd, unsigned char code, const void *data, int len){
+    PROTOCOL_FRAGMENT_TX *tx = &s->fragment_tx;
+
+    if(tx->data || !data || len <= 0 || len > 0xFFFF) {
+        return -1;
+    }
+    if(som != PROTOCOL_SOM_ACK && som != PROTOCOL_SOM_NOACK) {
+        return -1;
+    }
+    tx->seq++;
+    tx->som = som;
+    tx->cmd = cmd;
+    tx->code = code;
+    tx->len = (uint16_t) len;
+    tx->offset = 0;
+    tx->data = data;
+
+    protocol_fragments_tx(s);
+    return 0;
+}
+
+// private
+// sends the next parts of the message being sent in fragments,
+// as many as frames are free (PROTOCOL_FRAGMENT_BURST without ACK)
+static void protocol_fragments_tx(PROTOCOL_STAT *s){
+    PROTOCOL_FRAGMENT_TX *tx = &s->fragment_tx;
+    int burst = PROTOCOL_FRAGMENT_BURST;
+
+    // parts of the previous message may still be resent, they are processed as they come:
+    // the first part waits until none is in flight, so that both are not mixed up.
+    if(tx->data && !tx->offset && tx->som == PROTOCOL_SOM_ACK && (s->window.inflight || s->send_state == PROTOCOL_ACK_TX_WAITING)) {
+        return;
+    }
+
+    while(tx->data && burst > 0) {
+        PROTOCOL_MSG3full *msg = protocol_reserve(s, tx->som);
+        if(!msg) {
+            return; // window full or messages queued, next tick
+        }
+
+        int len = tx->len - tx->offset;
+        if(len > (int) PROTOCOL_FRAGMENT_DATA) len = PROTOCOL_FRAGMENT_DATA;
+
+        PROTOCOL_FRAGMENT_HEADER header;
+        header.cmd = tx->cmd;
+        header.seq = tx->seq;
+        header.offset = tx->offset;
+        header.total = tx->len;
+        memcpy(msg->content, &header, sizeof(header)); // not aligned
+        memcpy(&msg->content[sizeof(header)], &tx->data[tx->offset], len);
+        msg->cmd = PROTOCOL_CMD_FRAGMENT;
+        msg->code = tx->code;
+        msg->lenPayload = sizeof(header) + len;
+
+        tx->offset += len;
+        if(tx->offset >= tx->len) {
+            tx->data = NULL; // last part
+        }
+        protocol_commit(s, msg);
+
+        if(tx->som == PROTOCOL_SOM_NOACK) burst--;
+    }
+}
+
+// private
+// note: if NULL in, send one message from queue
+int protocol_send(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
+    if(msg) {
+        PROTOCOL_MSG3full *frame = protocol_reserve(s, msg->SOM);
+        if(!frame) {
+            // Message which requires ACK but a message is still pending, or unknown SOM
             return -1;
         }
+        memcpy(frame, msg, 5 + msg->lenPayload); // SOM, cmd, CI, len, code + size of content
+        return protocol_commit(s, frame);
+
     } else {
         // No Message was given, work on Buffers then..
+        PROTOCOL_ACK_SLOT *slot;
+
+        if(s->window.size > 1 && mpTxQueued(&s->ack.TxBuffer) && (slot = protocol_window_open(s))) {
+            // Fill the ACK window from the buffer
+            do {
+                mpGetTxMsg(&s->ack.TxBuffer, &slot->msg.cmd);
+                slot->msg.SOM = PROTOCOL_SOM_ACK;
+                protocol_commit(s, &slot->msg);
+            } while(mpTxQueued(&s->ack.TxBuffer) && (slot = protocol_window_open(s)));
+            return 0;
 
-        if(s->send_state == PROTOCOL_STATE_IDLE && mpTxQueued(&s->ack.TxBuffer)) {
+        } else if(s->window.size <= 1 && s->send_state == PROTOCOL_STATE_IDLE && mpTxQueued(&s->ack.TxBuffer)) {
             // Make sure we are not waiting for another ACK. Check if There is something in the buffer.
             mpGetTxMsg(&s->ack.TxBuffer, &s->ack.curr_send_msg.cmd);
             s->ack.curr_send_msg.SOM = PROTOCOL_SOM_ACK;
-            if( !(++(s->ack.lastTXCI)) ) s->ack.lastTXCI = 1;        // 0 is not a valid CI
-            s->ack.curr_send_msg.CI = s->ack.lastTXCI;
-            s->ack.counters.tx++;
-            protocol_send_raw(s->send_serial_data, &s->ack.curr_send_msg);
-            s->send_state = PROTOCOL_ACK_TX_WAITING;
-            s->ack.last_send_time = protocol_GetTick();
-            s->ack.retries = 2;
-            return 0;
+            return protocol_commit(s, &s->ack.curr_send_msg);
 
         } else {
             // Do the other queue
@@ -466,11 +649,7 @@ int protocol_send(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
             if (ismsg){
                 // Queue has message waiting
                 s->noack.curr_send_msg.SOM = PROTOCOL_SOM_NOACK;
-                if( !(++(s->noack.lastTXCI)) ) s->noack.lastTXCI = 1;        // 0 is not a valid CI
-                s->noack.curr_send_msg.CI = s->noack.lastTXCI;
-                s->noack.counters.tx++;
-                protocol_send_raw(s->send_serial_data, &s->noack.curr_send_msg);
-                return 0;
+                return protocol_commit(s, &s->noack.curr_send_msg);
             }
         }
     }
@@ -479,41 +658,51 @@ int protocol_send(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg){
 
 
 // private
-static int protocol_send_raw(int (*send_serial_data)( unsigned char *data, int len ), PROTOCOL_MSG3full *msgFull){
+// Checksum and COBS/R encoding of the len bytes at src followed by the checksum
+// CS holds the checksum of the header, returns the encoded length
+// the bytes are copied one byte into dst, where encoding only has to write the code bytes
+static int protocol_frame_encode(unsigned char *dst, const unsigned char *src, int len, unsigned char CS){
+    memcpy(dst + 1, src, len);
+    for (int i = 0; i < len; i++) {
+        CS -= src[i];
+    }
+    dst[len + 1] = CS; // sum of the complete decoded message is zero
+
+    return (int) cobsr_encode(dst, (size_t)len + 2, dst + 1, (size_t)len + 1).out_len;
+}
 
-    PROTOCOL_MSG3 *msg = (PROTOCOL_MSG3 *) msgFull;
+// private
+// the message is left as is, resends are encoded again
+static int protocol_send_raw(int (*send_serial_data)( unsigned char *data, int len ), PROTOCOL_MSG3full *msgFull){
 
+    PROTOCOL_MSG3 frame;
 
-    // Check if Messages is already encoded or not (Resends are already encoded.)
-    if( msgFull->SOM != PROTOCOL_SOM) {
     // Encode SOM
-    if( protocol_SOM_encode(msg) != 0) return 1;
+    frame.SOM = msgFull->SOM;
+    frame.cmd = msgFull->cmd;
+    if( protocol_SOM_encode(&frame) != 0) return 1;
+    frame.CI = msgFull->CI;
 
-        // Calculate Checksum
-        unsigned char CS = -msgFull->SOM -msgFull->cmd -msgFull->CI - msgFull->lenPayload;
+    // code is only sent when not 0
+    int len = msgFull->lenPayload;
+    if( msgFull->code != 0) len += 1; // Include code.
 
-        if( msgFull->code != 0) msg->len += 1; // Include code.
+    // COBS/R adds one byte to code, content and CS
+    if( len + 2 > (int) sizeof(frame.bytes)) return 2; // failed
 
-    int i;
-        for (i = 0; i < msg->len; i++) {
-        CS -= msg->bytes[i];
-    }
-    msg->bytes[i] = CS;
-        msg->len += 1; // Include CS.
-
-    // Encode COBS/R
-        if(protocol_cobsr_encode(msg) != 0) return 2; // failed
-    }
+    // Calculate Checksum and encode COBS/R
+    unsigned char CS = -frame.SOM -frame.cmd -frame.CI - msgFull->lenPayload;
+    frame.len = protocol_frame_encode(frame.bytes, &msgFull->code, len, CS);
 
-    // Send
-    send_serial_data((unsigned char *) msg, msg->len+4); // len + size of SOM, cmd, CI & len
+    // Send, straight from the frame
+    send_serial_data((unsigned char *) &frame, frame.len+4); // len + size of SOM, cmd, CI & len
     return 0; // Successful
 }
 
 int protocol_send_text(PROTOCOL_STAT *s, char *message, unsigned char som) {
 
 
-    if( (s->params[0x26]) && (strlen(message) <= s->params[0x26]->len ) ) {
+    if( (s->params[0x26]) && (strlen(message) <= (size_t)s->params[0x26]->len ) ) {
 
         PROTOCOL_MSG3full newMsg;
         memset((void*)&newMsg,0x00,sizeof(PROTOCOL_MSG3full));
@@ -537,9 +726,10 @@ int protocol_send_text(PROTOCOL_STAT *s, char *message, unsigned char som) {
 void protocol_tick(PROTOCOL_STAT *s){
     s->last_tick_time = protocol_GetTick();
 
+    protocol_window_tick(s);
 
     if(s->send_state == PROTOCOL_ACK_TX_WAITING) {
-        if ((s->last_tick_time - s->ack.last_send_time) > s->timeout1){
+        if ((s->last_tick_time - s->ack.last_send_time) > (uint32_t)s->timeout1){
             // 'If an end does not receive an ACK response within (TIMEOUT1), it should resend the last message with the same CI, up to 2 retries'
             if (s->ack.retries > 0){
                 s->ack.counters.txRetries++;
@@ -556,6 +746,9 @@ void protocol_tick(PROTOCOL_STAT *s){
     // send from tx queue
     protocol_send(s, NULL);
 
+    // send the next parts of a message sent in fragments
+    protocol_fragments_tx(s);
+
     switch(s->state){
         case PROTOCOL_STATE_IDLE:
             break;
@@ -563,7 +756,7 @@ void protocol_tick(PROTOCOL_STAT *s){
             // 'normally, characters received BETWEEN messages which are not SOM should be treated as ASCII commands.'
             // 'implement a mode where non SOM characters between messages cause (TIMEOUT2) to be started,
             // resulting in a _NACK with CI of last received message + 1_.'
-            if ((s->last_tick_time - s->last_char_time) > s->timeout2){
+            if ((s->last_tick_time - s->last_char_time) > (uint32_t)s->timeout2){
                 protocol_send_nack(s->send_serial_data, s->curr_msg.CI+1, s->curr_msg.SOM);
                 s->last_char_time = 0;
                 s->state = PROTOCOL_STATE_IDLE;
@@ -574,7 +767,7 @@ void protocol_tick(PROTOCOL_STAT *s){
             // 'In receive, if in a message (SOM has been received) and the time since the last character
             // exceeds (TIMEOUT2), the incomming message should be discarded,
             // and a NACK should be sent with the CI of the message in progress or zero if no CI received yet'
-            if ((s->last_tick_time - s->last_char_time) > s->timeout2){
+            if ((s->last_tick_time - s->last_char_time) > (uint32_t)s->timeout2){
                 protocol_send_nack(s->send_serial_data, s->curr_msg.CI, s->curr_msg.SOM);
                 s->last_char_time = 0;
                 s->state = PROTOCOL_STATE_IDLE;
@@ -621,6 +814,171 @@ void protocol_tick(PROTOCOL_STAT *s){
 }
 
 
+/////////////////////////////////////////////////////////////////
+// ACK window
+
+// called when the peer negotiated a window (code 0x28)
+// externed in protocol.h
+int protocol_set_ack_window(PROTOCOL_STAT *s, int size){
+    if (size < 1) size = 1;
+    if (size > PROTOCOL_ACK_WINDOW_MAX) size = PROTOCOL_ACK_WINDOW_MAX;
+    if (s->window.size <= 1) {
+        // last CI received so far is the only one known
+        s->window.rx = 1;
+    }
+    // messages already in flight are completed whatever the size
+    s->window.size = size;
+    return size;
+}
+
+// CIs from 'from' to 'to', CIs going from 1 to 255
+static int protocol_ci_distance(unsigned char to, unsigned char from){
+    return ((int)to - (int)from + 255) % 255;
+}
+
+// private
+// free slot if one more message can be sent, NULL otherwise
+static PROTOCOL_ACK_SLOT *protocol_window_open(PROTOCOL_STAT *s){
+    PROTOCOL_ACK_SLOT *free_slot = NULL;
+    int oldest = -1;
+    for (int i = 0; i < PROTOCOL_ACK_WINDOW_MAX; i++) {
+        if (!s->window.slots[i].msg.CI) {
+            if (!free_slot) free_slot = &s->window.slots[i];
+            continue;
+        }
+        int back = protocol_ci_distance(s->ack.lastTXCI, s->window.slots[i].msg.CI);
+        if (back > oldest) oldest = back;
+    }
+    // the next CI stays within the window from the oldest one in flight,
+    // so that the peer can tell a retry from a new message
+    if (oldest + 2 > s->window.size) return NULL;
+    return free_slot;
+}
+
+// private
+static void protocol_window_send(PROTOCOL_STAT *s, PROTOCOL_ACK_SLOT *slot){
+    if( !(++(s->ack.lastTXCI)) ) s->ack.lastTXCI = 1;        // 0 is not a valid CI
+    slot->msg.CI = s->ack.lastTXCI;
+    s->ack.counters.tx++;
+    protocol_send_raw(s->send_serial_data, &slot->msg);
+    slot->last_send_time = protocol_GetTick();
+    slot->retries = 2;
+    s->window.inflight++;
+    if (s->window.inflight > s->ack.counters.windowPeak) {
+        s->ack.counters.windowPeak = s->window.inflight;
+    }
+}
+
+// private
+static PROTOCOL_ACK_SLOT *protocol_window_find(PROTOCOL_STAT *s, unsigned char CI){
+    if (!CI || !s->window.inflight) return NULL;
+    for (int i = 0; i < PROTOCOL_ACK_WINDOW_MAX; i++) {
+        if (s->window.slots[i].msg.CI == CI) return &s->window.slots[i];
+    }
+    return NULL;
+}
+
+// private
+static void protocol_window_release(PROTOCOL_STAT *s, PROTOCOL_ACK_SLOT *slot){
+    slot->msg.CI = 0;
+    s->window.inflight--;
+}
+
+// private
+// returns 1 if CI was in flight in the window
+static int protocol_window_ack(PROTOCOL_STAT *s, unsigned char CI){
+    PROTOCOL_ACK_SLOT *slot = protocol_window_find(s, CI);
+    if (!slot) return 0;
+    protocol_window_release(s, slot);
+    // if we got ack, then try to send the next messages
+    if (mpTxQueued(&s->ack.TxBuffer)) {
+        protocol_send(s, NULL);
+    }
+    return 1;
+}
+
+// private
+// returns 1 if CI was in flight in the window
+static int protocol_window_nack(PROTOCOL_STAT *s, unsigned char CI){
+    PROTOCOL_ACK_SLOT *slot = protocol_window_find(s, CI);
+    if (!slot) return 0;
+    if (slot->retries > 0) {
+        s->ack.counters.txRetries++;
+        protocol_send_raw(s->send_serial_data, &slot->msg);
+        slot->last_send_time = protocol_GetTick();
+        slot->retries--;
+    } else {
+        s->ack.counters.txFailed++;
+        protocol_window_release(s, slot);
+        // if we run out of retries, then try to send the next messages
+        if (mpTxQueued(&s->ack.TxBuffer)) {
+            protocol_send(s, NULL);
+        }
+    }
+    return 1;
+}
+
+// private
+// ACK-required message received with a window, returns 1 if it is to be processed
+// window.rx remembers which of the last 32 CIs were received, retries of a
+// message received already are discarded, messages arriving late are processed
+static int protocol_window_receive(PROTOCOL_STAT *s, unsigned char CI){
+    int ahead = protocol_ci_distance(CI, s->ack.lastRXCI);
+    int behind = 255 - ahead;
+
+    if (ahead == 0) {
+        s->ack.counters.rxDuplicate++;
+        return 0;
+    }
+
+    if (ahead < 128) {
+        // newer message, CIs skipped are missing until they arrive
+        s->window.rx = (ahead < 32) ? (s->window.rx << ahead) | 1 : 1;
+        s->ack.counters.rxMissing += ahead - 1;
+        s->ack.lastRXCI = CI;
+        return 1;
+    }
+
+    if (behind < 32) {
+        if (s->window.rx & (1UL << behind)) {
+            s->ack.counters.rxDuplicate++;
+            return 0;
+        }
+        s->window.rx |= 1UL << behind;
+        s->ack.counters.rxOutOfOrder++;
+        if (s->ack.counters.rxMissing) s->ack.counters.rxMissing--;
+        return 1;
+    }
+
+    // far behind, the peer started its CIs again
+    s->window.rx = 1;
+    s->ack.lastRXCI = CI;
+    return 1;
+}
+
+// private
+// 'If an end does not receive an ACK response within (TIMEOUT1), it should resend the last message with the same CI, up to 2 retries'
+// each message in the window has its own timeout
+static void protocol_window_tick(PROTOCOL_STAT *s){
+    if (!s->window.inflight) return;
+    for (int i = 0; i < PROTOCOL_ACK_WINDOW_MAX; i++) {
+        PROTOCOL_ACK_SLOT *slot = &s->window.slots[i];
+        if (!slot->msg.CI || (s->last_tick_time - slot->last_send_time) <= (uint32_t)s->timeout1) {
+            continue;
+        }
+        if (slot->retries > 0) {
+            s->ack.counters.txRetries++;
+            protocol_send_raw(s->send_serial_data, &slot->msg);
+            slot->last_send_time = protocol_GetTick();
+            slot->retries--;
+        } else {
+            s->ack.counters.txFailed++;
+            protocol_window_release(s, slot);
+        }
+    }
+}
+
+
 int mpTxQueued(MACHINE_PROTOCOL_TX_BUFFER *buf){
     if (buf->head != buf->tail){
         int count = buf->head - buf->tail;
@@ -632,31 +990,32 @@ int mpTxQueued(MACHINE_PROTOCOL_TX_BUFFER *buf){
     return 0;
 }
 
-unsigned char mpGetTxByte(MACHINE_PROTOCOL_TX_BUFFER *buf){
-    short t = -1;
-    if (buf->head != buf->tail){
-        t = buf->buff[buf->tail];
-        buf->tail = ((buf->tail + 1 ) % MACHINE_PROTOCOL_TX_BUFFER_SIZE);
-    }
-    return t;
+// copies len bytes out of the ring, in one or two pieces
+static void mpGetTx(MACHINE_PROTOCOL_TX_BUFFER *buf, unsigned char *dest, int len){
+    unsigned char *buff = (unsigned char *) buf->buff;
+    int tail = buf->tail;
+    int n = MACHINE_PROTOCOL_TX_BUFFER_SIZE - tail;
+    if (n > len) n = len;
+    memcpy(dest, buff + tail, n);
+    memcpy(dest + n, buff, len - n);
+    buf->tail = (tail + len) % MACHINE_PROTOCOL_TX_BUFFER_SIZE;
 }
 
 char mpGetTxMsg(MACHINE_PROTOCOL_TX_BUFFER *buf, unsigned char *dest){
     if (mpTxQueued(buf)) {
-        *(dest++) = mpGetTxByte(buf); // cmd
-        *(dest++) = mpGetTxByte(buf); // CI, technically not needed..
-        unsigned char len = *(dest++) = mpGetTxByte(buf); // length of payload
-        *(dest++) = mpGetTxByte(buf); // code
-
-        for (int i = 0; i < len; i++) {
-            *(dest++) = mpGetTxByte(buf); // data
-        }
+        mpGetTx(buf, dest, 4);                 // cmd, CI (technically not needed..), length of payload, code
+        mpGetTx(buf, dest + 4, dest[2]);       // data
         return 1; // we got a message
     }
     return 0;
 }
 
-void mpPutTx(MACHINE_PROTOCOL_TX_BUFFER *buf, unsigned char value){
-    buf->buff[buf->head] = value;
-    buf->head = ((buf->head + 1 ) % MACHINE_PROTOCOL_TX_BUFFER_SIZE);
-}
\ No newline at end of file
+void mpPutTxMsg(MACHINE_PROTOCOL_TX_BUFFER *buf, const unsigned char *src, int len){
+    unsigned char *buff = (unsigned char *) buf->buff;
+    int head = buf->head;
+    int n = MACHINE_PROTOCOL_TX_BUFFER_SIZE - head;
+    if (n > len) n = len;
+    memcpy(buff + head, src, n);
+    memcpy(buff, src + n, len - n);
+    buf->head = (head + len) % MACHINE_PROTOCOL_TX_BUFFER_SIZE;
+}
@@ -46,7 +46,7 @@ unsigned char contentbuf[sizeof( ((PROTOCOL_MSG3full *)0)->content )];
 void protocol_process_ReadValue(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg) {
     if(msg) {
         unsigned char *src = s->params[msg->code]->ptr;
-        for (int j = 0; j < s->params[msg->code]->len; j++){
+        for (int j = 0; j < s->params[msg->code]->len && j < (int) sizeof(msg->content); j++){
             msg->content[j] = *(src++);
         }
     }
@@ -54,6 +54,28 @@ void protocol_process_ReadValue(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg) {
 
 void protocol_process_ReadAndSendValue(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg) {
     if(msg) {
+        if(s->params[msg->code]->len > (int) PROTOCOL_PAYLOAD_MAX) {
+            // larger than one frame, sent in fragments
+            // in a batch it does not fit a record : empty record, to be read on its own
+            if(s->batch || protocol_send_fragments(s, msg->SOM, PROTOCOL_CMD_READVALRESPONSE, msg->code, s->params[msg->code]->ptr, s->params[msg->code]->len) < 0) {
+                msg->lenPayload = 0; // busy with an other one or batched, nothing read
+                msg->cmd = PROTOCOL_CMD_READVALRESPONSE;
+                protocol_post(s, msg);
+            }
+            return;
+        }
+
+        // read the value straight into the frame it is sent from, unless it has to be queued
+        PROTOCOL_MSG3full *frame = protocol_reserve(s, msg->SOM);
+        if(frame) {
+            frame->cmd = PROTOCOL_CMD_READVALRESPONSE; // mark as response
+            frame->code = msg->code;
+            frame->lenPayload = s->params[msg->code]->len;
+            memcpy(frame->content, s->params[msg->code]->ptr, s->params[msg->code]->len);
+            protocol_commit(s, frame);
+            return;
+        }
+
         protocol_process_ReadValue(s, msg);
 
         PROTOCOL_MSG3full newMsg;
@@ -175,6 +197,34 @@ void fn_ping ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_M
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+// Variable & Functions for 0x28 ACK window
+// A peer able to keep several ACK-required messages in flight writes the window it wants,
+// then reads back the window accepted (at most PROTOCOL_ACK_WINDOW_MAX). Peers which never
+// write it, and firmwares without it, keep one message in flight.
+
+static uint8_t ack_window = 1;
+
+void fn_ackWindow ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+
+    switch (cmd) {
+        case PROTOCOL_CMD_READVAL:
+        case PROTOCOL_CMD_SILENTREAD:
+            ack_window = s->window.size;
+            break;
+    }
+
+    fn_defaultProcessingPreWriteClear(s, param, cmd, msg); // Wipes memory before write (and readresponse is just a differenct type of writing)
+
+    switch (cmd) {
+        case PROTOCOL_CMD_WRITEVAL:
+        case PROTOCOL_CMD_READVALRESPONSE:
+            // the response is posted already, following messages use the new window
+            ack_window = protocol_set_ack_window(s, ack_window);
+            break;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 // Variable & Functions for 0x22 SubscribeData
 
@@ -251,6 +301,10 @@ void fn_ProtocolcountDataSum ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char
             ProtocolcountData.unknowncommands     = s->ack.counters.unknowncommands     + s->noack.counters.unknowncommands;
             ProtocolcountData.unplausibleresponse = s->ack.counters.unplausibleresponse + s->noack.counters.unplausibleresponse;
             ProtocolcountData.unwantednacks       = s->ack.counters.unwantednacks       + s->noack.counters.unwantednacks;
+            ProtocolcountData.windowFull          = s->ack.counters.windowFull          + s->noack.counters.windowFull;
+            ProtocolcountData.windowPeak          = s->ack.counters.windowPeak          + s->noack.counters.windowPeak;
+            ProtocolcountData.rxOutOfOrder        = s->ack.counters.rxOutOfOrder        + s->noack.counters.rxOutOfOrder;
+            ProtocolcountData.rxDuplicate         = s->ack.counters.rxDuplicate         + s->noack.counters.rxDuplicate;
             break;
     }
 
@@ -420,8 +474,16 @@ const static PARAMSTAT initialparams[] = {
     { 0x25, "protocol stats noack",    NULL,  UI_NONE,  &ProtocolcountData, sizeof(PROTOCOLCOUNT),          fn_ProtocolcountDataNoack },
     { 0x26, "text",                    NULL,  UI_NONE,  &contentbuf,        sizeof(contentbuf),             fn_defaultProcessing },
     { 0x27, "ping",                    NULL,  UI_NONE,  &contentbuf,        sizeof(contentbuf),             fn_ping },
+    { 0x28, "ack window",              NULL,  UI_CHAR,  &ack_window,        sizeof(uint8_t),                fn_ackWindow },
 
     // Mini Pupper commands added, we leave the Rest untouched
+    { 0x40, "servo stream position",   NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingPreWriteClear },
+    { 0x42, "telemetry",               NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingReadOnly },
+    { 0x43, "state",                   NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingReadOnly },
+    { 0x44, "bus stats",               NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessing },
+    { 0x45, "servo trajectory",        NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessing },
+    { 0x46, "trajectory status",       NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingReadOnly },
+    { 0x47, "imu batch",               NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingReadOnly },
     { 0x60, "imu read 6dof",           NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingReadOnly },
     { 0x61, "imu read attitude",       NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingReadOnly },
     { 0x70, "servo enable",            NULL,  UI_NONE,  &contentbuf, sizeof(PROTOCOL_SENSOR_FRAME),        fn_defaultProcessingPreWriteClear },
@@ -484,8 +546,8 @@ int setParam(PROTOCOL_STAT *s, PARAMSTAT *param) {
 
     if(param == NULL) return 1;   // Failure, got NULL pointer
 
-    // Check if len can actually be received
-    if( param->len > sizeof( ((PROTOCOL_MSG3full *)0)->content ) ) {
+    // Check if len can actually be received (in fragments if larger than one frame)
+    if( param->len > 0xFFFF ) {
         return 1;                 // Too long, Failure
     }
 
@@ -522,8 +584,8 @@ int setParamsCopy(PROTOCOL_STAT *s, const PARAMSTAT params[], int len) {
 // Change variable at runtime
 int setParamVariable(PROTOCOL_STAT *s, unsigned char code, char ui_type, void *ptr, int len) {
 
-    // Check if len can actually be received
-    if( len > sizeof( ((PROTOCOL_MSG3full *)0)->content ) ) {
+    // Check if len can actually be received (in fragments if larger than one frame)
+    if( len > 0xFFFF ) {
         return 1;                           // Too long, Failure
     }
 
@@ -580,6 +642,8 @@ int protocol_init(PROTOCOL_STAT *s) {
     s->ack.lastRXCI = 1;
     s->noack.lastTXCI = 1;
     s->noack.lastRXCI = 1;
+    s->window.size = 1;
+    ack_window = 1;
 
     // Initialize params array
     int error = 0;
@@ -611,6 +675,158 @@ int protocol_init(PROTOCOL_STAT *s) {
     return error;
 }
 
+/////////////////////////////////////////////
+// batch ('M'): records of cmd, code, len and len bytes of content.
+// Each record is processed as a message of its own, their responses
+// are gathered as records in one 'm' message, code is the record count.
+// Responses which do not fit are dropped, the count tells what came back.
+#define PROTOCOL_BATCH_RECORD 3   // cmd, code, len
+
+// called by protocol_post while a batch is processed
+int protocol_batch_add(PROTOCOL_MSG3full *batch, PROTOCOL_MSG3full *msg) {
+    unsigned char *record = &batch->content[batch->lenPayload];
+
+    if ((size_t)(batch->lenPayload + PROTOCOL_BATCH_RECORD + msg->lenPayload) > PROTOCOL_PAYLOAD_MAX) {
+        return -1;
+    }
+    record[0] = msg->cmd;
+    record[1] = msg->code;
+    record[2] = msg->lenPayload;
+    memcpy(&record[PROTOCOL_BATCH_RECORD], msg->content, msg->lenPayload);
+    batch->lenPayload += PROTOCOL_BATCH_RECORD + msg->lenPayload;
+    batch->code++;
+    return 0;
+}
+
+static void protocol_process_batch(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg) {
+    PROTOCOL_MSG3full response;
+    PROTOCOL_MSG3full record;
+    int i = 0;
+
+    response.SOM = msg->SOM;
+    response.cmd = PROTOCOL_CMD_BATCHRESPONSE;
+    response.code = 0;
+    response.lenPayload = 0;
+
+    s->batch = &response;
+    while (i + PROTOCOL_BATCH_RECORD <= msg->lenPayload) {
+        int len = msg->content[i + 2];
+        if (i + PROTOCOL_BATCH_RECORD + len > msg->lenPayload) {
+            break; // truncated record
+        }
+        record.SOM = msg->SOM;
+        record.cmd = msg->content[i];
+        record.CI = msg->CI;
+        record.lenPayload = len;
+        record.code = msg->content[i + 1];
+        memcpy(record.content, &msg->content[i + PROTOCOL_BATCH_RECORD], len); // handlers re-use the record as response
+        i += PROTOCOL_BATCH_RECORD + len;
+
+        if (record.cmd == PROTOCOL_CMD_BATCH || record.cmd == PROTOCOL_CMD_REBOOT) {
+            continue; // no nesting, no reboot halfway through
+        }
+        protocol_process_message(s, &record);
+    }
+    s->batch = NULL;
+
+    protocol_post(s, &response);
+}
+
+/////////////////////////////////////////////
+// fragments ('F'): parts are put in place in fragment_rx.buff,
+// the whole message is processed once every part is there.
+// Writes are taken by params with default processing only, other
+// handlers expect the whole content in the message.
+static void protocol_process_fragments(PROTOCOL_STAT *s, unsigned char som, unsigned char cmd, unsigned char code, unsigned char *data, int len) {
+    PARAMSTAT *param = s->params[code];
+    PARAMSTAT_FN fn = param ? param->fn : NULL;
+
+    switch (cmd) {
+        case PROTOCOL_CMD_WRITEVAL:
+        case PROTOCOL_CMD_READVALRESPONSE: {
+            unsigned char written = 0;
+            if (param && param->ptr && (fn == fn_defaultProcessing || fn == fn_defaultProcessingPreWriteClear)) {
+                if (fn == fn_defaultProcessingPreWriteClear) {
+                    memset(param->ptr, 0, param->len);
+                }
+                memcpy(param->ptr, data, (len < param->len) ? len : param->len);
+                written = 1;
+            }
+            if (cmd == PROTOCOL_CMD_WRITEVAL) {
+                PROTOCOL_MSG3full response;
+                response.SOM = som;
+                response.cmd = PROTOCOL_CMD_WRITEVALRESPONSE;
+                response.code = code;
+                response.lenPayload = 1;
+                response.content[0] = written; // say if we wrote it
+                protocol_post(s, &response);
+            }
+            break;
+        }
+
+        default:
+            if(som == PROTOCOL_SOM_ACK) {
+                s->ack.counters.unknowncommands++;
+            } else {
+                s->noack.counters.unknowncommands++;
+            }
+            break;
+    }
+}
+
+static void protocol_process_fragment(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg) {
+    PROTOCOL_FRAGMENT_RX *rx = &s->fragment_rx;
+    PROTOCOL_FRAGMENT_HEADER header;
+
+    if (msg->lenPayload < sizeof(header)) {
+        return;
+    }
+    memcpy(&header, msg->content, sizeof(header)); // not aligned
+    int len = msg->lenPayload - sizeof(header);
+
+    if (header.seq != rx->seq || msg->SOM != rx->som || header.cmd != rx->cmd || msg->code != rx->code || header.total != rx->total) {
+        // first part of a new message
+        if (rx->active) {
+            rx->dropped++; // previous one never completed
+        }
+        rx->seq = header.seq;
+        rx->som = msg->SOM;
+        rx->cmd = header.cmd;
+        rx->code = msg->code;
+        rx->total = header.total;
+        rx->parts = 0;
+        rx->active = 1;
+        if (!header.total || header.total > sizeof(rx->buff) || header.total > 32 * PROTOCOL_FRAGMENT_DATA) {
+            rx->dropped++;
+            rx->active = 0;
+        }
+    }
+
+    if (!rx->active) {
+        return; // part of a message dropped or complete already
+    }
+    // each part fills PROTOCOL_FRAGMENT_DATA bytes, the last one the rest
+    unsigned part = header.offset / PROTOCOL_FRAGMENT_DATA;
+    unsigned parts = (rx->total + PROTOCOL_FRAGMENT_DATA - 1) / PROTOCOL_FRAGMENT_DATA;
+    int expected = (part + 1 < parts) ? (int)PROTOCOL_FRAGMENT_DATA : rx->total - header.offset;
+    if (header.offset % PROTOCOL_FRAGMENT_DATA || part >= parts || len != expected) {
+        rx->dropped++;
+        rx->active = 0;
+        return;
+    }
+    if (rx->parts & (1UL << part)) {
+        return; // repeated part
+    }
+    memcpy(&rx->buff[header.offset], &msg->content[sizeof(header)], len);
+    rx->parts |= 1UL << part;
+
+    if (rx->parts == (parts < 32 ? (1UL << parts) - 1 : 0xFFFFFFFFUL)) {
+        rx->active = 0;
+        rx->complete++;
+        protocol_process_fragments(s, rx->som, rx->cmd, rx->code, rx->buff, rx->total);
+    }
+}
+
 /////////////////////////////////////////////
 // a complete machineprotocol message has been
 // received without error
@@ -689,6 +905,23 @@ void protocol_process_message(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg) {
             break;
         }
 
+        case PROTOCOL_CMD_BATCH:
+            protocol_process_batch(s, msg);
+            break;
+
+        case PROTOCOL_CMD_BATCHRESPONSE:
+            // responses are not requested by this side
+            if(msg->SOM == PROTOCOL_SOM_ACK) {
+                s->ack.counters.unplausibleresponse++;
+            } else {
+                s->noack.counters.unplausibleresponse++;
+            }
+            break;
+
+        case PROTOCOL_CMD_FRAGMENT:
+            protocol_process_fragment(s, msg);
+            break;
+
         case PROTOCOL_CMD_REBOOT:
             //protocol_send_ack(); // we no longer ack from here
             protocol_Delay(500);
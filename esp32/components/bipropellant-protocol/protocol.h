@@ -246,6 +246,10 @@ typedef struct tag_PROTOCOL_MSG3full {
 #pragma pack(pop)
 
 
+// largest lenPayload of a message with a code: code, content and CS are COBS/R encoded in 255 bytes
+#define PROTOCOL_PAYLOAD_MAX (sizeof( ((PROTOCOL_MSG3full *)0)->content ) - 1)
+
+
 //////////////////////////////////////////////////////////////////
 // protocol_post uses this structure to store outgoing messages
 // until they can be sent.
@@ -277,10 +281,88 @@ typedef struct tag_PROTOCOLCOUNT {
     uint32_t  unwantednacks;             // count of unwanted NACK messges
     uint32_t  unknowncommands;           // count of messages with unknown commands
     uint32_t  unplausibleresponse;       // count of unplausible replies
+
+    // ACK window (code 0x28), only counted when more than one message may be in flight
+    uint32_t  windowFull;                // count of messages queued because the window was full
+    uint32_t  windowPeak;                // most messages in flight at once
+    uint32_t  rxOutOfOrder;              // count of messages received after a later CI (were counted missing)
+    uint32_t  rxDuplicate;               // count of messages received twice (ACKed again, discarded)
 } PROTOCOLCOUNT;
 #pragma pack(pop)
 
 
+//////////////////////////////////////////////////////////////////
+// ACK window: up to PROTOCOL_ACK_WINDOW_MAX messages requiring an ACK
+// may be in flight at once. Each one is kept in a slot until
+// its own CI is ACKed, a NACK for its CI resends that message only.
+// The window is 1 (one message in flight) until the peer writes a
+// larger one to code 0x28, peers which do not know 0x28 are unaffected.
+#define PROTOCOL_ACK_WINDOW_MAX 8
+
+typedef struct tag_PROTOCOL_ACK_SLOT {
+    PROTOCOL_MSG3full msg;                   // message in flight, CI 0 if the slot is free
+    char retries;                            // number of retries left to send message
+    uint32_t last_send_time;                 // last time the message was sent
+} PROTOCOL_ACK_SLOT;
+
+typedef struct tag_PROTOCOL_ACK_WINDOW {
+    unsigned char size;                      // messages allowed in flight, 1: one at a time as send_state
+    unsigned char inflight;                  // slots in use
+    uint32_t rx;                             // bit i set: CI lastRXCI-i was received
+    PROTOCOL_ACK_SLOT slots[PROTOCOL_ACK_WINDOW_MAX];
+} PROTOCOL_ACK_WINDOW;
+
+//////////////////////////////////////////////////////////////////
+// Fragments ('F'): a message larger than PROTOCOL_PAYLOAD_MAX is sent as
+// parts of up to PROTOCOL_FRAGMENT_DATA bytes, each with a header giving
+// the cmd of the whole message, its number and the place of the part.
+// The code of the parts is the code of the message. Parts are sent from
+// protocol_tick as frames become free (with ACK: as the ACK window opens),
+// the receiver puts them back in place and processes the whole message
+// once every part is there. Parts start every PROTOCOL_FRAGMENT_DATA bytes
+// and may arrive in any order, a part received twice is ignored, a part at
+// another place drops the message. A message missing a part is dropped when
+// the next one starts. Inside a batch ('M') a read of such a message is
+// answered with an empty record: it does not fit one, it is read on its own.
+#ifndef PROTOCOL_FRAGMENT_MAX
+#define PROTOCOL_FRAGMENT_MAX 2048                 // largest message received in fragments
+#endif
+#define PROTOCOL_FRAGMENT_BURST 2                  // parts without ACK sent per tick, 2x 254 bytes keep 3Mbaud busy for 1ms
+
+#pragma pack(push, 1)
+typedef struct tag_PROTOCOL_FRAGMENT_HEADER {
+    unsigned char cmd;                       // cmd of the whole message
+    unsigned char seq;                       // number of the whole message, the same in all its parts
+    uint16_t offset;                         // place of this part in the whole message
+    uint16_t total;                          // length of the whole message
+} PROTOCOL_FRAGMENT_HEADER;
+#pragma pack(pop)
+
+#define PROTOCOL_FRAGMENT_DATA (PROTOCOL_PAYLOAD_MAX - sizeof(PROTOCOL_FRAGMENT_HEADER))
+
+typedef struct tag_PROTOCOL_FRAGMENT_TX {
+    const unsigned char *data;               // whole message, NULL if none is being sent
+    uint16_t len;                            // length of the whole message
+    uint16_t offset;                         // next part to send
+    unsigned char seq;                       // number of the message
+    unsigned char som;
+    unsigned char cmd;
+    unsigned char code;
+} PROTOCOL_FRAGMENT_TX;
+
+typedef struct tag_PROTOCOL_FRAGMENT_RX {
+    unsigned char seq;                       // number of the message being received
+    unsigned char som;
+    unsigned char cmd;
+    unsigned char code;
+    uint16_t total;                          // length of the message
+    uint32_t parts;                          // bit i set: part at offset i*PROTOCOL_FRAGMENT_DATA received
+    unsigned char active;                    // 1 while parts of the message are expected
+    uint32_t complete;                       // count of messages received in fragments
+    uint32_t dropped;                        // count of messages dropped (part missing, too large, inconsistent)
+    unsigned char buff[PROTOCOL_FRAGMENT_MAX];
+} PROTOCOL_FRAGMENT_RX;
+
 typedef struct tag_PROTOCOLSTATE {
     PROTOCOL_MSG3full curr_send_msg;         // transmit message storage
     char retries;                            // number of retries left to send message
@@ -325,6 +407,10 @@ typedef struct tag_PROTOCOL_STAT {
 
     PROTOCOLSTATE ack;
     PROTOCOLSTATE noack;
+    PROTOCOL_ACK_WINDOW window;           // ACK-required messages in flight when window.size > 1
+    PROTOCOL_MSG3full *batch;             // combined response while a batch ('M') is processed, NULL otherwise
+    PROTOCOL_FRAGMENT_TX fragment_tx;     // message being sent in fragments
+    PROTOCOL_FRAGMENT_RX fragment_rx;     // message being received in fragments
     PARAMSTAT *params[256];
     ASCIISTATE ascii;
     int initialised_functions;
@@ -375,6 +461,9 @@ struct tag_PARAMSTAT {
 #define PROTOCOL_CMD_WRITEVAL         'W'  // Writing a value and requesting confirmaion
 #define PROTOCOL_CMD_WRITEVALRESPONSE 'w'  // Confirmation for written value
 #define PROTOCOL_CMD_SILENTREAD       's'  // Reads a value and triggers callback functions but does not actually send back anything
+#define PROTOCOL_CMD_BATCH            'M'  // Records of cmd, code, len and content processed in order, code is the record count
+#define PROTOCOL_CMD_BATCHRESPONSE    'm'  // Responses of a batch, as records the same way
+#define PROTOCOL_CMD_FRAGMENT         'F'  // Part of a message larger than one frame, see PROTOCOL_FRAGMENT_HEADER
 
 
 ///////////////////////////////////////////////////
@@ -426,9 +515,18 @@ void fn_ping ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_M
 /////////////////////////////////////////////////////////////////
 // call this with received bytes; normally from main loop
 void protocol_byte( PROTOCOL_STAT *s, unsigned char byte );
+// or with a chunk of received bytes
+void protocol_bytes( PROTOCOL_STAT *s, const unsigned char *data, int len );
 /////////////////////////////////////////////////////////////////
 // call this schedule a message. CI and Checksum are added
 int protocol_post(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg);
+// or this to build it in the frame it is sent from (NULL if it has to be queued or batched, use protocol_post)
+// fill in cmd, code, lenPayload and content, then commit it. CI and Checksum are added
+PROTOCOL_MSG3full *protocol_reserve(PROTOCOL_STAT *s, unsigned char som);
+int protocol_commit(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg);
+// or this to send len bytes (up to 65535) as one message in fragments. data is read as the parts
+// are sent and has to stay valid until then. Returns -1 if a message is being sent in fragments already
+int protocol_send_fragments(PROTOCOL_STAT *s, unsigned char som, unsigned char cmd, unsigned char code, const void *data, int len);
 /////////////////////////////////////////////////////////////////
 // call this regularly from main.c
 void protocol_tick(PROTOCOL_STAT *s);
@@ -439,6 +537,9 @@ int protocol_init(PROTOCOL_STAT *s);
 // Send Text over protocol
 int protocol_send_text(PROTOCOL_STAT *s, char *message, unsigned char som);
 /////////////////////////////////////////////////////////////////
+// Set the ACK window (1 to PROTOCOL_ACK_WINDOW_MAX), returns the window set
+int protocol_set_ack_window(PROTOCOL_STAT *s, int size);
+/////////////////////////////////////////////////////////////////
 
 ///////////////////////////////////////////////////////
 // Function Pointers to system functions
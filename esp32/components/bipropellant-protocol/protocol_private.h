@@ -49,6 +49,10 @@ void ascii_byte(PROTOCOL_STAT *s, unsigned char byte );
 // processes machine protocol messages
 void protocol_process_message(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg);
 
+/////////////////////////////////////////////////////////////////
+// adds a response to the batch being processed
+int protocol_batch_add(PROTOCOL_MSG3full *batch, PROTOCOL_MSG3full *msg);
+
 /////////////////////////////////////////////////////////////////
 // get buffer level
 int mpTxQueued(MACHINE_PROTOCOL_TX_BUFFER *buf);
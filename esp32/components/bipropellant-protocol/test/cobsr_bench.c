@@ -0,0 +1,170 @@
+/*
+ * cobsr_bench.c
+ *
+ * COBS/R encoder and decoder, host test and benchmark
+ * cobsr_encode() and cobsr_decode() are compared with the byte-wise
+ * reference implementation on every string of up to 3 bytes, then on random
+ * strings of up to 520 bytes with zero densities from none to all, at and
+ * around the destination buffer limits, in place and on corrupted input.
+ * Results, status and every byte of the destination buffer must match.
+ * Then the time per call of each is printed for telemetry frame sizes
+ * (configure the host build with -DCMAKE_BUILD_TYPE=Release for meaningful
+ * numbers).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cobsr.h"
+
+#define CHECK_RANDOM_STRINGS    200000
+#define CHECK_MAX_LEN           520
+#define BENCH_ITERATIONS        200000
+
+static unsigned long checks, failed;
+
+static void fail(const char *what, size_t len, size_t dst_len) {
+    if (failed++ < 5) printf("FAIL %s : source length %u, destination length %u\n",
+        what, (unsigned)len, (unsigned)dst_len);
+}
+
+static void check_encode(const uint8_t *src, size_t len, size_t dst_len) {
+    uint8_t ref[1024], out[1024];
+    memset(ref, 0xAA, sizeof(ref));
+    memset(out, 0xAA, sizeof(out));
+    cobsr_encode_result ref_result = cobsr_encode_bytewise(ref, dst_len, src, len);
+    cobsr_encode_result out_result = cobsr_encode(out, dst_len, src, len);
+    checks++;
+    if (ref_result.out_len != out_result.out_len || ref_result.status != out_result.status
+     || memcmp(ref, out, sizeof(ref))) {
+        fail("encode", len, dst_len);
+    }
+    // in place, and from one byte after the destination as protocol_frame_encode() does
+    if (len && len <= 254) {
+        memcpy(ref, src, len);
+        memcpy(out, src, len);
+        ref[len] = out[len] = 0x55;
+        ref_result = cobsr_encode_bytewise(ref, len+1, ref, len);
+        out_result = cobsr_encode(out, len+1, out, len);
+        checks++;
+        if (ref_result.out_len != out_result.out_len || ref_result.status != out_result.status
+         || memcmp(ref, out, ref_result.out_len)) {
+            fail("encode in place", len, len+1);
+        }
+        memcpy(out+1, src, len);
+        out_result = cobsr_encode(out, len+1, out+1, len);
+        checks++;
+        if (ref_result.out_len != out_result.out_len || ref_result.status != out_result.status
+         || memcmp(ref, out, ref_result.out_len)) {
+            fail("encode one byte before the source", len, len+1);
+        }
+    }
+}
+
+static void check_decode(const uint8_t *src, size_t len, size_t dst_len) {
+    uint8_t ref[1024], out[1024];
+    memset(ref, 0xAA, sizeof(ref));
+    memset(out, 0xAA, sizeof(out));
+    cobsr_decode_result ref_result = cobsr_decode_bytewise(ref, dst_len, src, len);
+    cobsr_decode_result out_result = cobsr_decode(out, dst_len, src, len);
+    checks++;
+    if (ref_result.out_len != out_result.out_len || ref_result.status != out_result.status
+     || memcmp(ref, out, sizeof(ref))) {
+        fail("decode", len, dst_len);
+    }
+    // in place, as protocol_cobsr_decode() does
+    memcpy(ref, src, len);
+    memcpy(out, src, len);
+    ref_result = cobsr_decode_bytewise(ref, len, ref, len);
+    out_result = cobsr_decode(out, len, out, len);
+    checks++;
+    if (ref_result.out_len != out_result.out_len || ref_result.status != out_result.status
+     || memcmp(ref, out, len)) {
+        fail("decode in place", len, len);
+    }
+}
+
+static uint32_t seed = 1;
+static uint32_t rnd() {
+    seed = seed*1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+int main() {
+    uint8_t s[CHECK_MAX_LEN];
+
+    // every string of up to 3 bytes
+    for (size_t len = 0; len <= 3; len++) {
+        unsigned long n = 1UL << (8*len);
+        for (unsigned long v = 0; v < n; v++) {
+            for (size_t i = 0; i < len; i++) s[i] = v >> (8*i);
+            check_encode(s, len, COBSR_ENCODE_DST_BUF_LEN_MAX(len));
+            check_decode(s, len, len);
+            check_decode(s, len, len ? len-1 : 0);
+        }
+    }
+
+    // random strings, zero density from none to all
+    for (int it = 0; it < CHECK_RANDOM_STRINGS; it++) {
+        size_t len = rnd()%(CHECK_MAX_LEN+1);
+        unsigned density = rnd()%5;
+        for (size_t i = 0; i < len; i++) {
+            uint8_t b = rnd();
+            s[i] = (density && rnd()%(1u << (2*density)) == 0) ? 0 : (b ? b : 1);
+            if (density == 4 && rnd()%2) s[i] = 0;
+        }
+        size_t max = COBSR_ENCODE_DST_BUF_LEN_MAX(len);
+        check_encode(s, len, max);
+        check_encode(s, len, max+3);
+        if (max) check_encode(s, len, max-1);
+        check_encode(s, len, rnd()%(max+1));
+
+        uint8_t e[COBSR_ENCODE_DST_BUF_LEN_MAX(CHECK_MAX_LEN)];
+        cobsr_encode_result r = cobsr_encode_bytewise(e, sizeof(e), s, len);
+        check_decode(e, r.out_len, r.out_len);
+        check_decode(e, r.out_len, r.out_len+5);
+        check_decode(e, r.out_len, rnd()%(r.out_len+1));
+        if (r.out_len) {
+            e[rnd()%r.out_len] = rnd();     // corrupted
+            check_decode(e, r.out_len, r.out_len);
+        }
+        check_decode(s, len, len);          // not encoded at all
+    }
+    printf("%lu checks, %lu mismatches\n", checks, failed);
+
+    // binary telemetry payloads, few zeros
+    static const size_t sizes[] = {8, 24, 64, 128, 200, 253};
+    printf("%6s %12s %12s %12s %12s\n", "bytes", "enc ref ns", "enc ns", "dec ref ns", "dec ns");
+    for (unsigned k = 0; k < sizeof(sizes)/sizeof(*sizes); k++) {
+        size_t len = sizes[k];
+        uint8_t src[256], enc[COBSR_ENCODE_DST_BUF_LEN_MAX(256)], dst[sizeof(enc)];
+        for (size_t i = 0; i < len; i++) {
+            src[i] = rnd();
+            if (rnd()%16 == 0) src[i] = 0;
+        }
+        size_t enc_len = cobsr_encode(enc, sizeof(enc), src, len).out_len;
+        volatile size_t sink = 0;
+        double t[5];
+        t[0] = now();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) { src[0] = i; sink += cobsr_encode_bytewise(dst, sizeof(dst), src, len).out_len; }
+        t[1] = now();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) { src[0] = i; sink += cobsr_encode(dst, sizeof(dst), src, len).out_len; }
+        t[2] = now();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) { enc[1] ^= 1; sink += cobsr_decode_bytewise(dst, sizeof(dst), enc, enc_len).out_len; }
+        t[3] = now();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) { enc[1] ^= 1; sink += cobsr_decode(dst, sizeof(dst), enc, enc_len).out_len; }
+        t[4] = now();
+        (void)sink;
+        printf("%6u %12.1f %12.1f %12.1f %12.1f\n", (unsigned)len,
+            (t[1]-t[0])*1e9/BENCH_ITERATIONS, (t[2]-t[1])*1e9/BENCH_ITERATIONS,
+            (t[3]-t[2])*1e9/BENCH_ITERATIONS, (t[4]-t[3])*1e9/BENCH_ITERATIONS);
+    }
+    printf("%s\n", failed ? "FAILED" : "cobsr_encode and cobsr_decode match the byte-wise reference");
+    return failed ? 1 : 0;
+}
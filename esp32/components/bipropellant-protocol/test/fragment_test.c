@@ -0,0 +1,201 @@
+/*
+ * fragment_test.c
+ *
+ * Messages larger than one frame ('F' fragments), host test
+ * Parts of a WRITEVAL are sent to an endpoint in order, out of order, some
+ * of them twice, or with one missing, then the param and the response are
+ * checked. A READVAL of a param larger than one frame is sent in parts by
+ * one endpoint and put back together by the other; inside a batch ('M') it
+ * is answered with an empty record instead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "protocol.h"
+
+#define TEST_CODE   0x50
+#define TEST_LEN    1000        // 5 parts of PROTOCOL_FRAGMENT_DATA bytes at most
+#define TEST_PARTS  ((TEST_LEN + PROTOCOL_FRAGMENT_DATA - 1) / PROTOCOL_FRAGMENT_DATA)
+
+static int failed;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        failed++;
+    }
+}
+
+// bytes sent by each endpoint
+typedef struct {
+    unsigned char data[16384];
+    int len;
+} WIRE;
+
+static WIRE host_wire, esp_wire, host_out;
+
+static int host_send(unsigned char *data, int len) {
+    memcpy(host_wire.data + host_wire.len, data, len);
+    host_wire.len += len;
+    return len;
+}
+
+static int esp_send(unsigned char *data, int len) {
+    memcpy(esp_wire.data + esp_wire.len, data, len);
+    esp_wire.len += len;
+    return len;
+}
+
+static uint32_t tick() { return 0; }
+
+static PROTOCOL_STAT host, esp;
+static unsigned char host_value[TEST_LEN], esp_value[TEST_LEN], pattern[TEST_LEN];
+static PARAMSTAT host_param = { TEST_CODE, "test", NULL, UI_NONE, host_value, TEST_LEN, fn_defaultProcessing };
+static PARAMSTAT esp_param = { TEST_CODE, "test", NULL, UI_NONE, esp_value, TEST_LEN, fn_defaultProcessing };
+
+static void setup() {
+    protocol_init(&host);
+    protocol_init(&esp);
+    host.allow_ascii = esp.allow_ascii = 0;
+    host.send_serial_data = host_send;
+    esp.send_serial_data = esp_send;
+    setParam(&host, &host_param);
+    setParam(&esp, &esp_param);
+    memset(host_value, 0, sizeof(host_value));
+    memset(esp_value, 0, sizeof(esp_value));
+    host_wire.len = esp_wire.len = 0;
+}
+
+// what the host sent is received by the ESP and the other way round, until both are quiet
+static void pump() {
+    for (int i = 0; i < 100 && (host_wire.len || esp_wire.len); i++) {
+        memcpy(&host_out, &host_wire, sizeof(host_wire));
+        host_wire.len = 0;
+        protocol_bytes(&esp, host_out.data, host_out.len);
+        memcpy(&host_out, &esp_wire, sizeof(esp_wire));
+        esp_wire.len = 0;
+        protocol_bytes(&host, host_out.data, host_out.len);
+        protocol_tick(&esp);
+        protocol_tick(&host);
+    }
+}
+
+// one part of a WRITEVAL of the whole pattern, in a NOACK frame of its own
+static void send_part(unsigned char seq, int part) {
+    PROTOCOL_MSG3full msg;
+    PROTOCOL_FRAGMENT_HEADER header;
+    int offset = part * PROTOCOL_FRAGMENT_DATA;
+    int len = TEST_LEN - offset < (int) PROTOCOL_FRAGMENT_DATA ? TEST_LEN - offset : (int) PROTOCOL_FRAGMENT_DATA;
+
+    header.cmd = PROTOCOL_CMD_WRITEVAL;
+    header.seq = seq;
+    header.offset = offset;
+    header.total = TEST_LEN;
+    msg.SOM = PROTOCOL_SOM_NOACK;
+    msg.cmd = PROTOCOL_CMD_FRAGMENT;
+    msg.code = TEST_CODE;
+    msg.lenPayload = sizeof(header) + len;
+    memcpy(msg.content, &header, sizeof(header));
+    memcpy(&msg.content[sizeof(header)], &pattern[offset], len);
+    protocol_post(&host, &msg);
+    pump();
+}
+
+// parts sent in the given order, -1 ends the list : returns the WRITEVAL responses the host got
+static int write_parts(unsigned char seq, const int *order) {
+    uint32_t before = host.noack.counters.rx;
+    for (int i = 0; order[i] >= 0; i++) {
+        send_part(seq, order[i]);
+    }
+    return (int)(host.noack.counters.rx - before);
+}
+
+static void test_write(const char *name, unsigned char seq, const int *order, int complete) {
+    char what[128];
+    uint32_t complete_before = esp.fragment_rx.complete;
+
+    memset(esp_value, 0, sizeof(esp_value));
+    int responses = write_parts(seq, order);
+
+    snprintf(what, sizeof(what), "%s : %s", name, complete ? "message not completed" : "incomplete message processed");
+    check((int)(esp.fragment_rx.complete - complete_before) == complete, what);
+    snprintf(what, sizeof(what), "%s : %s", name, complete ? "value not written" : "value written");
+    check((memcmp(esp_value, pattern, TEST_LEN) == 0) == complete, what);
+    snprintf(what, sizeof(what), "%s : %d responses", name, responses);
+    check(responses == complete, what);
+}
+
+int main() {
+    static const int in_order[] = {0, 1, 2, 3, 4, -1};
+    static const int out_of_order[] = {3, 0, 4, 2, 1, -1};
+    static const int duplicates[] = {0, 1, 1, 2, 0, 3, 4, -1};
+    static const int missing[] = {0, 1, 3, 4, -1};
+
+    protocol_GetTick = tick;
+    for (int i = 0; i < TEST_LEN; i++) pattern[i] = i * 7 + 1;
+    check(TEST_PARTS == 5, "test message is not 5 parts");
+
+    setup();
+    test_write("in order", 1, in_order, 1);
+    test_write("out of order", 2, out_of_order, 1);
+    test_write("duplicates", 3, duplicates, 1);
+    uint32_t dropped = esp.fragment_rx.dropped;
+    test_write("missing part", 4, missing, 0);
+    test_write("after a missing part", 5, in_order, 1);
+    check(esp.fragment_rx.dropped == dropped + 1, "missing part : message not counted as dropped");
+
+    // a part at another place drops the message
+    {
+        PROTOCOL_MSG3full msg;
+        PROTOCOL_FRAGMENT_HEADER header = { PROTOCOL_CMD_WRITEVAL, 6, 10, TEST_LEN };
+        msg.SOM = PROTOCOL_SOM_NOACK;
+        msg.cmd = PROTOCOL_CMD_FRAGMENT;
+        msg.code = TEST_CODE;
+        msg.lenPayload = sizeof(header) + 20;
+        memcpy(msg.content, &header, sizeof(header));
+        memset(&msg.content[sizeof(header)], 0, 20);
+        dropped = esp.fragment_rx.dropped;
+        protocol_post(&host, &msg);
+        pump();
+        check(esp.fragment_rx.dropped == dropped + 1, "misplaced part : message not dropped");
+    }
+
+    // READVAL : the ESP sends its value in parts, the host puts them back in place
+    setup();
+    memcpy(esp_value, pattern, TEST_LEN);
+    {
+        PROTOCOL_MSG3full msg;
+        msg.SOM = PROTOCOL_SOM_NOACK;
+        msg.cmd = PROTOCOL_CMD_READVAL;
+        msg.code = TEST_CODE;
+        msg.lenPayload = 0;
+        protocol_post(&host, &msg);
+        pump();
+        check(host.fragment_rx.complete == 1, "read : response not completed");
+        check(!memcmp(host_value, pattern, TEST_LEN), "read : value differs");
+        check(!esp.fragment_tx.data, "read : parts left to send");
+    }
+
+    // READVAL in a batch : an empty record, no fragments
+    setup();
+    memcpy(esp_value, pattern, TEST_LEN);
+    {
+        PROTOCOL_MSG3full msg;
+        uint32_t complete = host.fragment_rx.complete;
+        msg.SOM = PROTOCOL_SOM_NOACK;
+        msg.cmd = PROTOCOL_CMD_BATCH;
+        msg.code = 1;
+        msg.lenPayload = 3;
+        msg.content[0] = PROTOCOL_CMD_READVAL;
+        msg.content[1] = TEST_CODE;
+        msg.content[2] = 0;
+        protocol_post(&host, &msg);
+        pump();
+        check(host.fragment_rx.complete == complete, "batch read : sent in fragments");
+        check(!esp.fragment_tx.data, "batch read : fragments started");
+        check(host.noack.counters.rx == 1, "batch read : no batch response");
+    }
+
+    printf("%s\n", failed ? "FAILED" : "fragments are put back together");
+    return failed ? 1 : 0;
+}
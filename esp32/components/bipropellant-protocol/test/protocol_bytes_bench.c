@@ -0,0 +1,135 @@
+/*
+ * protocol_bytes_bench.c
+ *
+ * Machine protocol receive path, host test and benchmark
+ * Streams of COBS/R frames, clean or with noise and truncated frames in
+ * between, are fed to protocol_byte() one byte at a time and to
+ * protocol_bytes() in chunks; both must send the same replies and end in the
+ * same state. Then the frames/second of each are printed for several payload
+ * sizes (configure the host build with -DCMAKE_BUILD_TYPE=Release for
+ * meaningful numbers).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "protocol.h"
+#include "cobsr.h"
+
+#define BENCH_CHECK_FRAMES  2000
+#define BENCH_FRAMES        20000
+#define BENCH_REPEAT        5
+#define BENCH_MAX_PAYLOAD   240     // code, payload and checksum fit a frame once encoded
+
+static unsigned char stream[BENCH_FRAMES*(BENCH_MAX_PAYLOAD+16)];
+static int stream_len;
+
+// replies are folded into a hash, nothing is sent
+static unsigned long out_hash, out_len;
+static int sink(unsigned char *data, int len) {
+    for (int i = 0; i < len; i++) out_hash = out_hash*31 + data[i];
+    out_len += len;
+    return len;
+}
+
+static uint32_t tick() { return 0; }
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// NOACK WRITEVAL frames to an unknown code : each one is answered
+static void build(int payload, int frames, int noise) {
+    stream_len = 0;
+    srand(1);
+    for (int f = 0; f < frames; f++) {
+        unsigned char raw[BENCH_MAX_PAYLOAD+2], enc[COBSR_ENCODE_DST_BUF_LEN_MAX(BENCH_MAX_PAYLOAD+2)];
+        unsigned char ci = (f+1)%255 + 1;       // protocol_init() takes CI 1 as received
+        unsigned char cmd = PROTOCOL_CMD_WRITEVAL;
+        unsigned char cs = cmd + ci + payload;
+        raw[0] = 0xEE;
+        for (int i = 0; i < payload; i++) raw[1+i] = rand();
+        for (int i = 0; i <= payload; i++) cs += raw[i];
+        raw[payload+1] = -cs;
+        cobsr_encode_result r = cobsr_encode(enc, sizeof(enc), raw, payload+2);
+        stream[stream_len++] = PROTOCOL_SOM;
+        stream[stream_len++] = cmd;
+        stream[stream_len++] = ci;
+        stream[stream_len++] = r.out_len;
+        memcpy(stream+stream_len, enc, r.out_len);
+        stream_len += r.out_len;
+        if (noise && rand()%5 == 0) {
+            int k = rand()%4;
+            for (int i = 0; i < k; i++) stream[stream_len++] = rand();
+        }
+        if (noise && rand()%7 == 0 && stream_len > 3) stream_len -= rand()%3;
+    }
+}
+
+static void run(PROTOCOL_STAT *s, int bulk, int chunk) {
+    memset(s, 0, sizeof(*s));
+    protocol_init(s);
+    s->send_serial_data = sink;
+    s->allow_ascii = 0;
+    out_hash = 0;
+    out_len = 0;
+    for (int i = 0; i < stream_len; i += chunk) {
+        int n = stream_len-i < chunk ? stream_len-i : chunk;
+        if (bulk) {
+            protocol_bytes(s, stream+i, n);
+        } else {
+            for (int j = 0; j < n; j++) protocol_byte(s, stream[i+j]);
+        }
+    }
+}
+
+static PROTOCOL_STAT byte_stat, bulk_stat;
+
+int main() {
+    static const int sizes[] = {0, 8, 24, 64, 128, BENCH_MAX_PAYLOAD};
+    static const int chunks[] = {1, 7, 64, 1024};
+    int failed = 0;
+
+    protocol_GetTick = tick;
+    for (int noise = 0; noise < 2; noise++) {
+        for (unsigned si = 0; si < sizeof(sizes)/sizeof(*sizes); si++) {
+            for (unsigned ci = 0; ci < sizeof(chunks)/sizeof(*chunks); ci++) {
+                build(sizes[si], BENCH_CHECK_FRAMES, noise);
+                run(&byte_stat, 0, chunks[ci]);
+                unsigned long hash = out_hash, len = out_len;
+                run(&bulk_stat, 1, chunks[ci]);
+                if (hash != out_hash || len != out_len
+                 || byte_stat.noack.counters.rx != bulk_stat.noack.counters.rx
+                 || byte_stat.state != bulk_stat.state || byte_stat.count != bulk_stat.count) {
+                    printf("FAIL noise %d payload %d chunk %d : protocol_byte and protocol_bytes differ\n",
+                        noise, sizes[si], chunks[ci]);
+                    failed++;
+                }
+            }
+        }
+    }
+
+    printf("%8s %10s %14s %14s %6s\n", "payload", "bytes/frm", "byte frames/s", "bulk frames/s", "gain");
+    for (unsigned si = 0; si < sizeof(sizes)/sizeof(*sizes); si++) {
+        build(sizes[si], BENCH_FRAMES, 0);
+        double t0 = now();
+        for (int r = 0; r < BENCH_REPEAT; r++) run(&byte_stat, 0, 1024);
+        double t1 = now();
+        for (int r = 0; r < BENCH_REPEAT; r++) run(&bulk_stat, 1, 1024);
+        double t2 = now();
+        double byte_rate = (double)BENCH_REPEAT*BENCH_FRAMES/(t1-t0);
+        double bulk_rate = (double)BENCH_REPEAT*BENCH_FRAMES/(t2-t1);
+        printf("%8d %10.1f %14.0f %14.0f %5.2fx\n", sizes[si], (double)stream_len/BENCH_FRAMES,
+            byte_rate, bulk_rate, bulk_rate/byte_rate);
+        if (bulk_stat.noack.counters.rx != BENCH_FRAMES) {
+            printf("FAIL payload %d : %u of %d frames received\n", sizes[si],
+                (unsigned)bulk_stat.noack.counters.rx, BENCH_FRAMES);
+            failed++;
+        }
+    }
+    printf("%s\n", failed ? "FAILED" : "protocol_byte and protocol_bytes agree");
+    return failed ? 1 : 0;
+}
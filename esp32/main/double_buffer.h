@@ -0,0 +1,53 @@
+#include <atomic>
+#include <stdint.h>
+
+#ifndef _double_buffer_H
+#define _double_buffer_H
+
+// Lock-free double buffer : one writer at a time, any number of readers.
+// The sequence number is odd while the writer fills the slot of the next value,
+// even once that value is published. The published value stays in the other
+// slot until the write after next, so readers never wait for the writer : they
+// copy the published slot and retry only when the writer has started to
+// overwrite it.
+template<typename T>
+class DoubleBuffer
+{
+public:
+    DoubleBuffer() : sequence(0), slots() {}
+
+    void write(T const & value)
+    {
+        uint32_t const published {sequence.load(std::memory_order_relaxed)};
+        sequence.store(published+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slots[((published>>1)+1)&1] = value;
+        sequence.store(published+2, std::memory_order_release);
+    }
+
+    // returns the version of the copied value (0 : never written)
+    uint32_t read(T & value) const
+    {
+        for(;;)
+        {
+            uint32_t const before {sequence.load(std::memory_order_acquire)};
+            value = slots[(before>>1)&1];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint32_t const after {sequence.load(std::memory_order_relaxed)};
+            // the slot is overwritten once the sequence passes the next publication
+            if(after-(before&~1u)<=2)
+                return before>>1;
+        }
+    }
+
+    uint32_t version() const
+    {
+        return sequence.load(std::memory_order_acquire)>>1;
+    }
+
+private:
+    std::atomic<uint32_t> sequence;
+    T slots[2];
+};
+
+#endif
@@ -1,7 +1,7 @@
 #include "imu_cmd.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include "QMI8658C.h"
+#include "mini_pupper_imu.h"
 #include <stdio.h>
 #include <stdio.h>
 #include <string.h>
@@ -11,8 +11,6 @@
 #include "esp_log.h"
 #include "esp_timer.h"
 
-QMI8658C imu;
-
 static const char *TAG = "IMUCMD";
 static uint64_t start_time = 0;
 static uint64_t end_time = 0;
@@ -20,7 +18,9 @@ static uint64_t end_time = 0;
 static int imu_cmd_init(int argc, char **argv)
 {
     uint8_t err;
+    imu.lock();
     err = imu.init();
+    imu.unlock();
     if(err) {
         printf("Init error: %d \r\n", err);
     }
@@ -47,7 +47,9 @@ static void register_imu_cmd_init(void)
 static int imu_cmd_who_am_i(int argc, char **argv)
 {
     uint8_t ret;
+    imu.lock();
     ret = imu.who_am_i();
+    imu.unlock();
     printf("who_am_i: %d \r\n", ret);
     return 0;
 }
@@ -67,7 +69,9 @@ static void register_imu_cmd_who_am_i(void)
 static int imu_cmd_version(int argc, char **argv)
 {
     uint8_t ret;
+    imu.lock();
     ret = imu.version();
+    imu.unlock();
     printf("version: %d \r\n", ret);
     return 0;
 }
@@ -97,12 +101,22 @@ static int imu_cmd_read_6dof(int argc, char **argv)
     int loop = imu_loop_args.loop->ival[0];
 
     for(int i=0; i<loop; i++) {
-        err = imu.read_6dof();
+        // once started, the sampling task reads the IMU
+        IMU_SNAPSHOT snapshot;
+        if(imu.isStarted()) {
+            imu.getSnapshot(snapshot);
+            err = snapshot.valid ? 0 : 1;
+        }
+        else {
+            err = imu.read_6dof();
+            snapshot.acc = imu.acc;
+            snapshot.gyro = imu.gyro;
+        }
         if(err) {
             printf("error: %d \r\n", err);
         }
         else {
-            printf("%f\t%f\t%f\t%f\t%f\t%f \r\n", imu.acc.x, imu.acc.y, imu.acc.z, imu.gyro.x, imu.gyro.y, imu.gyro.z);
+            printf("%f\t%f\t%f\t%f\t%f\t%f \r\n", snapshot.acc.x, snapshot.acc.y, snapshot.acc.z, snapshot.gyro.x, snapshot.gyro.y, snapshot.gyro.z);
         }
 	vTaskDelay(200 / portTICK_PERIOD_MS);
     }
@@ -136,12 +150,24 @@ static int imu_cmd_read_attitude(int argc, char **argv)
     int loop = imu_loop_args.loop->ival[0];
 
     for(int i=0; i<loop; i++) {
-        err = imu.read_attitude();
+        // once started, the sampling task reads the IMU
+        IMU_SNAPSHOT snapshot;
+        if(imu.isStarted()) {
+            imu.getSnapshot(snapshot);
+            err = snapshot.valid ? 0 : 1;
+        }
+        else {
+            err = imu.read_attitude();
+            snapshot.dq = imu.dq;
+            snapshot.dv = imu.dv;
+            snapshot.ae_reg1 = imu.ae_reg1;
+            snapshot.ae_reg2 = imu.ae_reg2;
+        }
         if(err) {
             printf("error: %d \r\n", err);
         }
         else {
-            printf("%f\t%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d \r\n", imu.dq.w, imu.dq.v.x, imu.dq.v.y, imu.dq.v.x, imu.dv.x, imu.dv.y, imu.dv.z, imu.ae_reg1, imu.ae_reg2);
+            printf("%f\t%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d \r\n", snapshot.dq.w, snapshot.dq.v.x, snapshot.dq.v.y, snapshot.dq.v.x, snapshot.dv.x, snapshot.dv.y, snapshot.dv.z, snapshot.ae_reg1, snapshot.ae_reg2);
         }
 	vTaskDelay(200 / portTICK_PERIOD_MS);
     }
@@ -168,7 +194,9 @@ static int imu_cmd_perftest(int argc, char **argv)
 
     start_time = esp_timer_get_time();
     for(int i=0; i<10; i++) {
+        imu.lock();
         err = imu.read_6dof();
+        imu.unlock();
         if(err) {
             ESP_LOGE(TAG, "Error: %d", err);
         }
@@ -178,7 +206,9 @@ static int imu_cmd_perftest(int argc, char **argv)
 
     start_time = esp_timer_get_time();
     for(int i=0; i<10; i++) {
+        imu.lock();
         err = imu.read_attitude();
+        imu.unlock();
         if(err) {
             ESP_LOGE(TAG, "Error: %d", err);
         }
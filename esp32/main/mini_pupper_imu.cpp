@@ -0,0 +1,96 @@
+#include "mini_pupper_imu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "MINIPUPPERIMU";
+
+IMU imu;
+
+IMU::IMU() :
+    sampling_task_handle(NULL),
+    i2c_lock(xSemaphoreCreateMutex()),
+    snapshot_working(),
+    history_lock(xSemaphoreCreateMutex()),
+    history(),
+    history_sequence(0)
+{
+}
+
+void IMU::start(uint32_t period_us)
+{
+    if(isStarted()) return;
+    uint8_t const err {init()};
+    if(err)
+        ESP_LOGE(TAG, "Init error: %d", err);
+    xTaskCreatePinnedToCore(sampling_task, "imu_sampling_task", IMU_SAMPLING_TASK_STACK_SIZE, this, IMU_SAMPLING_TASK_PRIORITY, &sampling_task_handle, IMU_SAMPLING_TASK_CORE);
+    // FreeRTOS tick is too coarse (10ms) for the sampling period, use a high resolution timer
+    esp_timer_create_args_t const timer_args {
+        .callback = &sampling_timer,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "imu_sampling_timer",
+        .skip_unhandled_events = true
+    };
+    esp_timer_handle_t timer;
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer, period_us));
+    ESP_LOGI(TAG, "Sampling task started (period %luus)", (unsigned long)period_us);
+}
+
+void IMU::getSnapshot(IMU_SNAPSHOT & snapshot) const
+{
+    snapshot_buffer.read(snapshot);
+}
+
+int IMU::getHistory(IMU_SAMPLE samples[IMU_HISTORY_LENGTH], uint32_t & sequence) const
+{
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    sequence = history_sequence;
+    int const count {(int)(history_sequence<IMU_HISTORY_LENGTH ? history_sequence : IMU_HISTORY_LENGTH)};
+    for(int index=0; index<count; ++index)
+        samples[index] = history[(history_sequence-count+index)%IMU_HISTORY_LENGTH];
+    xSemaphoreGive(history_lock);
+    return count;
+}
+
+void IMU::sampling_timer(void * arg)
+{
+    IMU * self = static_cast<IMU*>(arg);
+    xTaskNotifyGive(self->sampling_task_handle);
+}
+
+void IMU::sampling_task(void * arg)
+{
+    IMU * self = static_cast<IMU*>(arg);
+    for(;;)
+    {
+        // wait for next period (missed periods are merged)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self->sampling_cycle();
+    }
+}
+
+void IMU::sampling_cycle()
+{
+    snapshot_working.timestamp = (uint32_t)esp_timer_get_time();
+    lock();
+    uint8_t const err {(uint8_t)(read_6dof() | read_attitude())};
+    // copied under the lock : console reads update the same fields
+    snapshot_working.acc = acc;
+    snapshot_working.gyro = gyro;
+    snapshot_working.dq = dq;
+    snapshot_working.dv = dv;
+    snapshot_working.ae_reg1 = ae_reg1;
+    snapshot_working.ae_reg2 = ae_reg2;
+    unlock();
+    snapshot_working.valid = err ? 0 : 1;
+    snapshot_buffer.write(snapshot_working);
+    if(err) return;
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    IMU_SAMPLE & sample {history[history_sequence%IMU_HISTORY_LENGTH]};
+    sample.timestamp = snapshot_working.timestamp;
+    sample.acc = snapshot_working.acc;
+    sample.gyro = snapshot_working.gyro;
+    ++history_sequence;
+    xSemaphoreGive(history_lock);
+}
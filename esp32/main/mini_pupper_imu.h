@@ -0,0 +1,64 @@
+#include "QMI8658C.h"
+#include "double_buffer.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#ifndef _mini_pupper_imu_H
+#define _mini_pupper_imu_H
+
+#define IMU_SAMPLING_PERIOD_US          5000    // 200Hz, sensor ODR is 235Hz
+#define IMU_SAMPLING_TASK_PRIORITY      (configMAX_PRIORITIES-3)
+#define IMU_SAMPLING_TASK_CORE          1
+#define IMU_SAMPLING_TASK_STACK_SIZE    4096
+#define IMU_HISTORY_LENGTH              64      // samples kept for batch reads (320ms)
+
+// last IMU sample, refreshed by the sampling task
+struct IMU_SNAPSHOT {
+    vec3_t acc;
+    vec3_t gyro;
+    quat_t dq;
+    vec3_t dv;
+    uint8_t ae_reg1;
+    uint8_t ae_reg2;
+    uint8_t valid;                              // 1 : last I2C read succeeded
+    uint32_t timestamp;                         // capture time (us)
+};
+
+// one IMU sample of the history
+struct IMU_SAMPLE {
+    uint32_t timestamp;                         // capture time (us)
+    vec3_t acc;
+    vec3_t gyro;
+};
+
+class IMU : public QMI8658C
+{
+public:
+    IMU();
+
+    // sampling task : once started, direct reads from another task go under lock()
+    void start(uint32_t period_us = IMU_SAMPLING_PERIOD_US);
+    bool isStarted() const { return sampling_task_handle!=NULL; }
+    void getSnapshot(IMU_SNAPSHOT & snapshot) const;                // thread-safe
+    int  getHistory(IMU_SAMPLE samples[IMU_HISTORY_LENGTH], uint32_t & sequence) const;    // thread-safe, last samples read, oldest first : returns their count
+    void lock() { xSemaphoreTake(i2c_lock, portMAX_DELAY); }        // exclusive I2C access, the holder inherits the sampling task priority
+    void unlock() { xSemaphoreGive(i2c_lock); }
+
+private:
+    static void sampling_task(void * arg);
+    static void sampling_timer(void * arg);
+    void sampling_cycle();
+
+    TaskHandle_t sampling_task_handle;
+    SemaphoreHandle_t i2c_lock;
+    IMU_SNAPSHOT snapshot_working;
+    DoubleBuffer<IMU_SNAPSHOT> snapshot_buffer;
+    SemaphoreHandle_t history_lock;
+    IMU_SAMPLE history[IMU_HISTORY_LENGTH];     // ring of the samples read, under history_lock
+    uint32_t history_sequence;                  // samples read since start, under history_lock
+};
+
+extern IMU imu;                                 // the IMU manager
+
+#endif
@@ -1,17 +1,52 @@
 #include "mini_pupper_servos.h"
+#include "SCSBaud.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "hal/gpio_hal.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <algorithm>
 
 static const char *TAG = "MINIPUPPERSERVOS";
 
 // number of retries for servo functions
 int retries = 3;
 
-SERVO::SERVO() {
+SERVO servo;
+
+SERVO::SERVO() :
+    bus_stats(),
+    control_task_handle(NULL),
+    uart_queue(NULL),
+    bus(),
+    bus_transport(bus),
+    setpoint_lock(xSemaphoreCreateMutex()),
+    bus_lock(xSemaphoreCreateMutex()),
+    paused(false),
+    feedback_pending(false),
+    feedback_received(0),
+    setpoint_sequence(0),
+    torque_request(-1),
+    return_level(1),
+    return_level_request(false),
+    feedback_missed(),
+    online_mask(0),
+    setpoint_working(),
+    stream_sequence(0),
+    feedback_working(),
+    setpoint_buffer(),
+    feedback_buffer(),
+    setpoint_version(0),
+    command(),
+    trajectory(),
+    goal_refresh(0),
+    slow_pending(false),
+    slow_budget(SERVO_SLOW_BUDGET_US),
+    slow_credit(0),
+    slow_next(0)
+{
     // setup enable pin
     gpio_config_t io_conf;
     io_conf.intr_type = GPIO_INTR_DISABLE;//disable interrupt
@@ -22,7 +57,7 @@ SERVO::SERVO() {
     ESP_ERROR_CHECK(gpio_config(&io_conf));//configure GPIO with the given settings
     // set UART port
     uart_config_t uart_config;
-    uart_config.baud_rate = 500000;
+    uart_config.baud_rate = CONFIG_SERVO_BAUD_RATE;
     uart_config.data_bits = UART_DATA_8_BITS;
     uart_config.parity = UART_PARITY_DISABLE;
     uart_config.stop_bits = UART_STOP_BITS_1;
@@ -33,10 +68,17 @@ SERVO::SERVO() {
 #elif SOC_UART_SUPPORT_XTAL_CLK
     uart_config.source_clk = UART_SCLK_XTAL;
 #endif
-    ESP_ERROR_CHECK(uart_driver_install(UART_NUM_1, 1024, 1024, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_driver_install(UART_NUM_1, 1024, 1024, SERVO_UART_EVENT_QUEUE_LENGTH, &uart_queue, 0));
     ESP_ERROR_CHECK(uart_param_config(UART_NUM_1, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(UART_NUM_1, 4, 5, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
     this->uart_port_num = UART_NUM_1;
+    // response windows are computed from the baud rate instead of waiting whole ticks
+    Timing.setBaud(uart_config.baud_rate);
+    // blocking and asynchronous transactions share the same statistics
+    Profiler = &bus_stats;
+    bus.Profiler = &bus_stats;
+    // sync read receive buffer is allocated once for all
+    syncReadBegin(SERVO_NUMBER, SERVO_FEEDBACK_LENGTH, SERVO_SYNC_READ_TIMEOUT_MS);
     this->disable();
     this->disableTorque();
 }
@@ -52,15 +94,78 @@ void SERVO::enable() {
 }
 
 void SERVO::enableTorque() {
-    this->EnableTorque(0xFE, 1);
+    if(isStarted())
+        torque_request = 1;     // handled by the control task
+    else {
+        lock();
+        this->EnableTorque(0xFE, 1);
+        unlock();
+    }
     isTorqueEnabled = true;
 }
 
 void SERVO::disableTorque() {
-    this->EnableTorque(0xFE, 0);
+    if(isStarted())
+        torque_request = 0;     // handled by the control task
+    else {
+        lock();
+        this->EnableTorque(0xFE, 0);
+        unlock();
+    }
     isTorqueEnabled = false;
 }
 
+struct SERVO_PING {
+    TaskHandle_t task;
+    u8 id;
+    bool answered;
+};
+
+int SERVO::ping(u8 servoID) {
+    if(!isStarted()) {
+        lock();
+        int const id {Ping(servoID)};
+        unlock();
+        return id;
+    }
+    // a background request of its own : the blocking transport is not shared with the console,
+    // the control task transactions go first
+    u8 const frame[] {0xff, 0xff, servoID, 2, INST_PING, 0};  // length and checksum are computed again
+    SERVO_PING context {xTaskGetCurrentTaskHandle(), servoID, false};
+    while(!bus.transfer(frame, sizeof(frame), 1, 0, &ping_callback, &context))
+        vTaskDelay(1);                                          // background queue full
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);                    // done or timed out, always reported
+    return context.answered ? servoID : -1;
+}
+
+void SERVO::ping_callback(void * arg, SCSAsyncResult const * result)
+{
+    // called from the async engine task
+    SERVO_PING * context = static_cast<SERVO_PING*>(arg);
+    if(result->Event==SCS_ASYNC_PACKET)
+    {
+        context->answered = result->ID==context->id;
+        return;
+    }
+    xTaskNotifyGive(context->task);
+}
+
+void SERVO::setReturnLevel(u8 level) {
+    // the register is written while the EEPROM is locked : the setting is not saved
+    // and servos come back with level 1 after a power cycle
+    return_level = level;
+    lock();
+    if(isStarted()) {
+        Level = level;                  // blocking calls stop waiting for acknowledgements right away
+        return_level_request = true;    // broadcast by the control task
+    }
+    else {
+        writeByte(0xFE, SCSCL_RETURN_LEVEL, level);
+        Level = level;
+    }
+    unlock();
+}
+
 void SERVO::rotate(u8 servoID) {
     int i;
     setPosition(servoID, 0);
@@ -93,15 +198,24 @@ void SERVO::setEndPos(u8 servoID) {
 }
 
 int SERVO::setPosition(u8 servoID, u16 position, u16 speed) {
+    if(isStarted()) {
+        // the control task owns the goal registers
+        setPositionAsync(servoID, position, speed);
+        return 0;
+    }
     int retry_counter = retries;
 
     for( int i=0; i<retry_counter; i++) {
+        lock();
         WritePos(servoID, position, 0, speed); // fixed pat92fr
-    	if(!Err) { 
+        bool const failed {Err!=0};
+        unlock();
+    	if(!failed) { 
     	    return i;
             }
     	else {
             ESP_LOGI(TAG, "Retrying WritePos((%d)", servoID);
+            bus_stats.retry(servoID);
             vTaskDelay(20 / portTICK_PERIOD_MS);
     	}
     }
@@ -114,41 +228,43 @@ int SERVO::setPositionFast(u8 servoID, u16 servoPosition)
         (u8)(servoPosition>>8),
         (u8)(servoPosition&0xff)
     };
-    return genWrite(servoID, SCSCL_GOAL_POSITION_L,buffer,2);
+    lock();
+    int const written {genWrite(servoID, SCSCL_GOAL_POSITION_L,buffer,2)};
+    unlock();
+    return written;
 }
 
 void SERVO::setPosition12(u8 const servoIDs[], u16 const servoPositions[])
 {
-    static size_t const L {2};                      // Length of data sent to each servo
-    static size_t const N {12};                     // Servo Number
-    static size_t const Length {(L+1)*N+4};         // Length field value
-    static size_t const buffer_size {2+1+1+Length}; // 0xFF 0xFF ID LENGTH (INSTR PARAM... CHK)
-    // prepare frame header and parameters (fixed)
-    static u8 buffer[buffer_size] {
-        0xFF,                                       // Start of Frame
-        0xFF,                                       // Start of Frame
-        0xFE,                                       // ID
-        Length,                                     // Length
-        INST_SYNC_WRITE,                            // Instruction
-        SCSCL_GOAL_POSITION_L,                      // Parameter 1 : Register address
-        L                                           // Parameter 2 : L
-    };
-    // build frame payload
-    size_t index {7};
-    for(size_t servo_index=0; servo_index<N; ++servo_index) {
-        buffer[index++] = servoIDs[servo_index];            // Parameter 3 = Servo Number
-        buffer[index++] = (servoPositions[servo_index]>>8); // Write the first data of the first servo
-        buffer[index++] = (servoPositions[servo_index]&0xff);
-    }
-    // compute checksum
-    u8 chk_sum {0};
-    for(size_t chk_index=2; chk_index<(buffer_size-1); ++chk_index) {
-        chk_sum += buffer[chk_index];
-    }
-    buffer[index++] = ~chk_sum;
-    // send frame to uart
-    writeSCS(buffer,buffer_size);
+    if(isStarted())
+    {
+        // the control task owns the goal registers
+        xSemaphoreTake(setpoint_lock, portMAX_DELAY);
+        for(size_t servo_index=0; servo_index<SERVO_NUMBER; ++servo_index)
+        {
+            u8 const id {servoIDs[servo_index]};
+            if(id<1 || id>SERVO_NUMBER) continue;
+            setpoint_working.position[id-1] = servoPositions[servo_index];
+            setpoint_working.mask |= 1<<(id-1);
+            setpoint_working.profile &= ~(1<<(id-1));
+        }
+        setpoint_buffer.write(setpoint_working);
+        xSemaphoreGive(setpoint_lock);
+        return;
+    }
+    // build the sync write frame in place and send it with a single write
+    lock();
+    txFrame.begin(0xFE,INST_SYNC_WRITE);
+    txFrame.add(SCSCL_GOAL_POSITION_L);             // Parameter 1 : Register address
+    txFrame.add(2);                                 // Parameter 2 : Length of data sent to each servo
+    for(size_t servo_index=0; servo_index<SERVO_NUMBER; ++servo_index) {
+        txFrame.add(servoIDs[servo_index]);
+        txFrame.add(servoPositions[servo_index]>>8);
+        txFrame.add(servoPositions[servo_index]&0xff);
+    }
+    writeFrame();
     wFlushSCS();
+    unlock();
 }
 
 bool SERVO::checkPosition(u8 servoID, u16 position, int accuracy = 5) {
@@ -157,12 +273,16 @@ bool SERVO::checkPosition(u8 servoID, u16 position, int accuracy = 5) {
     int retry_counter = retries;
     
     for( int i=0; i<retry_counter; i++) {
+        lock();
         pos = this->ReadPos(servoID);
-	if(!this->Err) { 
+        bool const failed {this->Err!=0};
+        unlock();
+	if(!failed) { 
 	    retry_counter = 0;
         }
 	else {
             ESP_LOGI(TAG, "Retrying ReadPos(%d)", servoID);
+            bus_stats.retry(servoID);
             vTaskDelay(20 / portTICK_PERIOD_MS);
 	}
     }
@@ -178,7 +298,410 @@ bool SERVO::checkPosition(u8 servoID, u16 position, int accuracy = 5) {
 }
 
 void SERVO::setID(u8 servoID, u8 newID) {
+	lock();
 	unLockEprom(servoID);
 	writeByte(servoID, SCSCL_ID, newID);
 	LockEprom(newID);
+	unlock();
+}
+
+int SERVO::syncFeedback12()
+{
+    static u8 const servoIDs[SERVO_NUMBER] {1,2,3,4,5,6,7,8,9,10,11,12};
+    u8 buffer[SERVO_FEEDBACK_LENGTH];
+    int count {0};
+    if(isStarted())
+    {
+        // the control task reads the feedback every cycle
+        SERVO_FEEDBACK feedback;
+        getFeedback(feedback);
+        for(auto const & state : feedback.servo)
+            count += state.valid;
+        return count;
+    }
+    // one INST_SYNC_READ request, every servo answers with its own status packet
+    lock();
+    syncReadPacketTx(const_cast<u8*>(servoIDs), SERVO_NUMBER, SCSCL_PRESENT_POSITION_L, SERVO_FEEDBACK_LENGTH);
+    for(size_t index=0; index<SERVO_NUMBER; ++index)
+    {
+        SERVO_STATE & state = feedback_working.servo[index];
+        if(syncReadPacketRx(servoIDs[index], buffer)!=SERVO_FEEDBACK_LENGTH)
+        {
+            state.valid = 0;
+            continue;
+        }
+        decodeState(state, buffer);
+        state.valid = 1;
+        feedback_working.slow_timestamp[index] = (u32)esp_timer_get_time();
+        Shadow.update(servoIDs[index], SCSCL_PRESENT_POSITION_L, buffer, SERVO_FEEDBACK_LENGTH);
+        ++count;
+    }
+    unlock();
+    return count;
+}
+
+void SERVO::decodeState(SERVO_STATE & state, u8 const data[])
+{
+    static_assert(SERVO_CODEC::FeedBackLen==SERVO_FEEDBACK_LENGTH, "feedback block mismatch");
+    decodeFast(state, data+SERVO_FAST_ADDRESS-SCSCL_PRESENT_POSITION_L);
+    decodeSlow(state, data+SERVO_SLOW_ADDRESS-SCSCL_PRESENT_POSITION_L);
+}
+
+void SERVO::decodeFast(SERVO_STATE & state, u8 const data[])
+{
+    // register map, byte order and sign bits of the family resolved at compile time
+    auto const reg = [data](u8 address) { return data+address-SERVO_FAST_ADDRESS; };
+    state.position = SERVO_CODEC::unsign(SERVO_CODEC::get(reg(SCSCL_PRESENT_POSITION_L)), SERVO_FAMILY::PositionSign);    // 56-57
+    state.speed = SERVO_CODEC::unsign(SERVO_CODEC::get(reg(SCSCL_PRESENT_SPEED_L)), SERVO_FAMILY::SpeedSign);             // 58-59
+    state.load = SERVO_CODEC::unsign(SERVO_CODEC::get(reg(SCSCL_PRESENT_LOAD_L)), SERVO_FAMILY::LoadSign);                // 60-61
+}
+
+void SERVO::decodeSlow(SERVO_STATE & state, u8 const data[])
+{
+    auto const reg = [data](u8 address) { return data+address-SERVO_SLOW_ADDRESS; };
+    state.voltage = *reg(SCSCL_PRESENT_VOLTAGE);                                                                        // 62
+    state.temperature = *reg(SCSCL_PRESENT_TEMPERATURE);                                                                // 63
+    state.move = *reg(SCSCL_MOVING);                                                                                    // 66
+    state.current = SERVO_CODEC::unsign(SERVO_CODEC::get(reg(SCSCL_PRESENT_CURRENT_L)), SERVO_FAMILY::CurrentSign);     // 69-70
+}
+
+u32 SERVO::slowCost(u8 count) const
+{
+    // time on the wire : sync read request, return delays and status packets
+    SCSTiming const & timing = bus.Timing;
+    return timing.bytes(8+count)+timing.response(count*(SERVO_SLOW_LENGTH+SCS_TIMING_MIN_PACKET_LEN), count)-timing.Margin;
+}
+
+void SERVO::start(uint32_t period_us)
+{
+    if(isStarted()) return;
+#if CONFIG_SERVO_NO_ACK
+    return_level = 0;
+#endif
+    // the blocking driver follows the level the control task is about to broadcast
+    Level = return_level;
+    return_level_request = true;
+    // servos left at another rate are looked for while the bus is still blocking
+    if(isEnabled) detectBaud();
+    // from now on, the UART is only read by the async engine
+    ESP_ERROR_CHECK(bus.begin(uart_port_num, uart_queue, SERVO_ASYNC_TASK_PRIORITY, SERVO_CONTROL_TASK_CORE) ? ESP_OK : ESP_FAIL);
+    // blocking calls are queued behind the control task transactions, the engine records their timing
+    Transport = &bus_transport;
+    Profiler = NULL;
+    xTaskCreatePinnedToCore(control_task, "servo_control_task", SERVO_CONTROL_TASK_STACK_SIZE, this, SERVO_CONTROL_TASK_PRIORITY, &control_task_handle, SERVO_CONTROL_TASK_CORE);
+    // FreeRTOS tick is too coarse (10ms) for the control period, use a high resolution timer
+    esp_timer_create_args_t const timer_args {
+        .callback = &control_timer,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "servo_control_timer",
+        .skip_unhandled_events = true
+    };
+    esp_timer_handle_t timer;
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer, period_us));
+    ESP_LOGI(TAG, "Control task started (period %luus)", (unsigned long)period_us);
+}
+
+int SERVO::detectBaud()
+{
+    if(isStarted()) return 0;
+    u8 ids[SERVO_NUMBER];
+    for(size_t index=0; index<SERVO_NUMBER; ++index)
+        ids[index] = index+1;
+    // one servo answering at the current rate is enough
+    for(u8 id : ids)
+        if(Ping(id)==id) return Timing.Baud;
+    for(u8 id : ids)
+    {
+        u8 const index {SCSBaud::discover(*this, id, SCSBaud::index(Timing.Baud))};
+        if(index!=SCS_BAUD_NONE)
+        {
+            if(Timing.Baud!=CONFIG_SERVO_BAUD_RATE)
+                ESP_LOGW(TAG, "Servos found at %lu baud instead of %d, run servo-baud-set to move them", (unsigned long)Timing.Baud, CONFIG_SERVO_BAUD_RATE);
+            return Timing.Baud;
+        }
+    }
+    ESP_LOGW(TAG, "No servo found at any baud rate");
+    setBaud(CONFIG_SERVO_BAUD_RATE);
+    return 0;
+}
+
+void SERVO::setPosition12Async(u16 const servoPositions[])
+{
+    xSemaphoreTake(setpoint_lock, portMAX_DELAY);
+    for(size_t index=0; index<SERVO_NUMBER; ++index)
+        setpoint_working.position[index] = servoPositions[index];
+    setpoint_working.mask = (1<<SERVO_NUMBER)-1;
+    setpoint_working.profile = 0;
+    setpoint_buffer.write(setpoint_working);
+    xSemaphoreGive(setpoint_lock);
+}
+
+void SERVO::setPositionAsync(u8 servoID, u16 servoPosition, u16 servoSpeed)
+{
+    if(servoID<1 || servoID>SERVO_NUMBER) return;
+    xSemaphoreTake(setpoint_lock, portMAX_DELAY);
+    setpoint_working.position[servoID-1] = servoPosition;
+    setpoint_working.speed[servoID-1] = servoSpeed;
+    setpoint_working.time[servoID-1] = 0;
+    setpoint_working.mask |= 1<<(servoID-1);
+    // only this servo's profile changes, the other servos keep theirs
+    if(servoSpeed)
+        setpoint_working.profile |= 1<<(servoID-1);
+    else
+        setpoint_working.profile &= ~(1<<(servoID-1));
+    setpoint_buffer.write(setpoint_working);
+    xSemaphoreGive(setpoint_lock);
+}
+
+bool SERVO::setPosition12Stream(u32 sequence, u32 timestamp, u16 const servoPositions[], u16 const servoSpeeds[], u16 const servoTimes[])
+{
+    // frames arriving late or twice are dropped, sequence 0 restarts the stream
+    xSemaphoreTake(setpoint_lock, portMAX_DELAY);
+    if(sequence!=0 && (int32_t)(sequence-stream_sequence)<=0)
+    {
+        xSemaphoreGive(setpoint_lock);
+        return false;
+    }
+    stream_sequence = sequence;
+    for(size_t index=0; index<SERVO_NUMBER; ++index)
+    {
+        setpoint_working.position[index] = servoPositions[index];
+        setpoint_working.speed[index] = servoSpeeds ? servoSpeeds[index] : 0;
+        setpoint_working.time[index] = servoTimes ? servoTimes[index] : 0;
+    }
+    setpoint_working.mask = (1<<SERVO_NUMBER)-1;
+    setpoint_working.profile = (servoSpeeds || servoTimes) ? (1<<SERVO_NUMBER)-1 : 0;
+    setpoint_working.sequence = sequence;
+    setpoint_working.timestamp = timestamp;
+    // the control task only sees the latest frame
+    setpoint_buffer.write(setpoint_working);
+    xSemaphoreGive(setpoint_lock);
+    return true;
+}
+
+void SERVO::getFeedback(SERVO_FEEDBACK & feedback) const
+{
+    feedback_buffer.read(feedback);
+}
+
+void SERVO::control_timer(void * arg)
+{
+    SERVO * self = static_cast<SERVO*>(arg);
+    xTaskNotifyGive(self->control_task_handle);
+}
+
+void SERVO::control_task(void * arg)
+{
+    SERVO * self = static_cast<SERVO*>(arg);
+    for(;;)
+    {
+        // wait for next period (missed periods are merged)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self->control_cycle();
+    }
+}
+
+void SERVO::control_cycle()
+{
+    // the bus is left to a blocking caller
+    if(paused) return;
+
+    // the register shadow is shared with the blocking calls : while one holds the bus lock
+    // for its transaction, the goals wait for the next cycle and only the feedback is read
+    if(xSemaphoreTake(bus_lock, 0)==pdTRUE)
+    {
+        control_goals();
+        xSemaphoreGive(bus_lock);
+    }
+
+    // position, speed and load of all servos in one bus transaction, decoded as status packets arrive
+    // a sync read still in flight is not queued twice
+    static u8 const servoIDs[SERVO_NUMBER] {1,2,3,4,5,6,7,8,9,10,11,12};
+    if(!feedback_pending.exchange(true))
+    {
+        feedback_received = 0;
+        if(!bus.syncRead(servoIDs, SERVO_NUMBER, SERVO_FAST_ADDRESS, SERVO_FAST_LENGTH, &feedback_callback, this))
+            feedback_pending = false;
+    }
+
+    // voltage, temperature, moving and current change slowly : read for as many servos in turn
+    // as the bus time saved over the previous cycles allows
+    slow_credit = std::min(slow_credit+slow_budget, slowCost(SERVO_NUMBER));
+    if(!slow_pending)
+    {
+        u8 slow_count {0};
+        while(slow_count<SERVO_NUMBER && slowCost(slow_count+1)<=slow_credit)
+            ++slow_count;
+        if(slow_count)
+        {
+            u8 slow_ids[SERVO_NUMBER];
+            for(size_t index=0; index<slow_count; ++index)
+                slow_ids[index] = servoIDs[(slow_next+index)%SERVO_NUMBER];
+            slow_pending = true;
+            if(bus.syncRead(slow_ids, slow_count, SERVO_SLOW_ADDRESS, SERVO_SLOW_LENGTH, &slow_callback, this))
+            {
+                slow_credit -= slowCost(slow_count);
+                slow_next = (slow_next+slow_count)%SERVO_NUMBER;
+            }
+            else
+                slow_pending = false;
+        }
+    }
+}
+
+void SERVO::control_goals()
+{
+    // pending torque request
+    int const torque {torque_request.exchange(-1)};
+    if(torque>=0)
+    {
+        u8 const enable = torque;
+        bus.writeByte(0xFE, SCSCL_TORQUE_ENABLE, enable);
+        Shadow.sent(0xFE, SCSCL_TORQUE_ENABLE, &enable, 1);
+    }
+
+    // return level broadcast at startup and whenever a servo comes back online
+    if(return_level_request.exchange(false))
+    {
+        u8 const level {return_level};
+        bus.Level = level;
+        bus.writeByte(0xFE, SCSCL_RETURN_LEVEL, level);
+        // a servo back online lost its goal : all goals are sent again
+        Shadow.touch(SCS_SHADOW_BROADCAST, SCSCL_GOAL_POSITION_L, SCSCL_GOAL_SPEED_H);
+    }
+
+    // latest goal positions : a new setpoint cancels the trajectory,
+    // otherwise the trajectory (if any) is sampled at the control rate
+    SERVO_SETPOINT setpoint;
+    u32 const version {setpoint_buffer.read(setpoint)};
+    if(version!=setpoint_version)
+    {
+        setpoint_version = version;
+        command = setpoint;
+        trajectory.clear();
+    }
+    else
+    {
+        u16 const all {(1<<SERVO_NUMBER)-1};
+        u16 known {command.mask};
+        if(!trajectory.isActive() && known!=all)
+        {
+            // a trajectory may start from here : joints never commanded start from their feedback
+            SERVO_FEEDBACK feedback;
+            feedback_buffer.read(feedback);
+            for(size_t index=0; index<SERVO_NUMBER; ++index)
+            {
+                if((known&(1<<index)) || !feedback.servo[index].valid) continue;
+                command.position[index] = feedback.servo[index].position;
+                known |= 1<<index;
+            }
+        }
+        if(trajectory.sample(esp_timer_get_time(), command.position, known))
+        {
+            command.mask = all;
+            command.profile = 0;
+        }
+    }
+
+    // goal positions go through the register shadow : position only, or position, time and speed
+    // as SyncWritePos does, only the bytes that differ from what the servos hold become dirty
+    if(command.mask)
+    {
+        for(size_t index=0; index<SERVO_NUMBER; ++index)
+        {
+            if(!(command.mask&(1<<index))) continue;
+            u8 const id = index+1;
+            Shadow.writeWord(id, SCSCL_GOAL_POSITION_L, command.position[index]);
+            if(command.profile&(1<<index))
+            {
+                Shadow.writeWord(id, SCSCL_GOAL_TIME_L, command.time[index]);
+                Shadow.writeWord(id, SCSCL_GOAL_SPEED_L, command.speed[index]);
+            }
+        }
+        setpoint_sequence = command.sequence;
+    }
+    if(++goal_refresh>=SERVO_GOAL_REFRESH_CYCLES)
+    {
+        goal_refresh = 0;
+        Shadow.touch(SCS_SHADOW_BROADCAST, SCSCL_GOAL_POSITION_L, SCSCL_GOAL_SPEED_H);
+    }
+
+    // one sync write of the servos and registers that changed, queued without waiting for the bus
+    // nothing is sent while the robot stands still
+    u8 ids[SCS_SHADOW_MAX_ID];
+    u8 data[SCS_SHADOW_MAX_ID*(SCSCL_GOAL_SPEED_H-SCSCL_GOAL_POSITION_L+1)];
+    u8 address, length;
+    int count;
+    while((count = Shadow.delta(SCSCL_GOAL_POSITION_L, SCSCL_GOAL_SPEED_H, ids, data, address, length))>0)
+    {
+        if(!bus.syncWrite(ids, count, address, data, length))
+        {
+            // realtime queue full : dirty again, sent next cycle
+            for(int index=0; index<count; ++index)
+                Shadow.touch(ids[index], address, address+length-1);
+            break;
+        }
+    }
+}
+
+void SERVO::feedback_callback(void * arg, SCSAsyncResult const * result)
+{
+    // called from the async engine task
+    SERVO * self = static_cast<SERVO*>(arg);
+    if(result->Event==SCS_ASYNC_PACKET)
+    {
+        if(result->ID<1 || result->ID>SERVO_NUMBER) return;
+        SERVO_STATE & state = self->feedback_working.servo[result->ID-1];
+        self->decodeFast(state, result->nDat);
+        state.valid = 1;
+        self->feedback_received |= 1<<(result->ID-1);
+        return;
+    }
+    // done or timed out : servos that did not answer are flagged invalid
+    // and reported offline after SERVO_OFFLINE_THRESHOLD consecutive misses
+    u16 online {self->online_mask};
+    for(size_t index=0; index<SERVO_NUMBER; ++index)
+    {
+        u16 const bit = 1<<index;
+        if(self->feedback_received&bit)
+        {
+            self->feedback_missed[index] = 0;
+            if(!(online&bit))
+            {
+                // a servo that was powered off is back with the default return level
+                ESP_LOGI(TAG, "Servo %d online", (int)index+1);
+                online |= bit;
+                self->return_level_request = true;
+            }
+            continue;
+        }
+        self->feedback_working.servo[index].valid = 0;
+        if(self->feedback_missed[index]<SERVO_OFFLINE_THRESHOLD && ++self->feedback_missed[index]==SERVO_OFFLINE_THRESHOLD && (online&bit))
+        {
+            ESP_LOGW(TAG, "Servo %d offline", (int)index+1);
+            online &= ~bit;
+        }
+    }
+    self->online_mask = online;
+    self->feedback_working.timestamp = (u32)esp_timer_get_time();
+    self->feedback_working.sequence = self->setpoint_sequence;
+    self->feedback_buffer.write(self->feedback_working);
+    self->feedback_pending = false;
+}
+
+void SERVO::slow_callback(void * arg, SCSAsyncResult const * result)
+{
+    // called from the async engine task, published along with the next fast feedback
+    SERVO * self = static_cast<SERVO*>(arg);
+    if(result->Event==SCS_ASYNC_PACKET)
+    {
+        if(result->ID<1 || result->ID>SERVO_NUMBER) return;
+        self->decodeSlow(self->feedback_working.servo[result->ID-1], result->nDat);
+        self->feedback_working.slow_timestamp[result->ID-1] = (u32)esp_timer_get_time();
+        return;
+    }
+    // missing servos are detected by the fast feedback
+    self->slow_pending = false;
 }
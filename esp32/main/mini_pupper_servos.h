@@ -1,8 +1,73 @@
 #include "SCSCL.h"
+#include "SCSFamily.h"
+#include "SCSAsync.h"
+#include "SCSAsyncTransport.h"
+#include "double_buffer.h"
+#include "mini_pupper_trajectory.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <atomic>
 
 #ifndef _mini_pupper_servos_H
 #define _mini_pupper_servos_H
 
+#define SERVO_NUMBER                    12
+#define SERVO_CONTROL_PERIOD_US         5000    // 200Hz
+#define SERVO_CONTROL_TASK_PRIORITY     (configMAX_PRIORITIES-2)
+#define SERVO_CONTROL_TASK_CORE         1
+#define SERVO_CONTROL_TASK_STACK_SIZE   4096
+#define SERVO_FEEDBACK_LENGTH           (SCSCL_PRESENT_CURRENT_H-SCSCL_PRESENT_POSITION_L+1)
+#define SERVO_FAST_ADDRESS              SCSCL_PRESENT_POSITION_L
+#define SERVO_FAST_LENGTH               (SCSCL_PRESENT_LOAD_H-SCSCL_PRESENT_POSITION_L+1)      // position, speed, load : every cycle
+#define SERVO_SLOW_ADDRESS              SCSCL_PRESENT_VOLTAGE
+#define SERVO_SLOW_LENGTH               (SCSCL_PRESENT_CURRENT_H-SCSCL_PRESENT_VOLTAGE+1)      // voltage, temperature, moving, current : round-robin
+#define SERVO_SLOW_BUDGET_US            400     // average bus time per control cycle spent on the slow fields
+typedef SCSCLFamily SERVO_FAMILY;               // servo family of the robot
+typedef SCSCodec<SERVO_FAMILY> SERVO_CODEC;
+#define SERVO_SYNC_READ_TIMEOUT_MS      10
+#define SERVO_UART_EVENT_QUEUE_LENGTH   32
+#define SERVO_ASYNC_TASK_PRIORITY       (configMAX_PRIORITIES-1)
+#define SERVO_OFFLINE_THRESHOLD         20      // missed sync reads before a servo is reported offline (100ms)
+#define SERVO_GOAL_REFRESH_CYCLES       100     // unchanged goals are sent again every 500ms, writes are not acknowledged
+
+// goal positions handed to the control task
+struct SERVO_SETPOINT {
+    u16 position[SERVO_NUMBER];
+    u16 time[SERVO_NUMBER];                     // goal time, written along with the position when its profile bit is set
+    u16 speed[SERVO_NUMBER];                    // goal speed, written along with the position when its profile bit is set
+    u16 mask;                                   // bit i set : servo ID i+1 has a goal position
+    u16 profile;                                // bit i set : servo ID i+1 also has a goal time and speed
+    u32 sequence;                               // streamed setpoint sequence number (0 : not streamed)
+    u32 timestamp;                              // host timestamp of the streamed setpoint
+};
+
+// last known state of a servo, refreshed by the control task
+struct SERVO_STATE {
+    u16 position;
+    s16 speed;
+    s16 load;
+    s16 current;
+    u8  voltage;
+    u8  temperature;
+    u8  move;
+    u8  valid;                                  // 1 : last feedback read succeeded
+};
+
+struct SERVO_FEEDBACK {
+    SERVO_STATE servo[SERVO_NUMBER];
+    u32 timestamp;                              // capture time (us)
+    u32 sequence;                               // streamed setpoint sent to the servos before the capture
+    u32 slow_timestamp[SERVO_NUMBER];           // last read of voltage, temperature, moving and current (us), 0 : never
+};
+
+// servo bus manager : the only owner of the servo UART
+// once started, the control task sends its transactions first, blocking calls
+// (console) are queued behind them as background requests
+// blocking calls share the SCS driver state (Level, Err, txFrame) and the register
+// shadow with the control task : the methods below take the bus lock themselves,
+// inherited SCSCL methods are called between lock() and unlock()
 class SERVO : public SCSCL
 {
 public:
@@ -10,18 +75,93 @@ public:
     void disable();
     void enable();
     void enableTorque();
-    void disableTorque(); 
+    void disableTorque();
     void rotate(u8 servoID);
     void setStartPos(u8 servoID);
     void setMidPos(u8 servoID);
     void setEndPos(u8 servoID);
     int  setPosition(u8 servoID, u16 position, u16 speed = 0); // default maximum speed
-    int  setPositionFast(u8 servoID, u16 position);                         // not thread-safe, to be deleted
-    void setPosition12(u8 const servoIDs[], u16 const servoPositions[]);    // not thread-safe
+    int  setPositionFast(u8 servoID, u16 position);                         // to be deleted
+    void setPosition12(u8 const servoIDs[], u16 const servoPositions[]);    // handed to the control task once started
     bool checkPosition(u8 servoID, u16 position, int accuracy);
     void setID(u8 servoID, u8 newID);
-    bool isEnabled; 
-    bool isTorqueEnabled; 
+    int  syncFeedback12();                                                  // returns number of servos read (last feedback once started)
+    bool isEnabled;
+    bool isTorqueEnabled;
+    SCSProfiler bus_stats;                                                  // timing of every transaction, blocking or not
+    int  detectBaud();                                                      // not thread-safe, adopts the rate the servos answer at, 0 if none
+
+    // control task : once started, the async engine is the only reader of the servo UART
+    // and blocking calls go through it (one task at a time)
+    void start(uint32_t period_us = SERVO_CONTROL_PERIOD_US);
+    bool isStarted() const { return control_task_handle!=NULL; }
+    void pause() { paused = true; }                                 // any task, the control task leaves the bus alone (baud rate changes)
+    void resume() { paused = false; return_level_request = true; }  // any task, return level and goals are sent again
+    void setPosition12Async(u16 const servoPositions[]);            // any task, latest call wins
+    void setPositionAsync(u8 servoID, u16 servoPosition, u16 servoSpeed = 0); // any task, latest call wins
+    bool setPosition12Stream(u32 sequence, u32 timestamp, u16 const servoPositions[],
+                             u16 const servoSpeeds[] = NULL, u16 const servoTimes[] = NULL); // any task, stale frames are dropped
+    void getFeedback(SERVO_FEEDBACK & feedback) const;              // thread-safe
+    void lock() { xSemaphoreTake(bus_lock, portMAX_DELAY); }        // any task, before inherited blocking calls (ReadPos, FeedBack...)
+    void unlock() { xSemaphoreGive(bus_lock); }
+    int  ping(u8 servoID);                                          // any task, blocking : servoID if the servo answers, -1 otherwise
+
+    // trajectory : sparse timestamped waypoints, interpolated by the control task
+    // a setpoint set through any other call cancels it
+    bool pushWaypoint(TRAJECTORY_WAYPOINT const & waypoint) { return trajectory.push(waypoint); }  // single writer task, false when the buffer is full
+    TRAJECTORY const & getTrajectory() const { return trajectory; }
+
+    // return level 0 : writes are not acknowledged, servos are checked through the sync read feedback
+    void setReturnLevel(u8 level);
+    u16  getOnlineMask() const { return online_mask; }              // bit i set : servo ID i+1 answers sync reads
+
+    // feedback : position, speed and load of every servo each cycle, the slow fields
+    // of a few servos in turn within an average bus time per cycle
+    void setSlowBudget(u32 budget_us) { slow_budget = budget_us; }  // any task, 0 : slow fields not read
+
+private:
+    static void control_task(void * arg);
+    static void control_timer(void * arg);
+    static void feedback_callback(void * arg, SCSAsyncResult const * result);
+    static void slow_callback(void * arg, SCSAsyncResult const * result);
+    static void ping_callback(void * arg, SCSAsyncResult const * result);
+    u32  slowCost(u8 count) const;
+    void control_cycle();
+    void control_goals();
+    void decodeState(SERVO_STATE & state, u8 const data[]);
+    void decodeFast(SERVO_STATE & state, u8 const data[]);
+    void decodeSlow(SERVO_STATE & state, u8 const data[]);
+
+    TaskHandle_t control_task_handle;
+    QueueHandle_t uart_queue;                   // UART events, consumed by the async engine once started
+    SCSAsync bus;                               // non-blocking transactions issued by the control task
+    SCSAsyncTransport bus_transport;            // blocking calls through the async engine once started
+    SemaphoreHandle_t setpoint_lock;            // setpoint writers (protocol and console tasks)
+    SemaphoreHandle_t bus_lock;                 // SCS driver state and register shadow (blocking callers and control task)
+    std::atomic<bool> paused;
+    std::atomic<bool> feedback_pending;         // a sync read is in flight
+    u16 feedback_received;                      // bit i set : servo ID i+1 answered the pending sync read
+    std::atomic<u32> setpoint_sequence;         // last streamed setpoint sent to the servos
+    std::atomic<int> torque_request;            // -1 : none, 0 : disable, 1 : enable
+    std::atomic<u8> return_level;               // return level the servos are configured with
+    std::atomic<bool> return_level_request;     // return level to be (re)sent by the control task
+    u8 feedback_missed[SERVO_NUMBER];           // consecutive sync reads without status packet
+    std::atomic<u16> online_mask;
+    SERVO_SETPOINT setpoint_working;            // writer side copy, under setpoint_lock
+    u32 stream_sequence;                        // last streamed setpoint accepted
+    SERVO_FEEDBACK feedback_working;            // state table filled by syncFeedback12()
+    DoubleBuffer<SERVO_SETPOINT> setpoint_buffer;
+    DoubleBuffer<SERVO_FEEDBACK> feedback_buffer;
+    u32 setpoint_version;                       // control task side : last setpoint read
+    SERVO_SETPOINT command;                     // control task side : goal positions, sent through the register shadow when they change
+    TRAJECTORY trajectory;
+    u8 goal_refresh;                            // control task side : cycles since the goals were last sent in full
+    std::atomic<bool> slow_pending;             // a slow fields sync read is in flight
+    std::atomic<u32> slow_budget;
+    u32 slow_credit;                            // control task side : bus time (us) saved for the slow fields
+    u8 slow_next;                               // control task side : index of the next servo whose slow fields are read
 };
 
+extern SERVO servo;                             // the servo bus manager
+
 #endif
@@ -0,0 +1,126 @@
+#include "mini_pupper_trajectory.h"
+
+TRAJECTORY::TRAJECTORY() :
+    queue(NULL),
+    previous(),
+    has_previous(false),
+    points(),
+    count(0),
+    host_anchor(0),
+    local_anchor(0),
+    host_last(0),
+    ended(false),
+    underruns(0),
+    dropped(0)
+{
+    queue = xQueueCreate(TRAJECTORY_QUEUE_LENGTH, sizeof(TRAJECTORY_WAYPOINT));
+}
+
+bool TRAJECTORY::push(TRAJECTORY_WAYPOINT const & waypoint)
+{
+    return xQueueSend(queue, &waypoint, 0)==pdTRUE;
+}
+
+u8 TRAJECTORY::getFree() const
+{
+    return uxQueueSpacesAvailable(queue);
+}
+
+void TRAJECTORY::clear()
+{
+    xQueueReset(queue);
+    count = 0;
+    has_previous = false;
+    ended = false;
+}
+
+void TRAJECTORY::append(int64_t time, u16 const position[])
+{
+    POINT & point = points[count++];
+    point.time = time;
+    for(size_t joint=0; joint<TRAJECTORY_JOINTS; ++joint)
+        point.position[joint] = position[joint];
+}
+
+void TRAJECTORY::refill(int64_t now, u16 const position[], u16 known)
+{
+    TRAJECTORY_WAYPOINT waypoint;
+    while(count<3 && xQueueReceive(queue, &waypoint, 0)==pdTRUE)
+    {
+        if(count==0)
+        {
+            // a waypoint that should already be playing on the previous mapping came late
+            if(ended && local_anchor+(int64_t)(int32_t)(waypoint.timestamp-host_anchor)*1000<=now)
+                ++underruns;
+            ended = false;
+            // new trajectory : from the current positions to the first waypoint, played after a delay
+            u16 start[TRAJECTORY_JOINTS];
+            for(size_t joint=0; joint<TRAJECTORY_JOINTS; ++joint)
+                start[joint] = (known&(1<<joint)) ? position[joint] : waypoint.position[joint];
+            host_anchor = waypoint.timestamp;
+            local_anchor = now+TRAJECTORY_PLAYOUT_DELAY_US;
+            host_last = waypoint.timestamp;
+            has_previous = false;
+            append(now, start);
+            append(local_anchor, waypoint.position);
+            continue;
+        }
+        if((int32_t)(waypoint.timestamp-host_last)<=0)
+        {
+            ++dropped;
+            continue;
+        }
+        host_last = waypoint.timestamp;
+        append(local_anchor+(int64_t)(int32_t)(waypoint.timestamp-host_anchor)*1000, waypoint.position);
+    }
+}
+
+bool TRAJECTORY::sample(int64_t now, u16 position[], u16 known)
+{
+    refill(now, position, known);
+    if(!count)
+        return false;
+
+    // move on to the segment holding now
+    while(count>1 && now>=points[1].time)
+    {
+        previous = points[0];
+        has_previous = true;
+        points[0] = points[1];
+        points[1] = points[2];
+        --count;
+        refill(now, position, known);
+    }
+    if(count==1)
+    {
+        // buffer ran dry (or the trajectory ended) : hold the last waypoint
+        for(size_t joint=0; joint<TRAJECTORY_JOINTS; ++joint)
+            position[joint] = (u16)(points[0].position[joint]+0.5f);
+        count = 0;
+        ended = true;
+        return true;
+    }
+
+    // cubic Hermite between points[0] and points[1], Catmull-Rom tangents,
+    // one-sided at the ends of the buffered waypoints
+    POINT const & p1 = points[0];
+    POINT const & p2 = points[1];
+    float const h = (float)(p2.time-p1.time);
+    float const s = (float)(now-p1.time)/h;
+    float const s2 = s*s;
+    float const s3 = s2*s;
+    float const h00 = 2*s3-3*s2+1;
+    float const h10 = s3-2*s2+s;
+    float const h01 = -2*s3+3*s2;
+    float const h11 = s3-s2;
+    float const k1 = has_previous ? h/(float)(p2.time-previous.time) : 1.0f;
+    float const k2 = count>2 ? h/(float)(points[2].time-p1.time) : 1.0f;
+    for(size_t joint=0; joint<TRAJECTORY_JOINTS; ++joint)
+    {
+        float const m1 = k1*(p2.position[joint]-(has_previous ? previous.position[joint] : p1.position[joint]));
+        float const m2 = k2*((count>2 ? points[2].position[joint] : p2.position[joint])-p1.position[joint]);
+        float const value = h00*p1.position[joint]+h10*m1+h01*p2.position[joint]+h11*m2;
+        position[joint] = value<=0 ? 0 : value>=65535 ? 65535 : (u16)(value+0.5f);
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#include "INST.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <atomic>
+
+#ifndef _mini_pupper_trajectory_H
+#define _mini_pupper_trajectory_H
+
+#define TRAJECTORY_JOINTS               12
+#define TRAJECTORY_QUEUE_LENGTH         16      // waypoints ahead of the interpolator, 320ms at 50Hz
+#define TRAJECTORY_PLAYOUT_DELAY_US     40000   // a new trajectory starts 40ms after its first waypoint : absorbs host jitter
+
+// joint positions the servos shall reach at a given host time
+struct TRAJECTORY_WAYPOINT {
+    u32 timestamp;                              // host time (ms)
+    u16 position[TRAJECTORY_JOINTS];
+};
+
+// Waypoints are pushed by the protocol task and interpolated by the control task
+// with cubic Hermite splines (Catmull-Rom tangents). Host time is mapped to local
+// time when a trajectory starts. When the buffer runs dry the last waypoint is held
+// and the next waypoint starts a new trajectory from the current positions
+// (joints with no known position start at the first waypoint).
+// The end of a trajectory is not an underrun : one is counted when the waypoint
+// starting the next trajectory arrives after its play time on the previous mapping,
+// that is when the host was still streaming but the buffer ran dry.
+class TRAJECTORY
+{
+public:
+    TRAJECTORY();
+    bool push(TRAJECTORY_WAYPOINT const & waypoint);        // any task, false when the buffer is full
+    u8   getFree() const;                                   // any task, waypoints that can still be pushed
+    u32  getUnderruns() const { return underruns; }         // waypoints that arrived after their play time
+    u32  getDropped() const { return dropped; }
+
+    // control task only
+    void clear();
+    bool sample(int64_t now, u16 position[], u16 known);    // position : current goal positions in (bit i of known set : joint i is valid), interpolated out
+    bool isActive() const { return count>0; }
+
+private:
+    struct POINT {
+        int64_t time;                           // local time (us)
+        float position[TRAJECTORY_JOINTS];
+    };
+    void refill(int64_t now, u16 const position[], u16 known);
+    void append(int64_t time, u16 const position[]);
+
+    QueueHandle_t queue;
+    POINT previous;                             // waypoint before the current segment
+    bool has_previous;
+    POINT points[3];                            // current segment [0]->[1], next waypoint [2]
+    u8 count;
+    u32 host_anchor;                            // host time of the first waypoint
+    int64_t local_anchor;                       // local time of the first waypoint
+    u32 host_last;                              // host time of the last waypoint accepted
+    bool ended;                                 // a trajectory ran to its last waypoint, the anchors still map host time
+    std::atomic<u32> underruns;
+    std::atomic<u32> dropped;                   // waypoints older than the previous one
+};
+
+#endif
@@ -1,22 +1,46 @@
 #include "mini_pupper_servos.h"
+#include "mini_pupper_imu.h"
 #include "protocolfunctions.h"
-#include "QMI8658C.h"
 #include <cstddef>
 #include <cstring>
 #include <cstdio>
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static const char *TAG = "PROTOCOLFUNCTIONS";
 
 PROTOCOL_STAT sUSART2;
-SERVO servo1;
-QMI8658C imu1;
 
 uint8_t data[2];
 struct SERVOPARAM {
     u16 param[12];
 };
 SERVOPARAM servo_data;
+#pragma pack(push, 1)
+struct SERVOSTREAMPARAM {
+    u32 sequence;
+    u32 timestamp;
+    u16 position[12];
+    u16 speed[12];          // optional
+    u16 time[12];           // optional
+};
+#pragma pack(pop)
+SERVOSTREAMPARAM servo_stream;
+#define TRAJECTORY_WAYPOINTS_PER_MESSAGE 8
+#pragma pack(push, 1)
+struct TRAJECTORYPARAM {
+    TRAJECTORY_WAYPOINT waypoint[TRAJECTORY_WAYPOINTS_PER_MESSAGE];
+};
+struct TRAJECTORYSTATUSPARAM {
+    uint8_t free;           // waypoints that can still be pushed
+    uint8_t active;
+    u32 underruns;
+    u32 dropped;
+};
+#pragma pack(pop)
+TRAJECTORYPARAM trajectory_data;
+TRAJECTORYSTATUSPARAM trajectory_status;
+SERVO_FEEDBACK servo_feedback;
 struct IMU6DOFPARAM {
     vec3_t acc;
     vec3_t gyro;
@@ -29,12 +53,138 @@ struct IMUATTPARAM {
     uint8_t ae_reg2;
 };
 IMUATTPARAM imu_att_data;
+IMU_SNAPSHOT imu_snapshot;
+#pragma pack(push, 1)
+struct TELEMETRYPARAM {
+    uint8_t version;
+    u32 timestamp;          // servo feedback capture time (us)
+    u32 sequence;           // last streamed setpoint sent to the servos before the capture
+    u16 valid;              // bit i set : feedback of servo ID i+1 is valid
+    u16 position[12];
+    s16 load[12];
+    vec3_t acc;
+    vec3_t gyro;
+};
+#pragma pack(pop)
+#define TELEMETRY_VERSION 1
+TELEMETRYPARAM telemetry;
+#pragma pack(push, 1)
+struct STATEPARAM {
+    uint8_t version;
+    u32 timestamp;          // servo feedback capture time (us)
+    u32 sequence;           // last streamed setpoint sent to the servos before the capture
+    u16 valid;              // bit i set : feedback of servo ID i+1 is valid
+    u16 position[12];
+    s16 speed[12];
+    s16 load[12];
+    s16 current[12];
+    u8  voltage[12];
+    u8  temperature[12];
+    u16 move;               // bit i set : servo ID i+1 is moving
+    u32 imu_timestamp;      // IMU capture time (us)
+    u8  imu_valid;
+    vec3_t acc;
+    vec3_t gyro;
+    quat_t dq;
+};
+#pragma pack(pop)
+#define STATE_VERSION 1
+STATEPARAM state;
+#pragma pack(push, 1)
+struct IMUBATCHPARAM {
+    uint8_t version;
+    uint8_t count;          // samples, oldest first
+    u32 sequence;           // samples read since start, the last one of the batch included
+    IMU_SAMPLE sample[IMU_HISTORY_LENGTH];
+};
+#pragma pack(pop)
+#define IMU_BATCH_VERSION 1
+IMUBATCHPARAM imu_batch;    // larger than one frame : sent in fragments
+IMU_SAMPLE imu_history[IMU_HISTORY_LENGTH];     // aligned copy, imu_batch.sample is not
+#pragma pack(push, 1)
+struct BUSSTATSPARAM {
+    uint8_t version;
+    struct {
+        u32 count;
+        u32 timeout;
+        u32 chkerr;
+        u16 min;            // us, saturated
+        u16 mean;
+        u16 p50;
+        u16 p99;
+        u16 max;
+    } inst[SCS_PROF_INST_NUM];  // write, read, sync write, sync read, ping
+    struct {
+        u32 timeout;
+        u32 chkerr;
+        u16 retry;
+    } servo[12];                // servo ID 1 to 12
+};
+#pragma pack(pop)
+#define BUS_STATS_VERSION 1
+BUSSTATSPARAM bus_stats_data;
 bool isEnabled;
 
+////////////////////////////////////////////////////////////////////////////////////////////
+// async handlers : handlers waiting on the servo bus run on the protocol async task, so that
+// the UART server task keeps draining the RX FIFO. The request is copied into a job, the async
+// function turns it into the response, then the server task posts it (protocol_async_poll) :
+// the protocol itself is only run by the server task. Fast handlers stay inline.
+// When the job queue is full the request is answered with the single byte PROTOCOL_ASYNC_BUSY.
+// So is a request inside a batch ('M') : the 'm' response is sent by the server task once every
+// record is in, the handler would stall it. Async parameters are requested on their own.
+#define PROTOCOL_ASYNC_QUEUE_LENGTH     4
+#define PROTOCOL_ASYNC_BUSY             0xFF    // response payload : too many requests pending, nothing done
+#define PROTOCOL_ASYNC_TASK_PRIORITY    5       // below the UART server task
+#define PROTOCOL_ASYNC_TASK_STACK_SIZE  4096
+
+typedef bool (*PROTOCOL_ASYNC_FN)(PROTOCOL_MSG3full & msg);   // async task : msg becomes the response, false : none
+
+struct PROTOCOL_ASYNC_JOB {
+    PROTOCOL_ASYNC_FN fn;
+    PROTOCOL_MSG3full msg;
+};
+
+static QueueHandle_t async_jobs;
+static QueueHandle_t async_responses;
+
+static void protocol_async_task(void * arg) {
+    PROTOCOL_ASYNC_JOB job;
+    for(;;)
+    {
+        if(xQueueReceive(async_jobs, &job, portMAX_DELAY)!=pdTRUE)
+            continue;
+        if(job.fn(job.msg))
+            xQueueSend(async_responses, &job.msg, portMAX_DELAY);
+    }
+}
+
+// runs fn on the async task, busy answer when it cannot
+static void protocol_async(PROTOCOL_STAT *s, PROTOCOL_MSG3full * msg, PROTOCOL_ASYNC_FN fn) {
+    if(!s->batch)
+    {
+        PROTOCOL_ASYNC_JOB job;
+        job.fn = fn;
+        memcpy(&job.msg, msg, sizeof(job.msg));
+        if(xQueueSend(async_jobs, &job, 0)==pdTRUE)
+            return;
+    }
+    msg->content[0] = PROTOCOL_ASYNC_BUSY;
+    msg->lenPayload = 1;
+    msg->cmd = msg->cmd==PROTOCOL_CMD_WRITEVAL ? PROTOCOL_CMD_WRITEVALRESPONSE : PROTOCOL_CMD_READVALRESPONSE;
+    protocol_post(s, msg);
+}
+
+void protocol_async_poll(PROTOCOL_STAT *s) {
+    PROTOCOL_MSG3full response;
+    while(xQueueReceive(async_responses, &response, 0)==pdTRUE)
+        protocol_post(s, &response);
+}
+
 void fn_servo_enable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_WRITEVAL:
-	    servo1.enable();
+	    servo.enable();
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -43,7 +193,7 @@ void fn_servo_enable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PR
 void fn_servo_disable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_WRITEVAL:
-	    servo1.disableTorque();
+	    servo.disableTorque();
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -52,7 +202,7 @@ void fn_servo_disable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, P
 void fn_servo_torque_enable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_WRITEVAL:
-	    servo1.enableTorque();
+	    servo.enableTorque();
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -61,7 +211,7 @@ void fn_servo_torque_enable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char
 void fn_servo_torque_disable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_WRITEVAL:
-	    servo1.disable();
+	    servo.disable();
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -70,7 +220,7 @@ void fn_servo_torque_disable ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char
 void fn_servo_is_enabled ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
-            isEnabled = servo1.isEnabled;
+            isEnabled = servo.isEnabled;
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -79,7 +229,7 @@ void fn_servo_is_enabled ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd
 void fn_servo_is_torque_enabled ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
-            isEnabled = servo1.isTorqueEnabled;
+            isEnabled = servo.isTorqueEnabled;
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -89,18 +239,14 @@ void fn_servo_set_position ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char c
     fn_defaultProcessing(s, param, cmd, msg);
     switch (cmd) {
         case PROTOCOL_CMD_WRITEVAL:
+	    // goal positions are handed to the control task, the bus is not touched here
 	    if( msg->lenPayload == 4 )
 	    {
-                //ESP_LOGI(TAG, "Position: %u %d", i+1, ((SERVOPARAM*) (param->ptr))->param[i]);
-                servo1.setPosition(((SERVOPARAM*) (param->ptr))->param[0], ((SERVOPARAM*) (param->ptr))->param[1]);
+                servo.setPositionAsync(((SERVOPARAM*) (param->ptr))->param[0], ((SERVOPARAM*) (param->ptr))->param[1]);
 	    }
 	    else if(msg->lenPayload == sizeof(servo_data))
 	    {
-                for(u8 i = 0; i<12; i++)
-                {
-                    //ESP_LOGI(TAG, "Position: %u %d", i+1, ((SERVOPARAM*) (param->ptr))->param[i]);
-                    servo1.setPosition(i+1, ((SERVOPARAM*) (param->ptr))->param[i]);
-                }
+                servo.setPosition12Async(((SERVOPARAM*) (param->ptr))->param);
 	    }
 	    else
 	    {
@@ -111,15 +257,82 @@ void fn_servo_set_position ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char c
     }
 }
 
+// streamed setpoints : no write response, the latest frame replaces any frame not yet sent to the servos
+void fn_servo_stream_position ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+    switch (cmd) {
+        case PROTOCOL_CMD_WRITEVAL:
+            // optional fields absent from a short frame read as 0
+            memset(param->ptr, 0, param->len);
+            memcpy(param->ptr, msg->content, msg->lenPayload < param->len ? msg->lenPayload : param->len);
+	    if( msg->lenPayload < offsetof(SERVOSTREAMPARAM, speed) )
+	    {
+                ESP_LOGE(TAG, "Invalid parameter lenght received: %d", msg->lenPayload);
+                break;
+	    }
+            servo.setPosition12Stream(servo_stream.sequence, servo_stream.timestamp, servo_stream.position,
+                                       msg->lenPayload >= offsetof(SERVOSTREAMPARAM, time) ? servo_stream.speed : NULL,
+                                       msg->lenPayload >= sizeof(servo_stream) ? servo_stream.time : NULL);
+            break;
+        default:
+            fn_defaultProcessing(s, param, cmd, msg);
+            break;
+    }
+}
+
+// trajectory waypoints : 1 to 8 per message, the write response holds the number
+// of waypoints accepted and the room left in the buffer
+void fn_servo_trajectory ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+    switch (cmd) {
+        case PROTOCOL_CMD_WRITEVAL:
+        {
+            memcpy(param->ptr, msg->content, msg->lenPayload < param->len ? msg->lenPayload : param->len);
+            unsigned const count = msg->lenPayload / sizeof(TRAJECTORY_WAYPOINT);
+	    if( count==0 || count>TRAJECTORY_WAYPOINTS_PER_MESSAGE || msg->lenPayload % sizeof(TRAJECTORY_WAYPOINT) )
+	    {
+                ESP_LOGE(TAG, "Invalid parameter lenght received: %d", msg->lenPayload);
+                break;
+	    }
+            unsigned accepted = 0;
+            while( accepted<count && servo.pushWaypoint(trajectory_data.waypoint[accepted]) )
+                ++accepted;
+
+            PROTOCOL_MSG3full newMsg;
+            memcpy(&newMsg, msg, sizeof(PROTOCOL_MSG3full));
+            newMsg.lenPayload = 2;
+            newMsg.cmd = PROTOCOL_CMD_WRITEVALRESPONSE;
+            newMsg.content[0] = accepted;
+            newMsg.content[1] = servo.getTrajectory().getFree();
+            protocol_post(s, &newMsg);
+            break;
+        }
+        default:
+            fn_defaultProcessing(s, param, cmd, msg);
+            break;
+    }
+}
+
+void fn_servo_trajectory_status ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+    switch (cmd) {
+        case PROTOCOL_CMD_READVAL:
+        case PROTOCOL_CMD_SILENTREAD:
+            trajectory_status.free = servo.getTrajectory().getFree();
+            trajectory_status.active = servo.getTrajectory().isActive();
+            trajectory_status.underruns = servo.getTrajectory().getUnderruns();
+            trajectory_status.dropped = servo.getTrajectory().getDropped();
+            break;
+    }
+    fn_defaultProcessingReadOnly(s, param, cmd, msg);
+}
+
+// all servo reads are served from the feedback refreshed by the control task
 void fn_servo_get_position ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
+            servo.getFeedback(servo_feedback);
             for(u8 i = 0; i<12; i++)
 	    {
-                servo_data.param[i] = servo1.ReadPos(i+1);
-                //ESP_LOGI(TAG, "Position: %u %d", i+1, servo_data.param[i]);
+                servo_data.param[i] = servo_feedback.servo[i].position;
 	    }
-            //ESP_LOG_BUFFER_HEX(TAG, &servo_data, sizeof(servo_data));
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -128,10 +341,8 @@ void fn_servo_get_position ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char c
 void fn_servo_get_feedback ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
-            for(u8 i = 0; i<12; i++)
-	    {
-                servo_data.param[i] = servo1.FeedBack(i+1);
-	    }
+            // position, speed, load, current, voltage, temperature, move and validity of all servos
+            servo.getFeedback(servo_feedback);
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -140,9 +351,10 @@ void fn_servo_get_feedback ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char c
 void fn_servo_get_speed ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
+            servo.getFeedback(servo_feedback);
             for(u8 i = 0; i<12; i++)
 	    {
-                servo_data.param[i] = servo1.ReadSpeed(i+1);
+                servo_data.param[i] = servo_feedback.servo[i].speed;
 	    }
             break;
     }
@@ -152,9 +364,10 @@ void fn_servo_get_speed ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd,
 void fn_servo_get_load ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
+            servo.getFeedback(servo_feedback);
             for(u8 i = 0; i<12; i++)
 	    {
-                servo_data.param[i] = servo1.ReadLoad(i+1);
+                servo_data.param[i] = servo_feedback.servo[i].load;
 	    }
             break;
     }
@@ -164,9 +377,10 @@ void fn_servo_get_load ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd,
 void fn_servo_get_voltage ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
+            servo.getFeedback(servo_feedback);
             for(u8 i = 0; i<12; i++)
 	    {
-                servo_data.param[i] = servo1.ReadVoltage(i+1);
+                servo_data.param[i] = servo_feedback.servo[i].voltage;
 	    }
             break;
     }
@@ -176,9 +390,10 @@ void fn_servo_get_voltage ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cm
 void fn_servo_get_temperature ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
+            servo.getFeedback(servo_feedback);
             for(u8 i = 0; i<12; i++)
 	    {
-                servo_data.param[i] = servo1.ReadTemper(i+1);
+                servo_data.param[i] = servo_feedback.servo[i].temperature;
 	    }
             break;
     }
@@ -188,9 +403,10 @@ void fn_servo_get_temperature ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned cha
 void fn_servo_get_move ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
+            servo.getFeedback(servo_feedback);
             for(u8 i = 0; i<12; i++)
 	    {
-                servo_data.param[i] = servo1.ReadMove(i+1);
+                servo_data.param[i] = servo_feedback.servo[i].move;
 	    }
             break;
     }
@@ -200,27 +416,34 @@ void fn_servo_get_move ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd,
 void fn_servo_get_current ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
+            servo.getFeedback(servo_feedback);
             for(u8 i = 0; i<12; i++)
 	    {
-                servo_data.param[i] = servo1.ReadCurrent(i+1);
+                servo_data.param[i] = servo_feedback.servo[i].current;
 	    }
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
 }
 
+// every servo is pinged on the bus, up to 12 response windows : run on the async task
+static bool servo_ping(PROTOCOL_MSG3full & msg) {
+    SERVOPARAM ids;
+    for(u8 i = 0; i<12; i++)
+    {
+        ids.param[i] = servo.ping(i+1)==i+1 ? i+1 : 0;
+    }
+    memcpy(msg.content, &ids, sizeof(ids));
+    msg.lenPayload = sizeof(ids);
+    msg.cmd = PROTOCOL_CMD_READVALRESPONSE;
+    return true;
+}
+
 void fn_servo_ping ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
-            for(u8 i = 0; i<12; i++)
-	    {
-                servo_data.param[i] = 0;
-                if(servo1.Ping(i+1) == i+1) {
-                    servo_data.param[i] = i+1;
-                    //ESP_LOGI(TAG, "Ping: %u", i+1);
-                }
-	    }
-            break;
+            if(msg) protocol_async(s, msg, servo_ping);
+            return;
     }
     fn_defaultProcessing(s, param, cmd, msg);
 }
@@ -228,11 +451,11 @@ void fn_servo_ping ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROT
 void fn_imu_get_6dof ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
-            imu1.read_6dof();
-	    memcpy(&imu_6dof_data.acc, &imu1.acc, sizeof(imu1.acc));
-	    memcpy(&imu_6dof_data.gyro, &imu1.gyro, sizeof(imu1.gyro));
+            imu.getSnapshot(imu_snapshot);
+	    memcpy(&imu_6dof_data.acc, &imu_snapshot.acc, sizeof(imu_snapshot.acc));
+	    memcpy(&imu_6dof_data.gyro, &imu_snapshot.gyro, sizeof(imu_snapshot.gyro));
             //ESP_LOG_BUFFER_HEX(TAG, &imu_6dof_data, sizeof(imu_6dof_data));
-	    //printf("%f\t%f\t%f\t%f\t%f\t%f \r\n", imu1.acc.x, imu1.acc.y, imu1.acc.z, imu1.gyro.x, imu1.gyro.y, imu1.gyro.z);
+	    //printf("%f\t%f\t%f\t%f\t%f\t%f \r\n", imu.acc.x, imu.acc.y, imu.acc.z, imu.gyro.x, imu.gyro.y, imu.gyro.z);
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
@@ -241,26 +464,199 @@ void fn_imu_get_6dof ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PR
 void fn_imu_get_attitude ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
     switch (cmd) {
         case PROTOCOL_CMD_READVAL:
-            imu1.read_attitude();
-	    memcpy(&imu_att_data.dq, &imu1.dq, sizeof(imu1.dq));
-	    memcpy(&imu_att_data.dv, &imu1.dv, sizeof(imu1.dv));
-            imu_att_data.ae_reg1 = imu1.ae_reg1;
-            imu_att_data.ae_reg2 = imu1.ae_reg2;
+            imu.getSnapshot(imu_snapshot);
+	    memcpy(&imu_att_data.dq, &imu_snapshot.dq, sizeof(imu_snapshot.dq));
+	    memcpy(&imu_att_data.dv, &imu_snapshot.dv, sizeof(imu_snapshot.dv));
+            imu_att_data.ae_reg1 = imu_snapshot.ae_reg1;
+            imu_att_data.ae_reg2 = imu_snapshot.ae_reg2;
             //ESP_LOG_BUFFER_HEX(TAG, &imu_att_data, sizeof(imu_att_data));
-            //printf("%f\t%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d \r\n", imu1.dq.w, imu1.dq.v.x, imu1.dq.v.y, imu1.dq.v.x, imu1.dv.x, imu1.dv.y, imu1.dv.z, imu1.ae_reg1, imu1.ae_reg2);
+            //printf("%f\t%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d \r\n", imu.dq.w, imu.dq.v.x, imu.dq.v.y, imu.dq.v.x, imu.dv.x, imu.dv.y, imu.dv.z, imu.ae_reg1, imu.ae_reg2);
+            break;
+    }
+    fn_defaultProcessing(s, param, cmd, msg);
+}
+
+// READVAL response to fill in straight in the frame it is sent from, NULL if it has to be queued
+static PROTOCOL_MSG3full * reserve_response(PROTOCOL_STAT *s, PROTOCOL_MSG3full *msg, unsigned char len) {
+    PROTOCOL_MSG3full *frame = protocol_reserve(s, msg->SOM);
+    if(frame) {
+        frame->cmd = PROTOCOL_CMD_READVALRESPONSE;
+        frame->code = msg->code;
+        frame->lenPayload = len;
+    }
+    return frame;
+}
+
+static void build_telemetry(TELEMETRYPARAM & telemetry) {
+    servo.getFeedback(servo_feedback);
+    imu.getSnapshot(imu_snapshot);
+    telemetry.version = TELEMETRY_VERSION;
+    telemetry.timestamp = servo_feedback.timestamp;
+    telemetry.sequence = servo_feedback.sequence;
+    telemetry.valid = 0;
+    for(u8 i = 0; i<12; i++)
+    {
+        telemetry.valid |= servo_feedback.servo[i].valid<<i;
+        telemetry.position[i] = servo_feedback.servo[i].position;
+        telemetry.load[i] = servo_feedback.servo[i].load;
+    }
+    memcpy(&telemetry.acc, &imu_snapshot.acc, sizeof(imu_snapshot.acc));
+    memcpy(&telemetry.gyro, &imu_snapshot.gyro, sizeof(imu_snapshot.gyro));
+}
+
+// servo and IMU state in one message, meant to be subscribed to (code 0x22)
+void fn_telemetry ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+    switch (cmd) {
+        case PROTOCOL_CMD_READVAL: {
+            // packed, serialized in the frame itself
+            PROTOCOL_MSG3full *frame = msg ? reserve_response(s, msg, sizeof(TELEMETRYPARAM)) : NULL;
+            if(frame) {
+                build_telemetry(*(TELEMETRYPARAM *)frame->content);
+                protocol_commit(s, frame);
+                return;
+            }
+            build_telemetry(telemetry);
+            break;
+        }
+        case PROTOCOL_CMD_SILENTREAD:
+            build_telemetry(telemetry);
+            break;
+    }
+    fn_defaultProcessingReadOnly(s, param, cmd, msg);
+}
+
+static void build_state(STATEPARAM & state) {
+    servo.getFeedback(servo_feedback);
+    imu.getSnapshot(imu_snapshot);
+    state.version = STATE_VERSION;
+    state.timestamp = servo_feedback.timestamp;
+    state.sequence = servo_feedback.sequence;
+    state.valid = 0;
+    state.move = 0;
+    for(u8 i = 0; i<12; i++)
+    {
+        SERVO_STATE const & servo = servo_feedback.servo[i];
+        state.valid |= servo.valid<<i;
+        state.move |= (servo.move!=0)<<i;
+        state.position[i] = servo.position;
+        state.speed[i] = servo.speed;
+        state.load[i] = servo.load;
+        state.current[i] = servo.current;
+        state.voltage[i] = servo.voltage;
+        state.temperature[i] = servo.temperature;
+    }
+    state.imu_timestamp = imu_snapshot.timestamp;
+    state.imu_valid = imu_snapshot.valid;
+    memcpy(&state.acc, &imu_snapshot.acc, sizeof(imu_snapshot.acc));
+    memcpy(&state.gyro, &imu_snapshot.gyro, sizeof(imu_snapshot.gyro));
+    memcpy(&state.dq, &imu_snapshot.dq, sizeof(imu_snapshot.dq));
+}
+
+// every servo field and the IMU sample in one message, built from cached state
+void fn_state ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+    switch (cmd) {
+        case PROTOCOL_CMD_READVAL: {
+            // packed, serialized in the frame itself
+            PROTOCOL_MSG3full *frame = msg ? reserve_response(s, msg, sizeof(STATEPARAM)) : NULL;
+            if(frame) {
+                build_state(*(STATEPARAM *)frame->content);
+                protocol_commit(s, frame);
+                return;
+            }
+            build_state(state);
+            break;
+        }
+        case PROTOCOL_CMD_SILENTREAD:
+            build_state(state);
+            break;
+    }
+    fn_defaultProcessingReadOnly(s, param, cmd, msg);
+}
+
+// the last IMU samples, larger than one frame : sent in fragments
+void fn_imu_get_batch ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+    switch (cmd) {
+        case PROTOCOL_CMD_READVAL:
+        case PROTOCOL_CMD_SILENTREAD:
+            // the parts are read from imu_batch as they are sent, it is left alone until the last one is
+            // in a batch nothing is sent (empty record)
+            if(!s->fragment_tx.data && !s->batch) {
+                uint32_t sequence;
+                imu_batch.version = IMU_BATCH_VERSION;
+                imu_batch.count = imu.getHistory(imu_history, sequence);
+                imu_batch.sequence = sequence;
+                memcpy(imu_batch.sample, imu_history, sizeof(imu_history));
+            }
+            break;
+    }
+    fn_defaultProcessingReadOnly(s, param, cmd, msg);
+}
+
+static u16 saturate16(u32 value) {
+    return value>0xffff ? 0xffff : (u16)value;
+}
+
+// servo bus statistics, any write resets them
+void fn_bus_stats ( PROTOCOL_STAT *s, PARAMSTAT *param, unsigned char cmd, PROTOCOL_MSG3full *msg ) {
+    SCSProfiler const & stats = servo.bus_stats;
+    switch (cmd) {
+        case PROTOCOL_CMD_WRITEVAL:
+            servo.bus_stats.reset();
+            break;
+        case PROTOCOL_CMD_READVAL:
+        case PROTOCOL_CMD_SILENTREAD:
+            bus_stats_data.version = BUS_STATS_VERSION;
+            for(u8 i = 0; i<SCS_PROF_INST_NUM; i++)
+	    {
+                bus_stats_data.inst[i].count = stats.Inst[i].Count;
+                bus_stats_data.inst[i].timeout = stats.Inst[i].Timeout;
+                bus_stats_data.inst[i].chkerr = stats.Inst[i].ChkErr;
+                bus_stats_data.inst[i].min = stats.Inst[i].Count ? saturate16(stats.Inst[i].Min) : 0;
+                bus_stats_data.inst[i].mean = saturate16(stats.mean(i));
+                bus_stats_data.inst[i].p50 = saturate16(stats.percentile(i, 50));
+                bus_stats_data.inst[i].p99 = saturate16(stats.percentile(i, 99));
+                bus_stats_data.inst[i].max = saturate16(stats.Inst[i].Max);
+	    }
+            for(u8 i = 0; i<12; i++)
+	    {
+                bus_stats_data.servo[i].timeout = stats.Servo[i+1].Timeout;
+                bus_stats_data.servo[i].chkerr = stats.Servo[i+1].ChkErr;
+                bus_stats_data.servo[i].retry = saturate16(stats.Servo[i+1].Retry);
+	    }
             break;
     }
     fn_defaultProcessing(s, param, cmd, msg);
 }
 
+static uint32_t protocol_tick_ms() {
+    return (uint32_t)(esp_timer_get_time()/1000);
+}
+
+static void protocol_delay_ms(uint32_t delay) {
+    vTaskDelay(delay / portTICK_PERIOD_MS);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 // initialize protocol and register functions
 int setup_protocol(PROTOCOL_STAT *s) {
 
     int errors = 0;
 
+    // timeouts and subscriptions need a millisecond tick
+    protocol_GetTick = protocol_tick_ms;
+    protocol_Delay = protocol_delay_ms;
+
     errors += protocol_init(&sUSART2);
 
+    async_jobs = xQueueCreate(PROTOCOL_ASYNC_QUEUE_LENGTH, sizeof(PROTOCOL_ASYNC_JOB));
+    async_responses = xQueueCreate(PROTOCOL_ASYNC_QUEUE_LENGTH, sizeof(PROTOCOL_MSG3full));
+    xTaskCreate(protocol_async_task, "protocol_async_task", PROTOCOL_ASYNC_TASK_STACK_SIZE, NULL, PROTOCOL_ASYNC_TASK_PRIORITY, NULL);
+
+    // from now on, the control task owns the servo bus and the sampling task owns the IMU
+    // handlers only read their snapshots
+    servo.start();
+    imu.start();
+
     //sUSART2.send_serial_data=USART2_IT_send;
     //sUSART2.send_serial_data_wait=USART2_IT_send;
     sUSART2.timeout1 = 500;
@@ -291,7 +687,7 @@ int setup_protocol(PROTOCOL_STAT *s) {
     errors += setParamVariable( s, 0x77, UI_NONE, (void*)&servo_data, sizeof(servo_data) );
     setParamHandler( s, 0x77, fn_servo_get_position );
 
-    errors += setParamVariable( s, 0x78, UI_NONE, (void*)&servo_data, sizeof(servo_data) );
+    errors += setParamVariable( s, 0x78, UI_NONE, (void*)&servo_feedback.servo, sizeof(servo_feedback.servo) );
     setParamHandler( s, 0x78, fn_servo_get_feedback );
 
     errors += setParamVariable( s, 0x79, UI_NONE, (void*)&servo_data, sizeof(servo_data) );
@@ -315,6 +711,27 @@ int setup_protocol(PROTOCOL_STAT *s) {
     errors += setParamVariable( s, 0x7F, UI_NONE, (void*)&servo_data, sizeof(servo_data) );
     setParamHandler( s, 0x7F, fn_servo_ping );
 
+    errors += setParamVariable( s, 0x40, UI_NONE, (void*)&servo_stream, sizeof(servo_stream) );
+    setParamHandler( s, 0x40, fn_servo_stream_position );
+
+    errors += setParamVariable( s, 0x42, UI_NONE, (void*)&telemetry, sizeof(telemetry) );
+    setParamHandler( s, 0x42, fn_telemetry );
+
+    errors += setParamVariable( s, 0x43, UI_NONE, (void*)&state, sizeof(state) );
+    setParamHandler( s, 0x43, fn_state );
+
+    errors += setParamVariable( s, 0x44, UI_NONE, (void*)&bus_stats_data, sizeof(bus_stats_data) );
+    setParamHandler( s, 0x44, fn_bus_stats );
+
+    errors += setParamVariable( s, 0x45, UI_NONE, (void*)&trajectory_data, sizeof(trajectory_data) );
+    setParamHandler( s, 0x45, fn_servo_trajectory );
+
+    errors += setParamVariable( s, 0x46, UI_NONE, (void*)&trajectory_status, sizeof(trajectory_status) );
+    setParamHandler( s, 0x46, fn_servo_trajectory_status );
+
+    errors += setParamVariable( s, 0x47, UI_NONE, (void*)&imu_batch, sizeof(imu_batch) );
+    setParamHandler( s, 0x47, fn_imu_get_batch );
+
     errors += setParamVariable( s, 0x60, UI_NONE, (void*)&imu_6dof_data, sizeof(imu_6dof_data) );
     setParamHandler( s, 0x60, fn_imu_get_6dof );
 
@@ -3,5 +3,7 @@
 #include "protocol.h"
 
 int setup_protocol(PROTOCOL_STAT *s);
+// responses of the async handlers, posted by the task running the protocol
+void protocol_async_poll(PROTOCOL_STAT *s);
 
 extern PROTOCOL_STAT sUSART2;
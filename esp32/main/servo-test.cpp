@@ -21,7 +21,6 @@
 #include "esp_timer.h"
 #include "driver/uart.h"
 #include "mini_pupper_servos.h"
-extern SERVO servo;
 // Pat92fr
 
 static const char* TAG = "servo_tests";
@@ -100,13 +99,10 @@ extern "C" void app_main(void)
 
     /* Register commands */
     esp_console_register_help_command();
-#if CONFIG_RASPI_CONTROLLED
-    /* start UART server for Raspberry Pi communication */
+    /* start UART server for Raspberry Pi communication, the console shares the servo bus and the IMU with it */
     UARTServer uart_server;
-#else
     register_servo_cmds();
     register_imu_cmds();
-#endif
     register_system();
     register_wifi();
 
@@ -212,12 +208,9 @@ extern "C" void app_main(void)
 
     // TODO : test send pos+vel timing at 500kbps, with and w/o ring buffer
     // TODO : test send pos+vel and rcv feedback timing at 500kbps, with and w/o ring buffer
-    // TODO : test send pos+vel timing at 1Mbps.
-    // TODO : test send pos+vel and rcv feedback timing at 1Mbps.
+    // send pos+vel and rcv feedback timing at 1Mbps, 500kbps and 250kbps : see servo-baud-bench
     // TODO : communication about performances
 
-    // TODO desactiver return ACK
-
     // TODO : timing of a sequence of 12 set pos+vel
     // TODO : timing of a sequence of 12 set pos+vel and feedback
     // TODO : communication about frequency (>200Hz)
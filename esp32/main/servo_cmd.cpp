@@ -1,4 +1,5 @@
 #include "mini_pupper_servos.h"
+#include "SCSBaud.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <stdio.h>
@@ -13,8 +14,6 @@
 #include "nvs.h"
 #include "nvs_flash.h"
 
-SERVO servo;
-
 static const char *TAG = "SERVOCMD";
 static uint64_t start_time = 0;
 static uint64_t end_time = 0;
@@ -142,7 +141,7 @@ static int servo_cmd_scan(int argc, char **argv)
     printf("Servos on the bus:\r\n");
     for(u8 i = 0; i<13; i++)
     {
-        if(servo.Ping(i) == i) {
+        if(servo.ping(i) == i) {
             printf("%d ", i);
 	}
     }
@@ -162,6 +161,210 @@ static void register_servo_cmd_scan(void)
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd_servo_scan) );
 }
 
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} servo_stats_args;
+
+static int servo_cmd_stats(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&servo_stats_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, servo_stats_args.end, argv[0]);
+        return 0;
+    }
+    SCSProfiler const & stats = servo.bus_stats;
+    static char const * const names[SCS_PROF_INST_NUM] = {"write", "read", "sync-write", "sync-read", "ping"};
+    printf("Latency (us):\r\n");
+    printf("%-10s %8s %8s %8s %6s %6s %6s %6s %6s\r\n", "", "count", "timeout", "chkerr", "min", "mean", "p50", "p99", "max");
+    for(u8 i = 0; i<SCS_PROF_INST_NUM; i++)
+    {
+        SCSProfInst const & inst = stats.Inst[i];
+        printf("%-10s %8lu %8lu %8lu %6lu %6lu %6lu %6lu %6lu\r\n", names[i],
+            (unsigned long)inst.Count, (unsigned long)inst.Timeout, (unsigned long)inst.ChkErr,
+            (unsigned long)(inst.Count ? inst.Min : 0), (unsigned long)stats.mean(i),
+            (unsigned long)stats.percentile(i, 50), (unsigned long)stats.percentile(i, 99), (unsigned long)inst.Max);
+    }
+    printf("Histogram (us):\r\n");
+    for(u8 b = 0; b<SCS_PROF_BUCKETS; b++)
+    {
+        u32 limit = SCSProfiler::bucketLimit(b);
+        if(limit)
+            printf("<%-9lu", (unsigned long)limit);
+        else
+            printf(">=%-8lu", (unsigned long)SCSProfiler::bucketLimit(b-1));
+        for(u8 i = 0; i<SCS_PROF_INST_NUM; i++)
+            printf(" %8lu", (unsigned long)stats.Inst[i].Hist[b]);
+        printf("\r\n");
+    }
+    printf("Servos:\r\n");
+    printf("%-4s %8s %8s %8s %8s\r\n", "id", "answers", "timeout", "chkerr", "retries");
+    for(u8 id = 0; id<SCS_PROF_MAX_ID; id++)
+    {
+        SCSProfServo const & stat = stats.Servo[id];
+        if(!stat.Count && !stat.Timeout && !stat.ChkErr && !stat.Retry)
+            continue;
+        printf("%-4d %8lu %8lu %8lu %8lu\r\n", id,
+            (unsigned long)stat.Count, (unsigned long)stat.Timeout, (unsigned long)stat.ChkErr, (unsigned long)stat.Retry);
+    }
+    if(servo_stats_args.reset->count)
+        servo.bus_stats.reset();
+    return 0;
+}
+
+static void register_servo_cmd_stats(void)
+{
+    servo_stats_args.reset = arg_lit0("r", "reset", "reset the statistics once printed");
+    servo_stats_args.end = arg_end(1);
+    const esp_console_cmd_t cmd_servo_stats = {
+        .command = "servo-stats",
+        .help = "servo bus latency histograms, timeouts, checksum errors and retries",
+        .hint = "[-r]",
+        .func = &servo_cmd_stats,
+	.argtable = NULL
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd_servo_stats) );
+}
+
+static u8 const servo_baud_ids[] {1,2,3,4,5,6,7,8,9,10,11,12};
+
+static int servo_cmd_baud_scan(int argc, char **argv)
+{
+    u8 index[SERVO_NUMBER];
+    // the control task leaves the bus alone while the rates are changed
+    servo.pause();
+    servo.lock();
+    int const found {SCSBaud::scan(servo, servo_baud_ids, SERVO_NUMBER, index)};
+    servo.unlock();
+    servo.resume();
+    for(u8 i = 0; i<SERVO_NUMBER; i++)
+    {
+        if(index[i]==SCS_BAUD_NONE)
+            printf("%-4d not found\r\n", servo_baud_ids[i]);
+        else
+            printf("%-4d %lu\r\n", servo_baud_ids[i], (unsigned long)SCSBaud::rate(index[i]));
+    }
+    printf("%d servos found, bus left at %lu baud\r\n", found, (unsigned long)servo.Timing.Baud);
+    return 0;
+}
+
+static void register_servo_cmd_baud_scan(void)
+{
+    const esp_console_cmd_t cmd_servo_baud_scan = {
+        .command = "servo-baud-scan",
+        .help = "find the baud rate of each servo",
+        .hint = NULL,
+        .func = &servo_cmd_baud_scan,
+	.argtable = NULL
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd_servo_baud_scan) );
+}
+
+static struct {
+    struct arg_int *rate;
+    struct arg_end *end;
+} servo_baud_set_args;
+
+static int servo_cmd_baud_set(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&servo_baud_set_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, servo_baud_set_args.end, argv[0]);
+        return 0;
+    }
+    u32 const rate = servo_baud_set_args.rate->ival[0];
+    u8 const index {SCSBaud::index(rate)};
+    if(index==SCS_BAUD_NONE) {
+        printf("Invalid baud rate\r\n");
+        return 0;
+    }
+    servo.pause();
+    servo.lock();
+    int const moved {SCSBaud::migrate(servo, servo_baud_ids, SERVO_NUMBER, index)};
+    servo.unlock();
+    servo.resume();
+    printf("%d servos at %lu baud\r\n", moved, (unsigned long)rate);
+    if(rate!=CONFIG_SERVO_BAUD_RATE)
+        printf("Warning: the firmware is configured for %d baud (CONFIG_SERVO_BAUD_RATE)\r\n", CONFIG_SERVO_BAUD_RATE);
+    return 0;
+}
+
+static void register_servo_cmd_baud_set(void)
+{
+    servo_baud_set_args.rate = arg_int1(NULL, "rate", "<baud>", "Baud rate, 1000000 to 4800");
+    servo_baud_set_args.end = arg_end(2);
+    const esp_console_cmd_t cmd_servo_baud_set = {
+        .command = "servo-baud-set",
+        .help = "move the servos to another baud rate (EEPROM)",
+        .hint = "--rate <baud>",
+        .func = &servo_cmd_baud_set,
+	.argtable = NULL
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd_servo_baud_set) );
+}
+
+static struct {
+    struct arg_int *cycles;
+    struct arg_end *end;
+} servo_baud_bench_args;
+
+static int servo_cmd_baud_bench(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&servo_baud_bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, servo_baud_bench_args.end, argv[0]);
+        return 0;
+    }
+    int const cycles = servo_baud_bench_args.cycles->count ? servo_baud_bench_args.cycles->ival[0] : 100;
+    if(cycles<1 || cycles>10000) {
+        printf("Invalid number of cycles\r\n");
+        return 0;
+    }
+    // servos are moved back to the rate they were found at
+    servo.pause();
+    servo.lock();
+    u8 const origin {SCSBaud::discover(servo, servo_baud_ids[0], SCSBaud::index(servo.Timing.Baud))};
+    if(origin==SCS_BAUD_NONE) {
+        servo.unlock();
+        servo.resume();
+        printf("Servo %d not found\r\n", servo_baud_ids[0]);
+        return 0;
+    }
+    static u32 const rates[] {1000000, 500000, 250000};
+    printf("Sync write + sync read of %d feedback bytes (us):\r\n", SCS_BAUD_BENCH_LEN);
+    printf("%-8s %6s %6s %10s %9s %6s %6s\r\n", "baud", "servos", "cycles", "sync-write", "sync-read", "cycle", "missed");
+    for(u32 rate : rates)
+    {
+        SCSBaudBench result;
+        if(SCSBaud::migrate(servo, servo_baud_ids, SERVO_NUMBER, SCSBaud::index(rate))<=0) {
+            printf("%-8lu no servo at this rate\r\n", (unsigned long)rate);
+            continue;
+        }
+        SCSBaud::bench(servo, servo_baud_ids, SERVO_NUMBER, cycles, result);
+        printf("%-8lu %6d %6d %10lu %9lu %6lu %6lu\r\n", (unsigned long)result.Baud, result.Servos, result.Cycles,
+            (unsigned long)result.SyncWrite, (unsigned long)result.SyncRead, (unsigned long)result.Cycle, (unsigned long)result.Missed);
+    }
+    int const moved {SCSBaud::migrate(servo, servo_baud_ids, SERVO_NUMBER, origin)};
+    servo.unlock();
+    servo.resume();
+    printf("%d servos back at %lu baud\r\n", moved, (unsigned long)SCSBaud::rate(origin));
+    return 0;
+}
+
+static void register_servo_cmd_baud_bench(void)
+{
+    servo_baud_bench_args.cycles = arg_int0(NULL, "cycles", "<n>", "Cycles per baud rate (100)");
+    servo_baud_bench_args.end = arg_end(2);
+    const esp_console_cmd_t cmd_servo_baud_bench = {
+        .command = "servo-baud-bench",
+        .help = "sync write + sync read cycle time at 1M, 500k and 250k baud",
+        .hint = "[--cycles <n>]",
+        .func = &servo_cmd_baud_bench,
+	.argtable = NULL
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd_servo_baud_bench) );
+}
+
 static struct {
     struct arg_int *servo_id;
     struct arg_end *end;
@@ -258,7 +461,10 @@ static int servo_cmd_perftest(int argc, char **argv)
     bool hasError = false;
     for (id = start_range; id <= end_range; id++) {
         if(! servo.checkPosition((u8)id, (u16)start_pos, accuracy)) {
-            ESP_LOGE(TAG, "Servo %d has not reached it's starting position. Expected % d Read, %d", id, start_pos, servo.ReadPos((u8)id));
+            servo.lock();
+            int const pos {servo.ReadPos((u8)id)};
+            servo.unlock();
+            ESP_LOGE(TAG, "Servo %d has not reached it's starting position. Expected % d Read, %d", id, start_pos, pos);
             hasError = true;
         }
     }
@@ -595,7 +801,10 @@ static int servo_cmd_FeedBack(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("FeedBack: %d\r\n", servo.FeedBack((u8)servo_id));
+        servo.lock();
+        int const value {servo.FeedBack((u8)servo_id)};
+        servo.unlock();
+        printf("FeedBack: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -636,7 +845,10 @@ static int servo_cmd_ReadPos(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("ReadPos: %d\r\n", servo.ReadPos((u8)servo_id));
+        servo.lock();
+        int const value {servo.ReadPos((u8)servo_id)};
+        servo.unlock();
+        printf("ReadPos: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -677,7 +889,10 @@ static int servo_cmd_ReadSpeed(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("ReadSpeed: %d\r\n", servo.ReadSpeed((u8)servo_id));
+        servo.lock();
+        int const value {servo.ReadSpeed((u8)servo_id)};
+        servo.unlock();
+        printf("ReadSpeed: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -718,7 +933,10 @@ static int servo_cmd_ReadLoad(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("ReadLoad: %d\r\n", servo.ReadLoad((u8)servo_id));
+        servo.lock();
+        int const value {servo.ReadLoad((u8)servo_id)};
+        servo.unlock();
+        printf("ReadLoad: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -759,7 +977,10 @@ static int servo_cmd_ReadVoltage(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("ReadVoltage: %d\r\n", servo.ReadVoltage((u8)servo_id));
+        servo.lock();
+        int const value {servo.ReadVoltage((u8)servo_id)};
+        servo.unlock();
+        printf("ReadVoltage: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -800,7 +1021,10 @@ static int servo_cmd_ReadTemper(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("ReadTemper: %d\r\n", servo.ReadTemper((u8)servo_id));
+        servo.lock();
+        int const value {servo.ReadTemper((u8)servo_id)};
+        servo.unlock();
+        printf("ReadTemper: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -841,7 +1065,10 @@ static int servo_cmd_ReadMove(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("ReadMove: %d\r\n", servo.ReadMove((u8)servo_id));
+        servo.lock();
+        int const value {servo.ReadMove((u8)servo_id)};
+        servo.unlock();
+        printf("ReadMove: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -882,7 +1109,10 @@ static int servo_cmd_ReadCurrent(int argc, char **argv)
         return 0;
     }
     for(int i=0; i<loop; i++){
-        printf("ReadCurrent: %d\r\n", servo.ReadCurrent((u8)servo_id));
+        servo.lock();
+        int const value {servo.ReadCurrent((u8)servo_id)};
+        servo.unlock();
+        printf("ReadCurrent: %d\r\n", value);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
     return 0;
@@ -912,6 +1142,10 @@ void register_servo_cmds(void)
     register_servo_cmd_enableTorque();
     register_servo_cmd_isTorqueEnabled();
     register_servo_cmd_scan();
+    register_servo_cmd_stats();
+    register_servo_cmd_baud_scan();
+    register_servo_cmd_baud_set();
+    register_servo_cmd_baud_bench();
     register_servo_cmd_rotate();
     register_servo_cmd_perftest();
     register_servo_cmd_setStartPos();
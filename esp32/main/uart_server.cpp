@@ -6,6 +6,7 @@
 #include "freertos/task.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
 #include "esp_log.h"
 
@@ -16,17 +17,32 @@
 
 #define UART_SERVER_PORT_NUM      2
 #define UART_SERVER_BAUD_RATE     3000000 // seams to be the limit
-#define UART_SERVER_TASK_STACK_SIZE    4096
+#define UART_SERVER_TASK_STACK_SIZE    6144    // batches nest a response and a record (2x 259 bytes) over the handlers
+#define UART_SERVER_EVENT_QUEUE_LENGTH 32
+#define UART_SERVER_RX_FULL_THRESHOLD  64      // bytes in the RX FIFO before the task is woken up
+#define UART_SERVER_RX_TIMEOUT         2       // idle symbols after the last byte before the task is woken up (<10us at 3Mbaud)
+#define UART_SERVER_TICK_US            1000    // protocol tick : ACK timeouts, retries and subscriptions
+#define UART_SERVER_EVENT_TICK         ((uart_event_type_t)(UART_EVENT_MAX+1))
 
 static const char *TAG = "UART TEST";
 
 #define BUF_SIZE (1024)
 
+static QueueHandle_t uart_queue;
+
 static int send_serial_data( unsigned char *data, int len ) {
     uart_write_bytes(UART_SERVER_PORT_NUM, data, len);
     return len;
 }
 
+static void tick_timer(void *arg)
+{
+    // the tick goes through the UART event queue : the protocol is only run by the server task
+    uart_event_t event = {};
+    event.type = UART_SERVER_EVENT_TICK;
+    xQueueSend(uart_queue, &event, 0);
+}
+
 static void server_task(void *arg)
 {
     /* Configure parameters of an UART driver,
@@ -41,9 +57,12 @@ static void server_task(void *arg)
         .source_clk = UART_SCLK_DEFAULT,
     };
 
-    ESP_ERROR_CHECK(uart_driver_install(UART_SERVER_PORT_NUM, 2*1024, 0, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_driver_install(UART_SERVER_PORT_NUM, 2*1024, 0, UART_SERVER_EVENT_QUEUE_LENGTH, &uart_queue, 0));
     ESP_ERROR_CHECK(uart_param_config( UART_SERVER_PORT_NUM, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin( UART_SERVER_PORT_NUM, UART_SERVER_TXD, UART_SERVER_RXD, UART_SERVER_RTS, UART_SERVER_CTS));
+    // a frame is reported as soon as the line is idle after it, instead of waiting for 120 bytes
+    ESP_ERROR_CHECK(uart_set_rx_full_threshold( UART_SERVER_PORT_NUM, UART_SERVER_RX_FULL_THRESHOLD));
+    ESP_ERROR_CHECK(uart_set_rx_timeout( UART_SERVER_PORT_NUM, UART_SERVER_RX_TIMEOUT));
 
     // Configure a temporary buffer for the incoming data
     uint8_t *data = (uint8_t *) malloc(BUF_SIZE);
@@ -51,19 +70,50 @@ static void server_task(void *arg)
     setup_protocol(&sUSART2);
     sUSART2.send_serial_data = send_serial_data;
 
+    // FreeRTOS tick is too coarse (10ms) for ACK timeouts and subscriptions, use a high resolution timer
+    esp_timer_create_args_t const timer_args = {
+        .callback = &tick_timer,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "uart_server_tick",
+        .skip_unhandled_events = true
+    };
+    esp_timer_handle_t timer;
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer, UART_SERVER_TICK_US));
+
     while (1) {
-        // Read data from the UART
-        int len = uart_read_bytes( UART_SERVER_PORT_NUM, data, (BUF_SIZE - 1), 20 / portTICK_PERIOD_MS);
-        if (len) {
-            //ESP_LOGI(TAG, "Recv str len: %d", len);
-	    //ESP_LOG_BUFFER_HEX(TAG, data, len);
-            for(int i = 0; i<len; i++) {
-		protocol_byte( &sUSART2, (unsigned char) data[i]);
+        // wait for received bytes or the next protocol tick
+        uart_event_t event;
+        if(xQueueReceive(uart_queue, &event, portMAX_DELAY)!=pdTRUE) {
+            continue;
+        }
+        if(event.type==UART_SERVER_EVENT_TICK) {
+            protocol_async_poll( &sUSART2 );
+            protocol_tick( &sUSART2 );
+            continue;
+        }
+        switch(event.type) {
+        case UART_DATA: {
+            // everything received so far, then queued responses are sent right away
+            int len;
+            while((len = uart_read_bytes( UART_SERVER_PORT_NUM, data, BUF_SIZE, 0))>0) {
+                //ESP_LOGI(TAG, "Recv str len: %d", len);
+                //ESP_LOG_BUFFER_HEX(TAG, data, len);
+                protocol_bytes( &sUSART2, data, len);
             }
-             
-            data[len] = '\0';
+            protocol_tick( &sUSART2 );
+            break;
+        }
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            ESP_LOGW(TAG, "RX overflow");
+            uart_flush_input(UART_SERVER_PORT_NUM);
+            xQueueReset(uart_queue);
+            break;
+        default:
+            break;
         }
-        protocol_tick( &sUSART2 );
     }
 }
 